@@ -28,52 +28,55 @@
 namespace process
 {
 	action::action()
-		: process(ProcessPriority::action)
+		: process(ProcessPriority::action),
+		  query_(0)
 	{
+		using namespace component;
+		declare_access(genmask(Component::PLAYER) | genmask(Component::POSITION) | genmask(Component::INPUT) | genmask(Component::STATS),
+			genmask(Component::POSITION) | genmask(Component::INPUT) | genmask(Resource::MAP) | genmask(Resource::ENGINE));
 	}
 
-	void action::update(engine& eng, float t, const entity_list& elist)
+	void action::start(engine& eng)
 	{
 		using namespace component;
-		static component_id mask = genmask(Component::INPUT) | genmask(Component::POSITION);
-		for(auto& e : elist) {
-			if((e->mask & mask) == mask) {
-				auto& inp = e->inp;
-				auto& pos = e->pos;
+		query_ = eng.register_query(genmask(Component::INPUT) | genmask(Component::POSITION));
+	}
 
-				switch(inp->action)
-				{
-				case input::Action::none:	break;
-				case input::Action::moved:	
-					// Test to see if we moved but the collision detection failed it.
-					// XX there must be a better way.
-					if(pos->mov.x == 0 && pos->mov.y == 0) {
-						inp->action = input::Action::none;
-					} else {
-						e->pos->pos += e->pos->mov;
-						e->pos->mov.clear();
-						if(e->is_player()) {
-							eng.set_camera(e->pos->pos);
+	void action::update(engine& eng, float t, const entity_list& elist)
+	{
+		using namespace component;
+		for(auto& e : eng.get_query(query_)) {
+			auto& inp = e->inp;
+			auto& pos = e->pos;
 
-							eng.getMap()->clearVisible();
-							eng.getMap()->updatePlayerVisibility(e->pos->pos, e->stat->visible_radius);
-						}
+			switch(inp->action)
+			{
+			case input::Action::none:	break;
+			case input::Action::moved:	
+				// Test to see if we moved but the collision detection failed it.
+				// XX there must be a better way.
+				if(pos->mov.x == 0 && pos->mov.y == 0) {
+					inp->action = input::Action::none;
+				} else {
+					eng.move_entity(e, e->pos->pos + e->pos->mov);
+					e->pos->mov.clear();
+					if(e->is_player()) {
+						eng.set_camera(e->pos->pos);
+						eng.getMap()->updatePlayerVisibility(e->pos->pos, e->stat->visible_radius);
 					}
-					break;
-				case input::Action::pass:	break;
-				case input::Action::attack:	break;
-				case input::Action::spell:	break;
-				case input::Action::use:	break;
-				default: 
-					ASSERT_LOG(false, "No action defined for " << static_cast<int>(inp->action));
-					break;
 				}
-				// increment turns on successful update.
-				if(inp->action != input::Action::none) {
-					eng.inc_turns();
-				}
-			} else if((e->mask & genmask(Component::AI)) == genmask(Component::AI)) {
-				//auto& aip = e->aip;
+				break;
+			case input::Action::pass:	break;
+			case input::Action::attack:	break;
+			case input::Action::spell:	break;
+			case input::Action::use:	break;
+			default: 
+				ASSERT_LOG(false, "No action defined for " << static_cast<int>(inp->action));
+				break;
+			}
+			// increment turns on successful update.
+			if(inp->action != input::Action::none) {
+				eng.inc_turns();
 			}
 		}
 	}
@@ -31,7 +31,10 @@ namespace process
 	{
 	public:
 		action();
+		void start(engine& eng) override;
 		void update(engine& eng, float t, const entity_list& elist) override;
+		const char* get_name() const override { return "action"; }
 	private:
+		std::size_t query_;
 	};
 }
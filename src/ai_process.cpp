@@ -31,24 +31,63 @@
 
 namespace process
 {
+	namespace
+	{
+		// How far from the player monsters notice it, in tiles.
+		const int chase_limit = 64;
+		const char* const chase_ai = "chase_player";
+		const char* const flee_ai = "flee_player";
+	}
+
 	ai::ai()
 		: process(ProcessPriority::ai),
 		  should_update_(false),
-		  update_turns_(0)
+		  update_turns_(0),
+		  new_turn_(),
+		  tile_changed_(),
+		  chase_(),
+		  flee_(),
+		  flee_stale_(true)
 	{
+		using namespace component;
+		chase_.set_limit(chase_limit);
+		declare_access(genmask(Component::AI) | genmask(Resource::ENGINE) | genmask(Resource::MAP),
+			genmask(Component::POSITION) | genmask(Component::INPUT) | genmask(Resource::ENGINE) | genmask(Resource::RANDOM));
 	}
 
-	bool ai::handle_event(const SDL_Event& evt)
+	void ai::start(engine& eng)
 	{
-		switch(evt.type) {
-			case SDL_USEREVENT:
-				if(evt.user.code == static_cast<Sint32>(EngineUserEvents::NEW_TURN)) {
-					should_update_ = true;
-					update_turns_ = static_cast<int>(reinterpret_cast<intptr_t>(evt.user.data1));
-				}
-			default: break;
+		new_turn_ = eng.get_event_bus().subscribe<events::new_turn>([this](const events::new_turn& evt) {
+			should_update_ = true;
+			update_turns_ += evt.count;
+		});
+		tile_changed_ = eng.get_event_bus().subscribe<events::tile_changed>([this, &eng](const events::tile_changed& evt) {
+			const tile_bitmap* walkable = eng.getMap() != nullptr ? eng.getMap()->getWalkableGrid() : nullptr;
+			if(walkable != nullptr && !chase_.get_goals().empty()) {
+				chase_.tile_changed(*walkable, evt.pos);
+				flee_stale_ = true;
+			}
+		});
+	}
+
+	void ai::end(engine& eng)
+	{
+		eng.get_event_bus().unsubscribe(new_turn_);
+		eng.get_event_bus().unsubscribe(tile_changed_);
+	}
+
+	void ai::update_fields(engine& eng)
+	{
+		const tile_bitmap* walkable = eng.getMap() != nullptr ? eng.getMap()->getWalkableGrid() : nullptr;
+		const auto& player = eng.getPlayer();
+		if(walkable == nullptr || player == nullptr || player->pos == nullptr) {
+			return;
+		}
+		const std::vector<point> goals(1, player->pos->pos);
+		if(goals != chase_.get_goals()) {
+			chase_.update(*walkable, goals);
+			flee_stale_ = true;
 		}
-		return false;
 	}
 	
 	void ai::update(engine& eng, float t, const entity_list& elist)
@@ -58,32 +97,60 @@ namespace process
 			return;
 		}
 		should_update_ = false;
-		for(auto& e : elist) {
-			static component_id ai_mask = genmask(Component::POSITION) | genmask(Component::AI) | genmask(Component::INPUT);
-
-			if((e->mask & ai_mask) == ai_mask) {
-				auto& pos = e->pos;
-				//auto& aip = e->aip;
-				auto& inp = e->inp;
-			
-				// Set default action to nothing
-				inp->action = input::Action::none;
-
-				// XXX this should be rate limited a bit, so if the player wanted
-				// to do something for 20 turns then we carry out 1 turn/200ms or so
-				// then if the player needed to cancel action they could.
-				// Fortunately we have a useful time parameter t to use.
-				update_turns_ = eng.get_turns() - update_turns_;
-				for(int n = 0; n != update_turns_; ++n) {
-					// XXX add some logic
-					if(generator::get_uniform_int(0,1)) {
-						pos->mov.x += generator::get_uniform_int(-1, 1);
-					} else {
-						pos->mov.y += generator::get_uniform_int(-1, 1);
+		// Only actors whose time has come are woken, however many turns passed.
+		auto& store = eng.get_entity_store();
+		bool fields_updated = false;
+		eng.get_actors().advance(update_turns_, [this, &store, &eng, &fields_updated](entity_id id, int actions) {
+			auto pos = store.get<position>(id);
+			auto inp = store.get<input>(id);
+			if(pos == nullptr || inp == nullptr) {
+				return;
+			}
+			// Chasing and fleeing actors follow the fields, downhill from where their moves 
+			// so far take them. Out of range of the player they wander like the rest.
+			const dijkstra_map* field = nullptr;
+			auto aip = store.get<component::ai>(id);
+			if(aip != nullptr && !fields_updated && (aip->type == chase_ai || aip->type == flee_ai)) {
+				update_fields(eng);
+				fields_updated = true;
+			}
+			if(aip != nullptr && aip->type == chase_ai) {
+				field = &chase_;
+			} else if(aip != nullptr && aip->type == flee_ai && chase_.get(pos->pos) != dijkstra_map::unreachable) {
+				if(flee_stale_) {
+					flee_.compute_flee(*eng.getMap()->getWalkableGrid(), chase_);
+					flee_stale_ = false;
+				}
+				field = &flee_;
+			}
+			point next;
+			if(field != nullptr && field->downhill(pos->pos, &next)) {
+				for(int n = 0; n != actions; ++n) {
+					const point at = pos->pos + pos->mov;
+					if(!field->downhill(at, &next)) {
+						break;
 					}
+					pos->mov += next - at;
 				}
 				inp->action = input::Action::moved;
+				return;
 			}
-		}
+			// XXX this should be rate limited a bit, so if the player wanted
+			// to do something for 20 turns then we carry out 1 turn/200ms or so
+			// then if the player needed to cancel action they could.
+			// Fortunately we have a useful time parameter t to use.
+			for(int n = 0; n != actions; ++n) {
+				// XXX add some logic
+				if(generator::get_uniform_int(0,1)) {
+					pos->mov.x += generator::get_uniform_int(-1, 1);
+				} else {
+					pos->mov.y += generator::get_uniform_int(-1, 1);
+				}
+			}
+			// Actors that aren't woken are left alone, the action process resets 
+			// their action once there is no movement left to carry out.
+			inp->action = input::Action::moved;
+		});
+		update_turns_ = 0;
 	}
 }
@@ -23,6 +23,8 @@
 
 #pragma once
 
+#include "dijkstra_map.hpp"
+#include "event_bus.hpp"
 #include "process.hpp"
 
 namespace process
@@ -31,10 +33,20 @@ namespace process
 	{
 	public:
 		ai();
+		void start(engine& eng) override;
+		void end(engine& eng) override;
 		void update(engine& eng, float t, const entity_list& elist) override;
+		const char* get_name() const override { return "ai"; }
 	private:
-		bool handle_event(const SDL_Event& evt);
+		void update_fields(engine& eng);
 		bool should_update_;
 		int update_turns_;
+		events::subscription new_turn_;
+		events::subscription tile_changed_;
+		// Distance to the player, shared by every actor chasing it, and the field actors 
+		// running away from it follow, made from it when first needed.
+		dijkstra_map chase_;
+		dijkstra_map flee_;
+		bool flee_stale_;
 	};
 }
@@ -0,0 +1,240 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <set>
+
+#include "asserts.hpp"
+#include "fov_batch.hpp"
+#include "fov_bench.hpp"
+#include "tile_bitmap.hpp"
+#include "visibility.hpp"
+
+namespace 
+{
+	// The shadow casting code as it was before the kernels were templated, kept as a
+	// baseline. Everything goes through std::function and the octant is a run-time value.
+	class legacy_shadow_cast
+	{
+	public:
+		legacy_shadow_cast(std::function<bool(int, int)> blocks_light, std::function<int(int, int)> get_distance)
+			: blocks_light_(blocks_light), get_distance_(get_distance) 
+		{
+		}
+
+		void Compute(const point& origin, int rangeLimit, std::function<void(int, int)> set_visible)
+		{
+			set_visible(origin.x, origin.y);
+			for(int octant = 0; octant < 8; octant++) {
+				Compute(octant, origin, rangeLimit, 1, Slope(1, 1), Slope(0, 1), set_visible);
+			}
+		}
+	private:
+		struct Slope
+		{
+			Slope(int yy, int xx) : y(yy), x(xx) {}
+			int y, x;
+		};
+
+		void Compute(int octant, const point& origin, int rangeLimit, int x, Slope top, Slope bottom, std::function<void(int, int)> set_visible)
+		{
+			for(; x <= rangeLimit; x++) {
+				int top_y = top.x == 1 ? x : ((x * 2 + 1) * top.y + top.x - 1) / (top.x * 2);
+				int bottom_y = bottom.y == 0 ? 0 : ((x * 2 - 1) * bottom.y + bottom.x) / (bottom.x * 2);
+				int wasOpaque = -1;
+				for(int y = top_y; y >= bottom_y; y--) {
+					int tx = origin.x, ty = origin.y;
+					switch(octant) {
+						case 0: tx += x; ty -= y; break;
+						case 1: tx += y; ty -= x; break;
+						case 2: tx -= y; ty -= x; break;
+						case 3: tx -= x; ty -= y; break;
+						case 4: tx -= x; ty += y; break;
+						case 5: tx -= y; ty += x; break;
+						case 6: tx += y; ty += x; break;
+						case 7: tx += x; ty += y; break;
+						default: break;
+					}
+					bool in_range = rangeLimit < 0 || get_distance_(x, y) <= rangeLimit;
+					if(in_range) {
+						set_visible(tx, ty);
+					}
+					if(in_range && (y != top_y || top.y * x >= top.x * y) && (y != bottom_y || bottom.y * x <= bottom.x * y)) {
+						set_visible(tx, ty);
+					}
+					bool isOpaque = !in_range || blocks_light_(tx, ty);
+					if(x != rangeLimit) {
+						if(isOpaque) {
+							if(wasOpaque == 0) {
+								Slope newBottom(y * 2 + 1, x * 2 - 1);
+								if(!in_range || y == bottom_y) { 
+									bottom = newBottom; 
+									break; 
+								} else {
+									Compute(octant, origin, rangeLimit, x+1, top, newBottom, set_visible);
+								}
+							}
+							wasOpaque = 1;
+						} else {
+							if(wasOpaque > 0) {
+								top = Slope(y*2+1, x*2+1);
+							}
+							wasOpaque = 0;
+						}
+					}
+				}
+				if(wasOpaque != 0) break;
+			}
+		}
+
+		std::function<bool(int, int)> blocks_light_;
+		std::function<int(int, int)> get_distance_;
+	};
+
+	template<typename F>
+	double time_ms(F fn)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		fn();
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+void run_fov_bench(const mercy::BaseMapPtr& map, const std::vector<point>& origins, int iterations)
+{
+	fov::grid_access grid;
+	ASSERT_LOG(map->getOpacityGrid(&grid), "FOV benchmark needs a map with an opacity grid.");
+	const mercy::BaseMap* m = map.get();
+	legacy_shadow_cast legacy(std::bind(&mercy::BaseMap::blocksLight, m, std::placeholders::_1, std::placeholders::_2),
+		std::bind(&mercy::BaseMap::getDistance, m, std::placeholders::_1, std::placeholders::_2));
+	ShadowCastVisibility adapter(std::bind(&mercy::BaseMap::blocksLight, m, std::placeholders::_1, std::placeholders::_2),
+		std::bind(&mercy::BaseMap::getDistance, m, std::placeholders::_1, std::placeholders::_2));
+
+	std::cout << "fov: " << map->getWidth() << "x" << map->getHeight() << ", " << origins.size() << " origins, " 
+		<< iterations << " iterations\n";
+	std::cout << "  " << std::setw(6) << "radius" << std::setw(12) << "legacy us" << std::setw(12) << "adapter us" 
+		<< std::setw(12) << "kernel us" << std::setw(10) << "speedup" << std::setw(10) << "tiles" 
+		<< std::setw(12) << "set us" << std::setw(12) << "bitmap us" 
+		<< std::setw(12) << "batch ms" << std::setw(12) << "can see us" 
+		<< std::setw(12) << "full us" << std::setw(12) << "step us" << "\n";
+	fov_batch batch;
+	const int radii[] = { 5, 20, 40, 60 };
+	for(int radius : radii) {
+		long long visits = 0;
+		auto count = [&visits](int, int) { ++visits; };
+		const double legacy_ms = time_ms([&]() {
+			for(int n = 0; n != iterations; ++n) {
+				for(auto& o : origins) {
+					legacy.Compute(o, radius, count);
+				}
+			}
+		});
+		const double adapter_ms = time_ms([&]() {
+			for(int n = 0; n != iterations; ++n) {
+				for(auto& o : origins) {
+					adapter.Compute(o, radius, count);
+				}
+			}
+		});
+		visits = 0;
+		const double kernel_ms = time_ms([&]() {
+			for(int n = 0; n != iterations; ++n) {
+				for(auto& o : origins) {
+					fov::shadow_cast(grid, o, radius, count);
+				}
+			}
+		});
+		// Collecting the results, as a std::set<point> the map used to build and as a bitmap.
+		const double set_ms = time_ms([&]() {
+			for(int n = 0; n != iterations; ++n) {
+				for(auto& o : origins) {
+					std::set<point> visible;
+					fov::shadow_cast(grid, o, radius, [&visible](int x, int y) { visible.emplace(x, y); });
+				}
+			}
+		});
+		tile_bitmap bitmap;
+		const double bitmap_ms = time_ms([&]() {
+			for(int n = 0; n != iterations; ++n) {
+				for(auto& o : origins) {
+					map->getVisibleTilesAt(o, radius, &bitmap);
+				}
+			}
+		});
+		// Every origin at once, as for the perception of all the monsters on a level.
+		batch.clear();
+		for(auto& o : origins) {
+			batch.add(o, radius);
+		}
+		const double batch_ms = time_ms([&]() {
+			for(int n = 0; n != iterations; ++n) {
+				batch.compute(*map);
+			}
+		});
+		// Whether each origin can see the next one.
+		int seen = 0;
+		const double can_see_ms = time_ms([&]() {
+			for(int n = 0; n != iterations; ++n) {
+				for(std::size_t m = 0; m != origins.size(); ++m) {
+					seen += map->canSee(origins[m], origins[(m + 1) % origins.size()], radius) ? 1 : 0;
+				}
+			}
+		});
+		// The player stepping back and forth next to each origin, clearing the whole map and
+		// recomputing as the action process used to against only updating what changed.
+		const double full_ms = time_ms([&]() {
+			for(int n = 0; n != iterations; ++n) {
+				for(auto& o : origins) {
+					map->clearVisible();
+					map->updatePlayerVisibility(point(o.x + (n & 1), o.y), radius);
+				}
+			}
+		});
+		const double step_ms = time_ms([&]() {
+			for(int n = 0; n != iterations; ++n) {
+				for(auto& o : origins) {
+					map->updatePlayerVisibility(o, radius);
+					map->updatePlayerVisibility(point(o.x + 1, o.y), radius);
+				}
+			}
+		});
+		map->clearVisible();
+		const double runs = static_cast<double>(iterations) * origins.size();
+		std::cout << "  " << std::setw(6) << radius << std::fixed << std::setprecision(2)
+			<< std::setw(12) << legacy_ms * 1000.0 / runs
+			<< std::setw(12) << adapter_ms * 1000.0 / runs
+			<< std::setw(12) << kernel_ms * 1000.0 / runs
+			<< std::setw(9) << legacy_ms / std::max(kernel_ms, 1e-9) << "x"
+			<< std::setw(10) << static_cast<long long>(visits / runs)
+			<< std::setw(12) << set_ms * 1000.0 / runs
+			<< std::setw(12) << bitmap_ms * 1000.0 / runs
+			<< std::setw(12) << batch_ms / iterations
+			<< std::setw(12) << can_see_ms * 1000.0 / runs
+			<< std::setw(12) << full_ms * 1000.0 / runs
+			<< std::setw(12) << step_ms * 1000.0 / (runs * 2) << "\n";
+	}
+}
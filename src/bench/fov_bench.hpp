@@ -0,0 +1,36 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "geometry.hpp"
+#include "map.hpp"
+
+// Times the field of view calculation from each origin at radius 5, 20, 40 and 60, 
+// through the std::function based code the map used to use and through the templated
+// kernels on the map's opacity grid. Also times collecting the visible tiles into a 
+// std::set and into a tile_bitmap, computing all the origins as one fov_batch, 
+// BaseMap::canSee() and the player's visibility being updated a step at a time.
+void run_fov_bench(const mercy::BaseMapPtr& map, const std::vector<point>& origins, int iterations);
@@ -0,0 +1,316 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+// Headless simulation benchmark. Generates a dungeon, fills it with creatures and
+// then runs the engine for a fixed number of ticks with the player passing every
+// turn, reporting the turn rate and the time spent in each process.
+//
+// Usage: mercy-bench [--creatures N] [--ticks N] [--width W] [--height H]
+//                    [--seed S] [--type creature] [--data path] [--serial]
+//                    [--trace file.json] [--fov iterations] [--paths iterations]
+//                    [--noise iterations] [--export file.png] [--tiles path] [--test]
+//
+// --trace writes a Chrome trace event capture of the run.
+// --fov times field of view calculations from the creatures' positions instead of
+// running the simulation, see fov_bench.hpp.
+// --paths times path finding between the creatures' positions, see path_bench.hpp.
+// --noise times terrain noise over a width by height grid, see noise_bench.hpp.
+// --export and --tiles stream a width by width terrain map of the seed to a PNG and/or 
+// a tile pyramid, see terrain2.hpp, and report the time taken.
+// --test runs the unit tests, as the game does at startup, and exits.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "FontDriver.hpp"
+
+#include "action_process.hpp"
+#include "ai_process.hpp"
+#include "asserts.hpp"
+#include "collision_process.hpp"
+#include "component.hpp"
+#include "creature.hpp"
+#include "engine.hpp"
+#include "fov_bench.hpp"
+#include "input_process.hpp"
+#include "input_source.hpp"
+#include "json.hpp"
+#include "noise_bench.hpp"
+#include "path_bench.hpp"
+#include "profiler.hpp"
+#include "random.hpp"
+#include "terrain2.hpp"
+#include "unit_test.hpp"
+#include "variant_utils.hpp"
+
+// Creatures and maps ask for a text renderable, there is nothing to render to here.
+// Tiles are given a nominal size of a pixel so the camera still works.
+pointf text_block_tile_size()
+{
+	return pointf(1.0f, 1.0f);
+}
+
+KRE::ColoredFontRenderablePtr text_block_renderer(const std::vector<std::string>& strs, const std::vector<KRE::Color>& colors, float* ts_x, float* ts_y)
+{
+	if(ts_x) {
+		*ts_x = 1.0f;
+	}
+	if(ts_y) {
+		*ts_y = 1.0f;
+	}
+	return nullptr;
+}
+
+namespace 
+{
+	struct bench_options
+	{
+		bench_options() 
+			: creatures(100), 
+			  ticks(1000), 
+			  width(100), 
+			  height(40), 
+			  seed(1), 
+			  type("gnarled_goblin"), 
+			  data_path("data/"), 
+			  trace_file(),
+			  export_file(),
+			  export_tiles(),
+			  fov_iterations(0),
+			  path_iterations(0),
+			  noise_iterations(0),
+			  parallel(true),
+			  run_tests(false)
+		{
+		}
+		int creatures;
+		int ticks;
+		int width;
+		int height;
+		unsigned seed;
+		std::string type;
+		std::string data_path;
+		std::string trace_file;
+		std::string export_file;
+		std::string export_tiles;
+		int fov_iterations;
+		int path_iterations;
+		int noise_iterations;
+		bool parallel;
+		bool run_tests;
+	};
+
+	bench_options parse_args(int argc, char* argv[])
+	{
+		bench_options opts;
+		for(int n = 1; n < argc; ++n) {
+			const std::string arg = argv[n];
+			if(arg == "--serial") {
+				opts.parallel = false;
+				continue;
+			} else if(arg == "--test") {
+				opts.run_tests = true;
+				continue;
+			}
+			ASSERT_LOG(n + 1 < argc, "Option '" << arg << "' requires a value.");
+			const std::string value = argv[++n];
+			if(arg == "--creatures") {
+				opts.creatures = std::atoi(value.c_str());
+			} else if(arg == "--ticks") {
+				opts.ticks = std::atoi(value.c_str());
+			} else if(arg == "--width") {
+				opts.width = std::atoi(value.c_str());
+			} else if(arg == "--height") {
+				opts.height = std::atoi(value.c_str());
+			} else if(arg == "--seed") {
+				opts.seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+			} else if(arg == "--type") {
+				opts.type = value;
+			} else if(arg == "--trace") {
+				opts.trace_file = value;
+			} else if(arg == "--fov") {
+				opts.fov_iterations = std::atoi(value.c_str());
+			} else if(arg == "--paths") {
+				opts.path_iterations = std::atoi(value.c_str());
+			} else if(arg == "--noise") {
+				opts.noise_iterations = std::atoi(value.c_str());
+			} else if(arg == "--export") {
+				opts.export_file = value;
+			} else if(arg == "--tiles") {
+				opts.export_tiles = value;
+			} else if(arg == "--data") {
+				opts.data_path = value;
+				if(!opts.data_path.empty() && opts.data_path.back() != '/') {
+					opts.data_path += '/';
+				}
+			} else {
+				ASSERT_LOG(false, "Unrecognised option: " << arg);
+			}
+		}
+		ASSERT_LOG(opts.creatures >= 0 && opts.ticks > 0, "Creature count and ticks must be positive.");
+		return opts;
+	}
+
+	void create_player(engine& e)
+	{
+		using namespace component;
+		component_set_ptr player = std::make_shared<component_set>(100);
+		player->mask |= genmask(Component::PLAYER);
+		player->mask |= genmask(Component::POSITION);
+		player->mask |= genmask(Component::STATS);
+		player->mask |= genmask(Component::INPUT);
+		player->mask |= genmask(Component::COLLISION);
+		player->pos = std::make_shared<position>(e.getMap()->getStartLocation());
+		player->stat = std::make_shared<stats>();
+		player->stat->health = 10;
+		player->inp = std::make_shared<input>();
+		e.add_entity(player);
+	}
+
+	point random_walkable(const mercy::BaseMapPtr& map)
+	{
+		for(;;) {
+			const point p(generator::get_uniform_int<int>(0, map->getWidth() - 1), generator::get_uniform_int<int>(0, map->getHeight() - 1));
+			if(map->isWalkable(p.x, p.y)) {
+				return p;
+			}
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const bench_options opts = parse_args(argc, argv);
+	if(opts.run_tests) {
+		return test::run_tests() ? 0 : 1;
+	}
+	generator::set_seed(opts.seed);
+	if(opts.noise_iterations > 0) {
+		run_noise_bench(opts.width, opts.height, opts.noise_iterations);
+		return 0;
+	}
+	if(!opts.export_file.empty() || !opts.export_tiles.empty()) {
+		const auto start = std::chrono::high_resolution_clock::now();
+		mercy::export_terrain_image(opts.export_file, opts.export_tiles, opts.width, static_cast<int>(opts.seed));
+		const double secs = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		std::cout << "terrain export: " << opts.width << "x" << opts.width << ", seed: " << opts.seed 
+			<< " in " << std::fixed << std::setprecision(3) << secs << "s\n";
+		return 0;
+	}
+
+	creature::loader(json::parse_from_file(opts.data_path + "creatures.cfg"));
+
+	auto input = std::make_shared<queued_input_source>();
+	engine eng(rect(0, 0, opts.width, opts.height), input);
+	eng.set_parallel_processes(opts.parallel);
+
+	eng.add_process(std::make_shared<process::input>());
+	eng.add_process(std::make_shared<process::ai>());
+	eng.add_process(std::make_shared<process::action>());
+	// N.B. entity/map collision needs to come before entity/entity collision
+	eng.add_process(std::make_shared<process::em_collision>());
+	eng.add_process(std::make_shared<process::ee_collision>());
+
+	eng.setMap(mercy::BaseMap::create("dungeon", opts.width, opts.height, variant_builder().build()));
+	eng.getMap()->generate(eng);
+
+	if(opts.fov_iterations > 0) {
+		std::vector<point> origins;
+		for(int n = 0; n != std::max(opts.creatures, 1); ++n) {
+			origins.emplace_back(random_walkable(eng.getMap()));
+		}
+		run_fov_bench(eng.getMap(), origins, opts.fov_iterations);
+		return 0;
+	}
+	if(opts.path_iterations > 0) {
+		std::vector<std::pair<point, point>> pairs;
+		for(int n = 0; n != std::max(opts.creatures, 1); ++n) {
+			pairs.emplace_back(random_walkable(eng.getMap()), random_walkable(eng.getMap()));
+		}
+		run_path_bench(eng, pairs, opts.path_iterations);
+		return 0;
+	}
+
+	create_player(eng);
+	for(int n = 0; n != opts.creatures; ++n) {
+		eng.add_entity(creature::spawn(opts.type, random_walkable(eng.getMap())));
+	}
+
+	// Each update is exactly one engine tick, with the player passing its turn.
+	const float tick = 0.05f;
+	const int start_turns = eng.get_turns();
+	profile::frame_mark();
+	profile::reset_accumulated_stats();
+	eng.reset_query_stats();
+	if(!opts.trace_file.empty()) {
+		profile::begin_capture();
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+	for(int n = 0; n != opts.ticks; ++n) {
+		input->push_key(SDL_SCANCODE_PERIOD);
+		eng.update(tick);
+	}
+	const double elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	const int turns = eng.get_turns() - start_turns;
+	if(profile::is_capturing()) {
+		profile::end_capture();
+		profile::write_chrome_trace(opts.trace_file);
+	}
+
+	std::cout << "map: " << opts.width << "x" << opts.height 
+		<< ", creatures: " << opts.creatures 
+		<< ", seed: " << opts.seed 
+		<< ", " << (opts.parallel ? "parallel" : "serial") << "\n";
+	std::cout << "ticks: " << opts.ticks << " in " << std::fixed << std::setprecision(3) << elapsed << "s, " 
+		<< std::setprecision(1) << (opts.ticks / elapsed) << " ticks/s\n";
+	std::cout << "turns: " << turns << ", " << (turns / elapsed) << " turns/s\n";
+	for(auto& ps : eng.get_scheduler().get_stats()) {
+		std::cout << "  " << std::left << std::setw(14) << ps.proc->get_name() << std::right
+			<< std::setprecision(3) << std::setw(10) << ps.total_ms << " ms total, " 
+			<< std::setw(8) << (ps.runs > 0 ? ps.total_ms / ps.runs : 0.0) << " ms/run\n";
+	}
+	std::cout << "  " << std::left << std::setw(20) << "zone (ms)" << std::right << std::setw(8) << "calls" << std::setw(10) << "total" << std::setw(10) << "min"
+		<< std::setw(10) << "mean" << std::setw(10) << "p99" << std::setw(10) << "max" << "\n";
+	for(auto& zs : profile::get_accumulated_stats()) {
+		std::cout << "  " << std::left << std::setw(20) << zs.name << std::right << std::setprecision(3)
+			<< std::setw(8) << zs.calls << std::setw(10) << zs.total_ms << std::setw(10) << zs.min_ms
+			<< std::setw(10) << zs.mean_ms << std::setw(10) << zs.p99_ms << std::setw(10) << zs.max_ms << "\n";
+	}
+	std::cout << "  " << std::left << std::setw(40) << "query" << std::right << std::setw(10) << "entities" << std::setw(10) << "per tick" << "\n";
+	for(auto& qs : eng.get_query_stats()) {
+		std::string name;
+		for(int n = 0; n != static_cast<int>(component::Component::MAX_COMPONENTS); ++n) {
+			if(qs.mask.test(n)) {
+				name += (name.empty() ? "" : "|") + component::get_string_from_component(static_cast<component::Component>(n));
+			}
+		}
+		std::cout << "  " << std::left << std::setw(40) << name << std::right << std::setw(10) << qs.count 
+			<< std::setw(10) << std::setprecision(1) << (qs.ticks > 0 ? static_cast<double>(qs.total) / qs.ticks : 0.0) << "\n";
+	}
+	return 0;
+}
@@ -0,0 +1,107 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <noise/noise.h>
+
+#include "asserts.hpp"
+#include "noise_batch.hpp"
+#include "noise_bench.hpp"
+
+namespace
+{
+	template<typename F>
+	double time_ms(F fn)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		fn();
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+void run_noise_bench(int width, int height, int iterations)
+{
+	// Sampled the way Terrain samples it, a 16 tile chunk to every 1/8th of the noise.
+	std::vector<double> xs(width), ys(height);
+	for(int n = 0; n != width; ++n) {
+		xs[n] = (n - width / 2) / 128.0;
+	}
+	for(int n = 0; n != height; ++n) {
+		ys[n] = (n - height / 2) / 128.0;
+	}
+
+	noise::module::Perlin pnoise;
+	pnoise.SetSeed(12345);
+	std::vector<double> expected(width * height);
+	const double libnoise_ms = time_ms([&]() {
+		for(int n = 0; n != iterations; ++n) {
+			for(int y = 0; y != height; ++y) {
+				for(int x = 0; x != width; ++x) {
+					expected[y * width + x] = pnoise.GetValue(xs[x], ys[y], 0.0);
+				}
+			}
+		}
+	});
+
+	const double points = static_cast<double>(iterations) * width * height;
+	std::cout << "noise: " << width << "x" << height << ", " << iterations << " iterations\n" << std::fixed << std::setprecision(2)
+		<< "  libnoise  " << std::setw(10) << libnoise_ms * 1000000.0 / points << " ns/point\n";
+
+	const noise::batch::instruction_set best = noise::batch::get_instruction_set();
+	noise::batch::perlin bnoise;
+	bnoise.set_seed(12345);
+	std::vector<double> values(width * height);
+	std::vector<double> scalar(width * height);
+	for(int is = 0; is <= static_cast<int>(best); ++is) {
+		noise::batch::set_instruction_set(static_cast<noise::batch::instruction_set>(is));
+		const double ms = time_ms([&]() {
+			for(int n = 0; n != iterations; ++n) {
+				bnoise.get_grid(xs.data(), width, ys.data(), height, 0.0, values.data());
+			}
+		});
+		double max_diff = 0.0;
+		for(int n = 0; n != width * height; ++n) {
+			max_diff = std::max(max_diff, std::abs(values[n] - expected[n]));
+		}
+		if(is == 0) {
+			scalar = values;
+		} else {
+			double scalar_diff = 0.0;
+			for(int n = 0; n != width * height; ++n) {
+				scalar_diff = std::max(scalar_diff, std::abs(values[n] - scalar[n]));
+			}
+			ASSERT_LOG(scalar_diff <= 1e-12, "Batch noise (" << noise::batch::get_instruction_set_name(noise::batch::get_instruction_set()) 
+				<< ") differs from the scalar path by " << scalar_diff);
+		}
+		std::cout << "  " << std::left << std::setw(8) << noise::batch::get_instruction_set_name(noise::batch::get_instruction_set()) << std::right
+			<< std::setw(10) << ms * 1000000.0 / points << " ns/point " 
+			<< std::setw(10) << libnoise_ms / ms << "x libnoise, max difference " << std::scientific << max_diff << std::fixed << "\n";
+	}
+	noise::batch::set_instruction_set(best);
+}
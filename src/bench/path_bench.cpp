@@ -0,0 +1,140 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+#include "asserts.hpp"
+#include "hpa_pathfinder.hpp"
+#include "path_bench.hpp"
+#include "path_service.hpp"
+#include "pathfinder.hpp"
+
+namespace
+{
+	template<typename F>
+	double time_ms(F fn)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		fn();
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+void run_path_bench(engine& eng, const std::vector<std::pair<point, point>>& pairs, int iterations)
+{
+	const tile_bitmap* walkable = eng.getMap()->getWalkableGrid();
+	ASSERT_LOG(walkable != nullptr, "Path benchmark needs a map with a walkable grid.");
+
+	pathfinder astar, jps;
+	std::vector<point> a, b;
+	std::size_t found = 0, astar_expanded = 0, jps_expanded = 0;
+	for(auto& p : pairs) {
+		const bool ra = astar.find(*walkable, p.first, p.second, pathfinder::algorithm::astar, &a);
+		const bool rb = jps.find(*walkable, p.first, p.second, pathfinder::algorithm::jps, &b);
+		ASSERT_LOG(ra == rb && pathfinder::get_cost(a, p.first) == pathfinder::get_cost(b, p.first), 
+			"A* and JPS disagree on the path from " << p.first << " to " << p.second);
+		found += ra ? 1 : 0;
+		astar_expanded += astar.get_expanded();
+		jps_expanded += jps.get_expanded();
+	}
+	const double astar_ms = time_ms([&]() {
+		for(int n = 0; n != iterations; ++n) {
+			for(auto& p : pairs) {
+				astar.find(*walkable, p.first, p.second, pathfinder::algorithm::astar, &a);
+			}
+		}
+	});
+	const double jps_ms = time_ms([&]() {
+		for(int n = 0; n != iterations; ++n) {
+			for(auto& p : pairs) {
+				jps.find(*walkable, p.first, p.second, pathfinder::algorithm::jps, &b);
+			}
+		}
+	});
+
+	// The same pairs planned over 16x16 chunks of the map, the first pass builds the chunks.
+	const rect& bounds = walkable->get_bounds();
+	hpa_pathfinder hpa(16, 16, point(bounds.x(), bounds.y()), [walkable](const rect& area, tile_bitmap* out) {
+		for(int y = area.y(); y != area.y2(); ++y) {
+			for(int x = area.x(); x != area.x2(); ++x) {
+				if(walkable->test(x, y)) {
+					out->set(x, y);
+				}
+			}
+		}
+	});
+	const double hpa_cold_ms = time_ms([&]() {
+		for(auto& p : pairs) {
+			hpa.find(p.first, p.second, &b);
+		}
+	});
+	uint64_t jps_cost = 0, hpa_cost = 0;
+	std::size_t hpa_expanded = 0;
+	for(auto& p : pairs) {
+		const bool ra = jps.find(*walkable, p.first, p.second, pathfinder::algorithm::jps, &a);
+		const bool rb = hpa.find(p.first, p.second, &b);
+		ASSERT_LOG(ra == rb, "JPS and HPA* disagree on whether there is a path from " << p.first << " to " << p.second);
+		jps_cost += pathfinder::get_cost(a, p.first);
+		hpa_cost += pathfinder::get_cost(b, p.first);
+		hpa_expanded += hpa.get_expanded();
+	}
+	const double hpa_ms = time_ms([&]() {
+		for(int n = 0; n != iterations; ++n) {
+			for(auto& p : pairs) {
+				hpa.find(p.first, p.second, &b);
+			}
+		}
+	});
+
+	// All the requests of a turn, then the same again with the paths cached.
+	auto& paths = eng.get_paths();
+	std::vector<path_service::ticket> tickets;
+	auto run_batch = [&]() {
+		tickets.clear();
+		for(auto& p : pairs) {
+			tickets.emplace_back(paths.request(p.first, p.second));
+		}
+		paths.wait();
+		for(auto t : tickets) {
+			ASSERT_LOG(paths.get(t, &a), "Path request not finished after wait().");
+		}
+	};
+	const double cold_ms = time_ms(run_batch);
+	const double warm_ms = time_ms(run_batch);
+
+	const double runs = static_cast<double>(iterations) * pairs.size();
+	std::cout << "paths: " << eng.getMap()->getWidth() << "x" << eng.getMap()->getHeight() << ", " 
+		<< pairs.size() << " pairs, " << found << " found, " << iterations << " iterations\n" << std::fixed << std::setprecision(2)
+		<< "  a*        " << std::setw(10) << astar_ms * 1000.0 / runs << " us/path " 
+			<< std::setw(10) << static_cast<double>(astar_expanded) / pairs.size() << " expanded\n"
+		<< "  jps       " << std::setw(10) << jps_ms * 1000.0 / runs << " us/path " 
+			<< std::setw(10) << static_cast<double>(jps_expanded) / pairs.size() << " expanded\n"
+		<< "  hpa*      " << std::setw(10) << hpa_ms * 1000.0 / runs << " us/path " 
+			<< std::setw(10) << static_cast<double>(hpa_expanded) / pairs.size() << " expanded, " 
+			<< hpa_cold_ms << " ms first pass, " << hpa.get_chunk_count() << " chunks, "
+			<< (jps_cost != 0 ? static_cast<double>(hpa_cost) / jps_cost : 1.0) << "x the cost\n"
+		<< "  service   " << std::setw(10) << cold_ms << " ms/batch, " << std::setw(10) << warm_ms << " ms/batch cached, " 
+			<< paths.get_stats().cache_hits << " cache hits\n";
+}
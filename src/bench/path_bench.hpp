@@ -0,0 +1,36 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "engine.hpp"
+#include "geometry.hpp"
+
+// Times A* against jump point search for each pair of points, checking the two find 
+// paths of the same cost, then hierarchical paths over chunks of the map, then the engine's
+// path_service answering all the pairs as one batch of asynchronous requests, first with 
+// an empty cache and then from the cache.
+void run_path_bench(engine& eng, const std::vector<std::pair<point, point>>& pairs, int iterations);
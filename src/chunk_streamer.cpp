@@ -0,0 +1,221 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "chunk_streamer.hpp"
+#include "terrain.hpp"
+#include "unit_test.hpp"
+
+namespace mercy
+{
+	chunk_streamer::chunk_streamer(generate_fn generate, save_fn save, threading::thread_pool& pool)
+		: generate_(generate),
+		  save_(save),
+		  max_running_(std::max(1, pool.size())),
+		  mutex_(),
+		  wanted_(),
+		  prefetch_(),
+		  saves_(),
+		  saving_(),
+		  queued_(),
+		  done_(),
+		  running_(0),
+		  generated_(0),
+		  tasks_(pool)
+	{
+	}
+
+	chunk_streamer::~chunk_streamer()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			wanted_.clear();
+			prefetch_.clear();
+		}
+		tasks_.wait();
+	}
+
+	void chunk_streamer::request(const point& pos)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if(queued_.find(pos) != queued_.end()) {
+				// Something being prefetched is needed now.
+				auto it = std::find(prefetch_.begin(), prefetch_.end(), pos);
+				if(it != prefetch_.end()) {
+					prefetch_.erase(it);
+					wanted_.emplace_back(pos);
+				}
+				return;
+			}
+			queued_.insert(pos);
+			auto it = saving_.find(pos);
+			if(it != saving_.end()) {
+				done_.emplace_back(it->second);
+				return;
+			}
+			wanted_.emplace_back(pos);
+		}
+		schedule();
+	}
+
+	void chunk_streamer::prefetch(const std::vector<point>& positions)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			for(auto& p : prefetch_) {
+				queued_.erase(p);
+			}
+			prefetch_.clear();
+			for(auto& p : positions) {
+				if(queued_.insert(p).second) {
+					auto it = saving_.find(p);
+					if(it != saving_.end()) {
+						done_.emplace_back(it->second);
+					} else {
+						prefetch_.emplace_back(p);
+					}
+				}
+			}
+		}
+		schedule();
+	}
+
+	void chunk_streamer::save(const chunk_ptr& c)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			saves_.emplace_back(c);
+			saving_[c->get_position()] = c;
+		}
+		schedule();
+	}
+
+	void chunk_streamer::collect(std::vector<chunk_ptr>* done)
+	{
+		done->clear();
+		std::lock_guard<std::mutex> lock(mutex_);
+		done->swap(done_);
+		for(auto& c : *done) {
+			queued_.erase(c->get_position());
+		}
+	}
+
+	bool chunk_streamer::is_queued(const point& pos) const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return queued_.find(pos) != queued_.end();
+	}
+
+	std::size_t chunk_streamer::get_generated() const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return generated_;
+	}
+
+	void chunk_streamer::wait()
+	{
+		tasks_.wait();
+	}
+
+	void chunk_streamer::schedule()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		while(running_ < max_running_ && running_ < static_cast<int>(wanted_.size() + saves_.size() + prefetch_.size())) {
+			++running_;
+			tasks_.run([this]() { run_one(); });
+		}
+	}
+
+	void chunk_streamer::run_one()
+	{
+		point pos;
+		chunk_ptr to_save;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if(!wanted_.empty()) {
+				pos = wanted_.front();
+				wanted_.pop_front();
+			} else if(!saves_.empty()) {
+				to_save = saves_.front();
+				saves_.pop_front();
+			} else if(!prefetch_.empty()) {
+				pos = prefetch_.front();
+				prefetch_.pop_front();
+			} else {
+				--running_;
+				return;
+			}
+		}
+		chunk_ptr c = to_save == nullptr ? generate_(pos) : chunk_ptr();
+		if(to_save != nullptr) {
+			save_(to_save);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		if(to_save != nullptr) {
+			// It may have been queued again since.
+			auto it = saving_.find(to_save->get_position());
+			if(it != saving_.end() && it->second == to_save && std::find(saves_.begin(), saves_.end(), to_save) == saves_.end()) {
+				saving_.erase(it);
+			}
+		} else {
+			done_.emplace_back(c);
+			++generated_;
+		}
+		if(wanted_.empty() && saves_.empty() && prefetch_.empty()) {
+			--running_;
+		} else {
+			tasks_.run([this]() { run_one(); });
+		}
+	}
+}
+
+UNIT_TEST(chunk_streamer_request_while_saving)
+{
+	using namespace mercy;
+	std::atomic<bool> release(false);
+	std::atomic<int> saved(0), generated(0);
+	chunk_streamer streamer([&](const point& pos) { ++generated; return std::make_shared<chunk>(pos, 4, 4); }, 
+		[&](const chunk_ptr&) { while(!release) { std::this_thread::yield(); } ++saved; });
+	chunk_ptr c = std::make_shared<chunk>(point(8, 8), 4, 4);
+	streamer.save(c);
+	streamer.request(point(8, 8));
+	std::vector<chunk_ptr> done;
+	streamer.collect(&done);
+	CHECK_EQ(done.size(), 1u);
+	CHECK_EQ(done[0] == c, true);
+	release = true;
+	streamer.wait();
+	CHECK_EQ(saved.load(), 1);
+	CHECK_EQ(generated.load(), 0);
+	streamer.request(point(8, 8));
+	streamer.wait();
+	streamer.collect(&done);
+	CHECK_EQ(done.size(), 1u);
+	CHECK_EQ(done[0] == c, false);
+	CHECK_EQ(generated.load(), 1);
+}
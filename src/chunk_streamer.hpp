@@ -0,0 +1,102 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "geometry.hpp"
+#include "thread_pool.hpp"
+
+namespace mercy
+{
+	class chunk;
+	typedef std::shared_ptr<chunk> chunk_ptr;
+
+	// Generates chunks on the thread pool so that the game thread never waits for them.
+	// Chunks that are needed now go ahead of those being saved, which go ahead of those 
+	// being prefetched. Finished chunks wait to be collected by the game thread, which 
+	// makes anything that can't be made on another thread, such as the renderable.
+	class chunk_streamer
+	{
+	public:
+		// Called on a pool thread, must only read state that doesn't change.
+		typedef std::function<chunk_ptr(const point& pos)> generate_fn;
+		// Called on a pool thread, the chunk isn't changed while it is being saved.
+		typedef std::function<void(const chunk_ptr& c)> save_fn;
+
+		chunk_streamer(generate_fn generate, save_fn save, threading::thread_pool& pool=threading::thread_pool::get());
+		// Drops whatever is queued to be generated and waits for the chunks being 
+		// generated and all the saves.
+		~chunk_streamer();
+
+		// Does nothing if pos is already queued or being generated. A chunk that is still
+		// waiting to be saved is handed back as it is rather than generated again.
+		void request(const point& pos);
+		// Replaces the previous prefetches that haven't started.
+		void prefetch(const std::vector<point>& positions);
+		// Queues the chunk to be saved, for chunks that are being dropped.
+		void save(const chunk_ptr& c);
+		// Hands over the chunks finished since the last call.
+		void collect(std::vector<chunk_ptr>* done);
+		// Whether pos has been requested or prefetched but not collected yet.
+		bool is_queued(const point& pos) const;
+		// Blocks until everything queued has been generated and saved.
+		void wait();
+
+		std::size_t get_generated() const;
+	private:
+		// Queues tasks until there is one per thread or nothing left to start.
+		void schedule();
+		// Generates or saves one chunk. A task only does one so that a thread helping out 
+		// in a task_group::wait(), such as the game thread, isn't held up for long.
+		void run_one();
+
+		generate_fn generate_;
+		save_fn save_;
+		int max_running_;
+
+		mutable std::mutex mutex_;
+		std::deque<point> wanted_;
+		std::deque<point> prefetch_;
+		std::deque<chunk_ptr> saves_;
+		// Everything in saves_ or being saved.
+		std::map<point, chunk_ptr> saving_;
+		// Everything in wanted_, prefetch_, being generated or in done_.
+		std::set<point> queued_;
+		std::vector<chunk_ptr> done_;
+		int running_;
+		std::size_t generated_;
+
+		threading::task_group tasks_;
+
+		chunk_streamer(const chunk_streamer&) = delete;
+		void operator=(const chunk_streamer&) = delete;
+	};
+}
@@ -24,68 +24,75 @@
 #include "component.hpp"
 #include "engine.hpp"
 #include "collision_process.hpp"
+#include "input_source.hpp"
+#include "unit_test.hpp"
 
 namespace process
 {
 	ee_collision::ee_collision()
 		: process(ProcessPriority::collision)
 	{
-	
+		using namespace component;
+		declare_access(genmask(Component::COLLISION) | genmask(Component::POSITION), genmask(Component::POSITION));
 	}
 	
-	// XXX Should we split this into a map/entity collision and entity/entity collision
-	// classes?
 	void ee_collision::update(engine& eng, float t, const entity_list& elist)
 	{
 		using namespace component;
-		static component_id collision_mask = genmask(Component::POSITION) | genmask(Component::COLLISION);
-		// O(n^2) collision testing is for the pro's :-/
-		// XXX Please make quad-tree or kd-tree for O(nlogn)
-		for(auto& e1 : elist) {
-			if((e1->mask & collision_mask) == collision_mask) {
-				auto& e1pos = e1->pos;
-				// XXX replace elist_ below with a call to eng.entities_in_area(r)
-				// where r = active area for entities on map.
-				for(auto& e2 : elist) {
-					if(e1 == e2) {
-						continue;
-					}
-					if((e2->mask & collision_mask) == collision_mask) {
-						// entity - entity collision
-						auto& e2pos = e2->pos;
-						if(e1pos->pos + e1pos->mov == e2pos->pos) {
-							e1pos->mov.clear();
-						}						
-					}
-				}
+		auto& occupancy = eng.get_occupancy();
+		eng.get_entity_store().each<position>(genmask(Component::COLLISION), [&eng, &occupancy](entity_id id, position& p) {
+			if(p.mov.x == 0 && p.mov.y == 0) {
+				return;
+			}
+			// entity - entity collision
+			const point to = p.pos + p.mov;
+			if(occupancy.is_occupied(to, id)) {
+				p.mov.clear();
+			} else {
+				// So nothing else moves onto it this tick.
+				eng.claim_tile(id, to);
 			}
-		}
+		});
 	}
 
 	em_collision::em_collision()
 		: process(ProcessPriority::collision)
 	{
+		using namespace component;
+		declare_access(genmask(Component::COLLISION) | genmask(Component::POSITION) | genmask(Resource::MAP), 
+			genmask(Component::POSITION));
 	}
 	
 	void em_collision::update(engine& eng, float t, const entity_list& elist)
 	{
 		using namespace component;
-		static component_id collision_mask = genmask(Component::COLLISION) | genmask(Component::POSITION);
-		// O(n^2) collision testing is for the pro's :-/
-		// XXX Please make quad-tree or kd-tree for O(nlogn)
-		for(auto& e1 : elist) {
-			if((e1->mask & collision_mask) == collision_mask) {
-				auto& map = eng.getMap();
-				auto& pos = e1->pos->pos;
-				auto& mov = e1->pos->mov;
-
-				point new_pos = pos + mov; 
-
-				if(!map->isWalkable(new_pos.x, new_pos.y)) {
-					mov.x = 0;
-					mov.y = 0;
-				}
+		auto& map = eng.getMap();
+		eng.get_entity_store().each<position>(genmask(Component::COLLISION), [&map](entity_id id, position& p) {
+			point new_pos = p.pos + p.mov; 
+			if(!map->isWalkable(new_pos.x, new_pos.y)) {
+				p.mov.clear();
 			}
-		}
+		});
 	}
 }
+
+UNIT_TEST(ee_collision_same_target)
+{
+	using namespace component;
+	engine eng(rect(0, 0, 10, 10), std::make_shared<queued_input_source>());
+	std::vector<component_set_ptr> movers;
+	for(int x : { 2, 4 }) {
+		component_set_ptr e = std::make_shared<component_set>();
+		e->mask = genmask(Component::POSITION) | genmask(Component::COLLISION);
+		e->pos = std::make_shared<position>(point(x, 5));
+		eng.add_entity(e);
+		movers.emplace_back(e);
+	}
+	// Both step onto (3, 5), only the first to be checked gets it.
+	movers[0]->pos->mov = point(1, 0);
+	movers[1]->pos->mov = point(-1, 0);
+	process::ee_collision().update(eng, 0.0f, entity_list());
+	const int moving = (movers[0]->pos->mov != point(0, 0) ? 1 : 0) + (movers[1]->pos->mov != point(0, 0) ? 1 : 0);
+	CHECK_EQ(moving, 1);
+}
+
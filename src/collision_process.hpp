@@ -32,6 +32,7 @@ namespace process
 	public:
 		ee_collision();
 		void update(engine& eng, float t, const entity_list& elist) override;
+		const char* get_name() const override { return "ee_collision"; }
 	};
 
 	class em_collision : public process
@@ -39,5 +40,6 @@ namespace process
 	public:
 		em_collision();
 		void update(engine& eng, float t, const entity_list& elist) override;
+		const char* get_name() const override { return "em_collision"; }
 	};
 }
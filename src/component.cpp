@@ -101,6 +101,7 @@ namespace component
 			stats.add("attack", c->stat->attack);
 			stats.add("armour", c->stat->armour);
 			stats.add("visible_radius", c->stat->visible_radius);
+			stats.add("speed", c->stat->speed);
 			stats.add("name", c->stat->name);
 			stats.add("id", c->stat->id);
 			// XXX add more stats here as needed.
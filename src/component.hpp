@@ -24,6 +24,7 @@
 #pragma once
 
 #include <bitset>
+#include <cstddef>
 #include <memory>
 #include <string>
 #include <vector>
@@ -31,6 +32,7 @@
 #include "Color.hpp"
 #include "SceneFwd.hpp"
 #include "Texture.hpp"
+#include "asserts.hpp"
 #include "geometry.hpp"
 #include "variant.hpp"
 
@@ -74,7 +76,9 @@ namespace component
 		virtual ~component() {}
 		component_id id() const { return id_; }
 	private:
-		const component_id id_;
+		// N.B. Not const so that components can be stored by value in the
+		// entity_store columns, which need to be assignable.
+		component_id id_;
 	};
 
 	typedef std::shared_ptr<component> component_ptr;
@@ -97,11 +101,13 @@ namespace component
 
 	struct stats : public component
 	{
-		stats() : component(Component::STATS), health(1), attack(0), armour(0), visible_radius(5), name(), id() {}
+		stats() : component(Component::STATS), health(1), attack(0), armour(0), visible_radius(5), speed(100), name(), id() {}
 		int health;
 		int attack;
 		int armour;
 		int visible_radius;
+		// Actions per 100 turns.
+		int speed;
 		std::string name;
 		std::string id;
 	};
@@ -146,16 +152,88 @@ namespace component
 		KRE::TexturePtr tex;
 	};
 
+	class entity_store;
+	typedef unsigned entity_id;
+	const entity_id invalid_entity_id = ~0U;
+
+	// Generational reference to an entity. Entity ids are reused once an entity is 
+	// removed, the generation is bumped each time so old handles can be detected.
+	struct entity_handle
+	{
+		entity_handle() : index(invalid_entity_id), generation(0) {}
+		entity_handle(entity_id ndx, unsigned gen) : index(ndx), generation(gen) {}
+		bool is_valid() const { return index != invalid_entity_id; }
+		entity_id index;
+		unsigned generation;
+	};
+	inline bool operator==(const entity_handle& lhs, const entity_handle& rhs) 
+	{
+		return lhs.index == rhs.index && lhs.generation == rhs.generation;
+	}
+	inline bool operator!=(const entity_handle& lhs, const entity_handle& rhs) 
+	{
+		return !(lhs == rhs);
+	}
+
+	// Defined (and explicitly instantiated for each component type) in entity_store.cpp
+	template<typename T> T* get_component(entity_store* store, entity_id id);
+
+	// Compatibility shim for the old shared_ptr-per-component members of component_set.
+	// Until the owning component_set is added to an entity_store the component lives
+	// in a private shared_ptr. Once added the data is moved into the stores columns and
+	// all accesses are routed there.
+	template<typename T>
+	class component_ref
+	{
+	public:
+		component_ref() : store_(nullptr), id_(invalid_entity_id), detached_() {}
+		component_ref(std::nullptr_t) : store_(nullptr), id_(invalid_entity_id), detached_() {}
+		component_ref(const std::shared_ptr<T>& p) : store_(nullptr), id_(invalid_entity_id), detached_(p) {}
+		component_ref& operator=(const std::shared_ptr<T>& p) {
+			if(store_ != nullptr) {
+				T* c = get();
+				ASSERT_LOG(c != nullptr && p != nullptr, "Can't add or remove a component while the entity is in a store, update the mask using entity_store::set_mask()");
+				*c = *p;
+			} else {
+				detached_ = p;
+			}
+			return *this;
+		}
+		T* get() const { return store_ != nullptr ? get_component<T>(store_, id_) : detached_.get(); }
+		T* operator->() const { return get(); }
+		T& operator*() const { return *get(); }
+		explicit operator bool() const { return get() != nullptr; }
+		bool operator==(std::nullptr_t) const { return get() == nullptr; }
+		bool operator!=(std::nullptr_t) const { return get() != nullptr; }
+		bool is_attached() const { return store_ != nullptr; }
+		const std::shared_ptr<T>& detached() const { return detached_; }
+		void attach(entity_store* store, entity_id id) { store_ = store; id_ = id; detached_.reset(); }
+		void detach(const std::shared_ptr<T>& p) { store_ = nullptr; id_ = invalid_entity_id; detached_ = p; }
+	private:
+		entity_store* store_;
+		entity_id id_;
+		std::shared_ptr<T> detached_;
+	};
+
 	struct component_set
 	{
-		component_set(int z=0) : mask(component_id(0)), zorder(z) {}
+		component_set(int z=0) : mask(component_id(0)), zorder(z), store(nullptr), id(invalid_entity_id) {}
+		~component_set();
+		// N.B. Not copyable, destroying a copy would remove the entity from its store.
+		component_set(const component_set&) = delete;
+		component_set& operator=(const component_set&) = delete;
+		// N.B. if the entity has been added to an entity_store then changing the mask
+		// should be done through entity_store::set_mask() so the components can be migrated.
 		component_id mask;
 		int zorder;
-		std::shared_ptr<position> pos;
-		std::shared_ptr<sprite> spr;
-		std::shared_ptr<stats> stat;
-		std::shared_ptr<ai> aip;
-		std::shared_ptr<input> inp;
+		component_ref<position> pos;
+		component_ref<sprite> spr;
+		component_ref<stats> stat;
+		component_ref<ai> aip;
+		component_ref<input> inp;
+		// store this entity is held in, if any.
+		entity_store* store;
+		entity_id id;
 		bool is_player() { return (mask & genmask(Component::PLAYER)) == genmask(Component::PLAYER); }
 	};
 	typedef std::shared_ptr<component_set> component_set_ptr;
@@ -46,6 +46,7 @@ namespace creature
 				  attack_max_(0),
 				  armour_(0),
 				  visible_radius_(5),
+				  speed_(100),
 				  ai_name_(),
 				  //sprite_name_(),
 				  //sprite_area_(),
@@ -97,6 +98,9 @@ namespace creature
 					armour_ = stats.has_key("armour") ? stats["armour"].as_int32() : 0;
 
 					visible_radius_ = stats.has_key("sight_radius") ? stats["sight_radius"].as_int32() : 5;
+
+					speed_ = stats.has_key("speed") ? stats["speed"].as_int32() : 100;
+					ASSERT_LOG(speed_ > 0, "Speed must be greater than zero: " << speed_ << " for creature " << name_);
 				}
 
 				if((component_mask_ & genmask(Component::AI)) == genmask(Component::AI)) {
@@ -134,6 +138,7 @@ namespace creature
 					res->stat->armour = armour_;
 					res->stat->name = name_;
 					res->stat->visible_radius = visible_radius_;
+					res->stat->speed = speed_;
 					res->stat->id = type;
 				}
 				if((component_mask_ & genmask(Component::POSITION)) == genmask(Component::POSITION)) {
@@ -169,6 +174,7 @@ namespace creature
 			int attack_max_;
 			int armour_;
 			int visible_radius_;
+			int speed_;
 			// attack type (magic, physical, type of magic, type of physical, etc)
 			// has ranged attack
 			// what items might be carried.
@@ -0,0 +1,405 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "asserts.hpp"
+#include "dijkstra_map.hpp"
+#include "random.hpp"
+#include "unit_test.hpp"
+
+const dijkstra_map::value_type dijkstra_map::unreachable;
+
+namespace
+{
+	const int directions[8][2] = {
+		{ 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 },
+		{ 1, 1 }, { -1, 1 }, { 1, -1 }, { -1, -1 },
+	};
+
+	bool seed_less(const std::pair<int, dijkstra_map::value_type>& a, const std::pair<int, dijkstra_map::value_type>& b)
+	{
+		return a.second < b.second;
+	}
+}
+
+dijkstra_map::dijkstra_map()
+	: bounds_(),
+	  values_(),
+	  touched_(),
+	  goals_(),
+	  limit_(unreachable - 1),
+	  work_(0),
+	  current_(),
+	  next_(),
+	  invalid_(),
+	  seeds_()
+{
+}
+
+void dijkstra_map::set_limit(int limit)
+{
+	limit_ = std::max(0, std::min(limit, unreachable - 1));
+}
+
+template<typename F> 
+void dijkstra_map::for_each_neighbour(const tile_bitmap& walkable, int node, F fn) const
+{
+	const int x = bounds_.x1() + node % bounds_.w();
+	const int y = bounds_.y1() + node / bounds_.w();
+	for(auto& d : directions) {
+		const int nx = x + d[0], ny = y + d[1];
+		if(!walkable.test(nx, ny)) {
+			continue;
+		}
+		if(d[0] != 0 && d[1] != 0 && (!walkable.test(nx, y) || !walkable.test(x, ny))) {
+			continue;
+		}
+		fn(index(nx, ny));
+	}
+}
+
+void dijkstra_map::reset(const tile_bitmap& walkable)
+{
+	const rect& b = walkable.get_bounds();
+	if(b.x() != bounds_.x() || b.y() != bounds_.y() || b.w() != bounds_.w() || b.h() != bounds_.h()) {
+		bounds_ = b;
+		values_.assign(b.w() * b.h(), unreachable);
+	} else if(touched_.size() > values_.size() / 4) {
+		std::fill(values_.begin(), values_.end(), unreachable);
+	} else {
+		for(auto n : touched_) {
+			values_[n] = unreachable;
+		}
+	}
+	touched_.clear();
+	work_ = 0;
+}
+
+void dijkstra_map::set(int node, value_type v)
+{
+	if(values_[node] == unreachable) {
+		touched_.emplace_back(node);
+	}
+	values_[node] = v;
+	++work_;
+}
+
+void dijkstra_map::compute(const tile_bitmap& walkable, const std::vector<point>& goals)
+{
+	reset(walkable);
+	goals_ = goals;
+	seeds_.clear();
+	for(auto& g : goals_) {
+		if(walkable.test(g)) {
+			seeds_.emplace_back(index(g.x, g.y), 0);
+		}
+	}
+	relax(walkable, seeds_);
+}
+
+void dijkstra_map::update(const tile_bitmap& walkable, const std::vector<point>& goals)
+{
+	const rect& b = walkable.get_bounds();
+	if(b.x() != bounds_.x() || b.y() != bounds_.y() || b.w() != bounds_.w() || b.h() != bounds_.h()) {
+		compute(walkable, goals);
+		return;
+	}
+	std::vector<int> removed;
+	bool kept = false;
+	for(auto& g : goals_) {
+		if(std::find(goals.begin(), goals.end(), g) == goals.end()) {
+			if(walkable.test(g)) {
+				removed.emplace_back(index(g.x, g.y));
+			}
+		} else {
+			kept = true;
+		}
+	}
+	if(!kept) {
+		compute(walkable, goals);
+		return;
+	}
+	work_ = 0;
+	seeds_.clear();
+	for(auto& g : goals) {
+		if(walkable.test(g) && std::find(goals_.begin(), goals_.end(), g) == goals_.end()) {
+			seeds_.emplace_back(index(g.x, g.y), 0);
+		}
+	}
+	goals_ = goals;
+	invalidate(walkable, removed);
+	repair(walkable, seeds_);
+	relax(walkable, seeds_);
+}
+
+void dijkstra_map::tile_changed(const tile_bitmap& walkable, const point& p)
+{
+	if(p.x < bounds_.x1() || p.y < bounds_.y1() || p.x >= bounds_.x2() || p.y >= bounds_.y2()) {
+		return;
+	}
+	work_ = 0;
+	const int node = index(p.x, p.y);
+	seeds_.clear();
+	if(walkable.test(p)) {
+		// New ways through p, including diagonals between its neighbours that it was 
+		// blocking, can only lower the tiles around it.
+		invalid_.clear();
+		invalid_.emplace_back(node);
+		for_each_neighbour(walkable, node, [this](int n) { invalid_.emplace_back(n); });
+		if(std::find(goals_.begin(), goals_.end(), p) != goals_.end()) {
+			seeds_.emplace_back(node, 0);
+		}
+		repair(walkable, seeds_);
+	} else {
+		// The neighbours may have been reached through p or round its corners.
+		std::vector<int> sources(1, node);
+		for_each_neighbour(walkable, node, [this, &walkable, &sources](int n) {
+			if(values_[n] != unreachable && values_[n] != 0) {
+				bool supported = false;
+				const value_type v = values_[n] - 1;
+				for_each_neighbour(walkable, n, [this, v, &supported](int m) { supported = supported || values_[m] == v; });
+				if(!supported) {
+					sources.emplace_back(n);
+				}
+			}
+		});
+		invalidate(walkable, sources);
+		repair(walkable, seeds_);
+	}
+	relax(walkable, seeds_);
+}
+
+void dijkstra_map::compute_flee(const tile_bitmap& walkable, const dijkstra_map& chase, float coefficient)
+{
+	ASSERT_LOG(chase.bounds_.x() == walkable.get_bounds().x() && chase.bounds_.y() == walkable.get_bounds().y()
+		&& chase.bounds_.w() == walkable.get_bounds().w() && chase.bounds_.h() == walkable.get_bounds().h(),
+		"Flee map must be made from a map of the same area.");
+	reset(walkable);
+	goals_.clear();
+	value_type furthest = 0;
+	for(auto n : chase.touched_) {
+		if(chase.values_[n] != unreachable) {
+			furthest = std::max(furthest, chase.values_[n]);
+		}
+	}
+	seeds_.clear();
+	for(auto n : chase.touched_) {
+		if(chase.values_[n] != unreachable) {
+			const float v = std::floor(coefficient * (furthest - chase.values_[n]) + 0.5f);
+			seeds_.emplace_back(n, static_cast<value_type>(std::min(v, static_cast<float>(limit_))));
+		}
+	}
+	relax(walkable, seeds_);
+}
+
+void dijkstra_map::relax(const tile_bitmap& walkable, std::vector<seed>& seeds)
+{
+	// Tiles are visited a value at a time, so each is only set once it is final.
+	std::sort(seeds.begin(), seeds.end(), seed_less);
+	current_.clear();
+	next_.clear();
+	std::size_t ns = 0;
+	int v = 0;
+	while(ns != seeds.size() || !current_.empty()) {
+		if(current_.empty()) {
+			v = seeds[ns].second;
+			if(v > limit_) {
+				break;
+			}
+		}
+		for(; ns != seeds.size() && seeds[ns].second == v; ++ns) {
+			const int n = seeds[ns].first;
+			if(v < values_[n]) {
+				set(n, static_cast<value_type>(v));
+				current_.emplace_back(n);
+			}
+		}
+		if(v < limit_) {
+			const value_type nv = static_cast<value_type>(v + 1);
+			for(auto n : current_) {
+				if(values_[n] != v) {
+					continue;
+				}
+				for_each_neighbour(walkable, n, [this, nv](int m) {
+					if(nv < values_[m]) {
+						set(m, nv);
+						next_.emplace_back(m);
+					}
+				});
+			}
+		}
+		current_.swap(next_);
+		next_.clear();
+		++v;
+	}
+}
+
+void dijkstra_map::invalidate(const tile_bitmap& walkable, const std::vector<int>& sources)
+{
+	// Done a value at a time, so when a tile is checked for a neighbour one closer that 
+	// it could still be reached through, every tile that is going is already marked.
+	invalid_.clear();
+	std::vector<seed> lost;
+	for(auto n : sources) {
+		if(values_[n] != unreachable) {
+			lost.emplace_back(n, values_[n]);
+		}
+	}
+	std::sort(lost.begin(), lost.end(), seed_less);
+	current_.clear();
+	next_.clear();
+	std::size_t ns = 0;
+	int v = 0;
+	while(ns != lost.size() || !current_.empty()) {
+		if(current_.empty()) {
+			v = lost[ns].second;
+		}
+		for(; ns != lost.size() && lost[ns].second == v; ++ns) {
+			if(values_[lost[ns].first] == v) {
+				values_[lost[ns].first] = unreachable;
+				current_.emplace_back(lost[ns].first);
+			}
+		}
+		for(auto n : current_) {
+			invalid_.emplace_back(n);
+			for_each_neighbour(walkable, n, [this, &walkable, v](int m) {
+				if(values_[m] != v + 1) {
+					return;
+				}
+				bool supported = false;
+				for_each_neighbour(walkable, m, [this, v, &supported](int k) { supported = supported || values_[k] == v; });
+				if(!supported) {
+					values_[m] = unreachable;
+					next_.emplace_back(m);
+				}
+			});
+		}
+		current_.swap(next_);
+		next_.clear();
+		++v;
+	}
+	work_ += invalid_.size();
+}
+
+void dijkstra_map::repair(const tile_bitmap& walkable, std::vector<seed>& seeds)
+{
+	for(auto n : invalid_) {
+		if(!walkable.test(bounds_.x1() + n % bounds_.w(), bounds_.y1() + n / bounds_.w())) {
+			continue;
+		}
+		int best = unreachable;
+		for_each_neighbour(walkable, n, [this, &best](int m) { best = std::min(best, static_cast<int>(values_[m])); });
+		if(best < limit_) {
+			seeds.emplace_back(n, static_cast<value_type>(best + 1));
+		}
+	}
+}
+
+bool dijkstra_map::downhill(const point& from, point* to) const
+{
+	const value_type v = get(from);
+	if(v == unreachable || v == 0) {
+		return false;
+	}
+	value_type best = v;
+	for(auto& d : directions) {
+		const int nx = from.x + d[0], ny = from.y + d[1];
+		const value_type nv = get(nx, ny);
+		if(nv >= best) {
+			continue;
+		}
+		if(d[0] != 0 && d[1] != 0 && (get(nx, from.y) == unreachable || get(from.x, ny) == unreachable)) {
+			continue;
+		}
+		best = nv;
+		*to = point(nx, ny);
+	}
+	return best < v;
+}
+
+namespace
+{
+	point random_tile(const rect& r)
+	{
+		return point(generator::get_uniform_int<int>(r.x1(), r.x2() - 1), generator::get_uniform_int<int>(r.y1(), r.y2() - 1));
+	}
+
+	bool same_field(const dijkstra_map& a, const dijkstra_map& b, const rect& r)
+	{
+		for(int y = r.y1(); y != r.y2(); ++y) {
+			for(int x = r.x1(); x != r.x2(); ++x) {
+				if(a.get(x, y) != b.get(x, y)) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+}
+
+UNIT_TEST(dijkstra_map_repair)
+{
+	const rect r(-10, 5, 70, 45);
+	tile_bitmap walkable(r);
+	for(int y = r.y1(); y != r.y2(); ++y) {
+		for(int x = r.x1(); x != r.x2(); ++x) {
+			if(generator::get_uniform_int<int>(0, 3) != 0) {
+				walkable.set(x, y);
+			}
+		}
+	}
+	for(int limit : { 12, 1000 }) {
+		std::vector<point> goals;
+		for(int n = 0; n != 3; ++n) {
+			goals.emplace_back(random_tile(r));
+		}
+		dijkstra_map field, rebuilt;
+		field.set_limit(limit);
+		rebuilt.set_limit(limit);
+		field.compute(walkable, goals);
+		for(int step = 0; step != 50; ++step) {
+			// Goals coming and going, and tiles opening and closing.
+			if(step % 2 == 0) {
+				goals[generator::get_uniform_int<int>(0, 2)] = random_tile(r);
+				if(step % 3 == 0) {
+					goals.emplace_back(random_tile(r));
+				} else if(goals.size() > 3) {
+					goals.pop_back();
+				}
+				field.update(walkable, goals);
+			} else {
+				const point p = random_tile(r);
+				if(walkable.test(p)) {
+					walkable.unset(p.x, p.y);
+				} else {
+					walkable.set(p);
+				}
+				field.tile_changed(walkable, p);
+			}
+			rebuilt.compute(walkable, goals);
+			CHECK(same_field(field, rebuilt, r), "Repaired field differs from a rebuild at step " << step << " with limit " << limit);
+		}
+	}
+}
@@ -0,0 +1,105 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "geometry.hpp"
+#include "tile_bitmap.hpp"
+
+// Distance from every tile to the nearest of a set of goals, a.k.a. a Dijkstra map or
+// flow field. Computed once and shared by any number of actors, each of which moves by
+// stepping to its lowest neighbour. Moves are to the eight neighbours, each costing one, 
+// without cutting corners, as for the pathfinder. Values are stored one uint16_t per 
+// tile over the walkability bitmap's bounds, and only tiles within the limit of a goal 
+// are touched, so a field around the player costs the same on any size of map.
+class dijkstra_map
+{
+public:
+	typedef uint16_t value_type;
+	static const value_type unreachable = 0xffff;
+
+	dijkstra_map();
+
+	// Tiles further than this from every goal are unreachable.
+	void set_limit(int limit);
+	int get_limit() const { return limit_; }
+
+	void compute(const tile_bitmap& walkable, const std::vector<point>& goals);
+	// Same result as compute(), but starts from the current field. Tiles that only 
+	// depended on removed goals are recalculated, new goals only spread as far as they 
+	// make tiles closer. Moving the only goal changes every tile, that is a compute().
+	void update(const tile_bitmap& walkable, const std::vector<point>& goals);
+	// Call after the walkability of p changes, with the same bitmap as before.
+	void tile_changed(const tile_bitmap& walkable, const point& p);
+	// A field to run away from the goals of chase with. Tiles are valued at coefficient 
+	// times their distance from chase's goals, taken away from the furthest, so following
+	// it heads for somewhere far away, choosing a way round over a dead end.
+	void compute_flee(const tile_bitmap& walkable, const dijkstra_map& chase, float coefficient=1.2f);
+
+	value_type get(int x, int y) const {
+		if(x < bounds_.x1() || y < bounds_.y1() || x >= bounds_.x2() || y >= bounds_.y2()) {
+			return unreachable;
+		}
+		return values_[index(x, y)];
+	}
+	value_type get(const point& p) const { return get(p.x, p.y); }
+	const std::vector<point>& get_goals() const { return goals_; }
+
+	// The neighbour of from with the lowest value lower than its own, false if there
+	// is none, i.e. from is a goal or not in the field. Diagonal steps need both the
+	// tiles they pass to be in the field.
+	bool downhill(const point& from, point* to) const;
+
+	// Tiles written by the last compute or update.
+	std::size_t get_touched() const { return work_; }
+private:
+	typedef std::pair<int, value_type> seed;
+	int index(int x, int y) const { return (y - bounds_.y1()) * bounds_.w() + (x - bounds_.x1()); }
+	// Sets up the storage for the bitmap's bounds and empties the field.
+	void reset(const tile_bitmap& walkable);
+	void set(int node, value_type v);
+	// Lowers tiles to the seeds' values and spreads out from them.
+	void relax(const tile_bitmap& walkable, std::vector<seed>& seeds);
+	// Marks everything that depended on the given tiles unreachable, in invalid_.
+	void invalidate(const tile_bitmap& walkable, const std::vector<int>& sources);
+	// Seeds each invalidated tile from its neighbours.
+	void repair(const tile_bitmap& walkable, std::vector<seed>& seeds);
+	bool is_goal(int node) const;
+	template<typename F> void for_each_neighbour(const tile_bitmap& walkable, int node, F fn) const;
+
+	rect bounds_;
+	std::vector<value_type> values_;
+	// The tiles that aren't unreachable, possibly with repeats, so they can be reset.
+	std::vector<int> touched_;
+	std::vector<point> goals_;
+	int limit_;
+	std::size_t work_;
+	// Scratch space kept between updates.
+	std::vector<int> current_;
+	std::vector<int> next_;
+	std::vector<int> invalid_;
+	std::vector<seed> seeds_;
+};
@@ -32,45 +32,238 @@
 #include "component.hpp"
 #include "engine.hpp"
 #include "filesystem.hpp"
+#include "input_source.hpp"
 #include "variant_utils.hpp"
 #include "profile_timer.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
+#include "unit_test.hpp"
 
 namespace 
 {
 	// rate at which we do engine updates, 0.05 == 50ms == 20 times/second
 	const float engine_update_period = 0.05f;
+
+	// Enough for a few events per entity per tick.
+	const std::size_t event_queue_size = 1 << 15;
+
+	// Wraps the per-tick map update so that it can be scheduled like any other process.
+	// Map updates may create renderables, so must happen on the main thread.
+	class map_update : public process::process
+	{
+	public:
+		map_update() : process(::process::ProcessPriority::world) {
+			using ::process::Resource;
+			// N.B. The map reads the player's position.
+			declare_access(genmask(Resource::ENGINE) | genmask(Resource::MAP) | component::genmask(component::Component::POSITION), genmask(Resource::MAP), true);
+		}
+		void update(engine& eng, float t, const entity_list& elist) override {
+			if(eng.getMap() != nullptr) {
+				eng.getMap()->update(eng);
+			}
+		}
+		const char* get_name() const override { return "map"; }
+	};
 }
 
 engine::engine(const KRE::WindowPtr& wnd)
 	: state_(EngineState::PLAY),
 	  turns_(1),
+	  posted_turns_(1),
 	  camera_(),
 	  wnd_(wnd),
-	  entity_list_(),
-	  entity_quads_(0, rect(0,0,100,100)),
+	  entities_(component_id()),
+	  queries_(),
+	  collidable_(0),
+	  player_(),
+	  entity_quads_(rect(0,0,100,100)),
+	  quad_handles_(),
+	  occupancy_(),
+	  actors_(),
+	  paths_(),
 	  process_list_(),
 	  map_(),
 	  game_area_(0, 0, wnd->width(), wnd->height()),
+	  input_(std::make_shared<sdl_input_source>()),
+	  render_process_(nullptr),
+	  map_process_(std::make_shared<map_update>()),
+	  scheduler_(&threading::thread_pool::get()),
+	  event_bus_(event_queue_size),
+	  rebuild_schedule_(true),
+	  lag_(0.0f),
+	  entity_store_()
+{
+	collidable_ = register_query(component::genmask(component::Component::POSITION) | component::genmask(component::Component::COLLISION));
+}
+
+engine::engine(const rect& game_area, const input_source_ptr& input)
+	: state_(EngineState::PLAY),
+	  turns_(1),
+	  posted_turns_(1),
+	  camera_(),
+	  wnd_(),
+	  entities_(component_id()),
+	  queries_(),
+	  collidable_(0),
+	  player_(),
+	  entity_quads_(rect(0,0,100,100)),
+	  quad_handles_(),
+	  occupancy_(),
+	  actors_(),
+	  paths_(),
+	  process_list_(),
+	  map_(),
+	  game_area_(game_area),
+	  input_(input),
 	  render_process_(nullptr),
-	  lag_(0.0f)
+	  map_process_(),
+	  scheduler_(&threading::thread_pool::get()),
+	  event_bus_(event_queue_size),
+	  rebuild_schedule_(true),
+	  lag_(0.0f),
+	  entity_store_()
 {
+	ASSERT_LOG(input_ != nullptr, "A headless engine requires an input source.");
+	collidable_ = register_query(component::genmask(component::Component::POSITION) | component::genmask(component::Component::COLLISION));
 }
 
 engine::~engine()
 {
 }
 
-void engine::add_entity(component_set_ptr e)
+component::entity_handle engine::add_entity(component_set_ptr e)
 {
-	entity_list_.emplace_back(e);
-	std::stable_sort(entity_list_.begin(), entity_list_.end());
+	entity_store_.add(e);
+	entities_.add(e);
+	for(auto& q : queries_) {
+		if(q.matches(*e)) {
+			q.add(e);
+		}
+	}
+
+	if(e->is_player()) {
+		player_ = e;
+	}
+	update_spatial(e);
+	if((e->mask & component::genmask(component::Component::AI)) != 0) {
+		actors_.add(e->id, e->stat != nullptr ? e->stat->speed : turn_scheduler::normal_speed);
+	}
+	return entity_store_.get_handle(e->id);
 }
 
 void engine::remove_entity(component_set_ptr e1)
 {
-	entity_list_.erase(std::remove_if(entity_list_.begin(), entity_list_.end(), [&e1](component_set_ptr e2) {
-		return e1 == e2; 
-	}), entity_list_.end());
+	if(e1->store != &entity_store_) {
+		return;
+	}
+	if(e1->id < quad_handles_.size() && quad_handles_[e1->id] != entity_quadtree::invalid_handle) {
+		entity_quads_.remove(quad_handles_[e1->id]);
+		quad_handles_[e1->id] = entity_quadtree::invalid_handle;
+	}
+	if(occupancy_.contains(e1->id)) {
+		occupancy_.remove(e1->id);
+	}
+	actors_.remove(e1->id);
+	// Leaves a hole in the lists, they get compacted before the next tick.
+	entities_.remove(e1);
+	for(auto& q : queries_) {
+		q.remove(e1);
+	}
+	if(player_ == e1) {
+		player_.reset();
+	}
+	entity_store_.remove(e1);
+}
+
+void engine::remove_entity(const component::entity_handle& h)
+{
+	auto e = get_entity(h);
+	if(e != nullptr) {
+		remove_entity(e);
+	}
+}
+
+component_set_ptr engine::get_entity(const component::entity_handle& h) const
+{
+	if(!entity_store_.is_alive(h)) {
+		return nullptr;
+	}
+	return entities_.get(h.index);
+}
+
+void engine::compact_entities()
+{
+	if(entities_.is_dirty()) {
+		entities_.compact();
+	}
+	for(auto& q : queries_) {
+		if(q.is_dirty()) {
+			q.compact();
+		}
+	}
+}
+
+void engine::set_entity_mask(const component_set_ptr& e, const component_id& mask)
+{
+	ASSERT_LOG(e->store == &entity_store_, "Entity isn't in the engine.");
+	const component_id ai_mask = component::genmask(component::Component::AI);
+	const bool had_ai = (e->mask & ai_mask) != 0;
+	entity_store_.set_mask(e, mask);
+	const bool has_ai = (e->mask & ai_mask) != 0;
+	if(has_ai && !had_ai) {
+		actors_.add(e->id, e->stat != nullptr ? e->stat->speed : turn_scheduler::normal_speed);
+	} else if(had_ai && !has_ai) {
+		actors_.remove(e->id);
+	}
+	for(auto& q : queries_) {
+		if(q.matches(*e) != q.contains(e->id)) {
+			if(q.contains(e->id)) {
+				q.remove(e);
+			} else {
+				q.add(e);
+			}
+		}
+	}
+	update_spatial(e);
+}
+
+engine::query_id engine::register_query(const component_id& mask)
+{
+	for(query_id n = 0; n != queries_.size(); ++n) {
+		if(queries_[n].get_mask() == mask) {
+			return n;
+		}
+	}
+	queries_.emplace_back(mask);
+	auto& q = queries_.back();
+	entities_.for_each([&q](const component_set_ptr& e) {
+		if(q.matches(*e)) {
+			q.add(e);
+		}
+	});
+	q.compact();
+	return queries_.size() - 1;
+}
+
+std::vector<engine::query_stats> engine::get_query_stats() const
+{
+	std::vector<query_stats> res;
+	for(auto& q : queries_) {
+		query_stats qs;
+		qs.mask = q.get_mask();
+		qs.count = q.get_entities().size();
+		qs.ticks = q.get_ticks();
+		qs.total = q.get_total();
+		res.emplace_back(qs);
+	}
+	return res;
+}
+
+void engine::reset_query_stats()
+{
+	for(auto& q : queries_) {
+		q.reset_stats();
+	}
 }
 
 void engine::add_process(process::process_ptr s)
@@ -79,14 +272,27 @@ void engine::add_process(process::process_ptr s)
 	std::stable_sort(process_list_.begin(), process_list_.end(), [](const process::process_ptr& lhs, const process::process_ptr& rhs){
 		return lhs->get_priority() < rhs->get_priority();
 	});
-	s->start();
+	rebuild_schedule_ = true;
+	s->start(*this);
+}
+
+void engine::setRenderProcess(process::process_ptr s)
+{
+	if(render_process_ != nullptr) {
+		render_process_->end(*this);
+	}
+	render_process_ = s;
+	if(render_process_ != nullptr) {
+		render_process_->start(*this);
+	}
 }
 
 void engine::remove_process(process::process_ptr s)
 {
-	s->end();
+	s->end(*this);
 	process_list_.erase(std::remove_if(process_list_.begin(), process_list_.end(), 
 		[&s](process::process_ptr sp) { return sp == s; }), process_list_.end());
+	rebuild_schedule_ = true;
 }
 
 void engine::translate_mouse_coords(SDL_Event* evt)
@@ -104,7 +310,7 @@ void engine::translate_mouse_coords(SDL_Event* evt)
 void engine::process_events()
 {
 	SDL_Event evt;
-	while(SDL_PollEvent(&evt)) {
+	while(input_->poll(&evt)) {
 		bool claimed = false;
 		switch(evt.type) {
 			case SDL_MOUSEBUTTONDOWN:
@@ -121,6 +327,9 @@ void engine::process_events()
 				claimed = true;
 				switch(evt.window.event) {
 					case SDL_WINDOWEVENT_RESIZED: {
+						if(is_headless()) {
+							break;
+						}
 						int width = evt.window.data1;
 						int height = evt.window.data2;
 						wnd_->notifyNewWindowSize(width, height);
@@ -149,7 +358,7 @@ void engine::process_events()
 					// Save current state to file.
 					variant_builder save_result;
 					save_result.add("map", getMap()->write());
-					for(auto& e : entity_list_) {
+					for(auto& e : entities_.get_entities()) {
 						save_result.add("entities", write_component_set(e));
 					}
 					save_result.add("camera_position", camera_.x);
@@ -179,26 +388,61 @@ void engine::process_events()
 	}
 }
 
-void engine::populate_quadtree()
+void engine::update_spatial(const component_set_ptr& e)
 {
-	entity_quads_.clear();
-	
-	// only add entities to the quadtree that meet are collidable, but not maps
-	static component_id collision_mask 
-		= (1 << component::Component::POSITION)
-		| (1 << component::Component::SPRITE)
-		| (1 << component::Component::COLLISION);
-
-	for(auto& e : entity_list_) {
-		if((e->mask & collision_mask) == collision_mask) {
-			auto& pos = e->pos->pos;
-			auto& spr = e->spr;
-			entity_quads_.insert(e, rect(pos.x, pos.y, getMap()->getTileSize().x, getMap()->getTileSize().y));
+	// only collidable entities go in the quadtree and occupancy grid
+	if(e->id >= quad_handles_.size()) {
+		quad_handles_.resize(e->id + 1, entity_quadtree::invalid_handle);
+	}
+	auto& h = quad_handles_[e->id];
+	if(queries_[collidable_].matches(*e)) {
+		const rect r(e->pos->pos, 1, 1);
+		if(h == entity_quadtree::invalid_handle) {
+			h = entity_quads_.insert(e, r);
+		} else {
+			entity_quads_.move(h, r);
 		}
+		if(occupancy_.contains(e->id)) {
+			occupancy_.move(e->id, e->pos->pos);
+		} else {
+			occupancy_.add(e->id, e->pos->pos);
+		}
+	} else {
+		if(h != entity_quadtree::invalid_handle) {
+			entity_quads_.remove(h);
+			h = entity_quadtree::invalid_handle;
+		}
+		if(occupancy_.contains(e->id)) {
+			occupancy_.remove(e->id);
+		}
+	}
+}
+
+void engine::update_spatial()
+{
+	// Catch up with any positions changed without going through move_entity.
+	// Entities that haven't moved cost a comparison.
+	for(auto& e : get_query(collidable_)) {
+		update_spatial(e);
 	}
 }
 
-entity_list engine::entities_in_area(const rect& r)
+void engine::claim_tile(component::entity_id id, const point& p)
+{
+	if(occupancy_.contains(id)) {
+		occupancy_.move(id, p);
+	}
+}
+
+void engine::move_entity(const component_set_ptr& e, const point& p)
+{
+	e->pos->pos = p;
+	if(e->store == &entity_store_) {
+		update_spatial(e);
+	}
+}
+
+entity_list engine::entities_in_area(const rect& r) const
 {
 	entity_list res;
 	entity_quads_.get_collidable(res, r);
@@ -207,6 +451,14 @@ entity_list engine::entities_in_area(const rect& r)
 
 bool engine::update(float time)
 {
+	bool res = update_frame(time);
+	profile::frame_mark();
+	return res;
+}
+
+bool engine::update_frame(float time)
+{
+	PROFILE_ZONE("engine::update");
 	lag_ += time;
 
 	process_events();
@@ -214,40 +466,83 @@ bool engine::update(float time)
 		return state_ == EngineState::PAUSE ? true : false;
 	}
 
+	if(rebuild_schedule_) {
+		rebuild_schedule_ = false;
+		auto procs = process_list_;
+		// N.B. No map process when headless, map updates only build renderables.
+		if(map_process_ != nullptr) {
+			procs.emplace_back(map_process_);
+		}
+		std::stable_sort(procs.begin(), procs.end(), [](const process::process_ptr& lhs, const process::process_ptr& rhs){
+			return lhs->get_priority() < rhs->get_priority();
+		});
+		scheduler_.build(procs);
+	}
+
+	// anything posted from outside the update, i.e. during setup.
+	post_new_turn();
+	event_bus_.dispatch_deferred();
+
 	while(lag_ >= engine_update_period) {
-		populate_quadtree();
-		for(auto& p : process_list_) {
-			p->update(*this, engine_update_period, entity_list_);
+		PROFILE_ZONE("engine::tick");
+		compact_entities();
+		for(auto& q : queries_) {
+			q.record_tick();
 		}
-		map_->update(*this);
+		update_spatial();
+		scheduler_.run(*this, engine_update_period, entities_.get_entities());
+		post_new_turn();
+		event_bus_.dispatch_deferred();
 		lag_ -= engine_update_period;
 	}
 
-	render_process_->update(*this, lag_ / engine_update_period, entity_list_);
+	compact_entities();
+	if(render_process_ != nullptr) {
+		PROFILE_ZONE("render");
+		render_process_->update(*this, lag_ / engine_update_period, entities_.get_entities());
+	}
 
 	return true;
 }
 
 void engine::inc_turns(int cnt)
 { 
-	// N.B. The event holds the number turn number before we incremented. 
-	// So we can run things like the AI for the correct number of turns skipped.
 	// XXX On second thoughts I don't like this at all, we should skip
 	// turns at a rate 1/200ms or so I think. Gives player time to cancel
 	// if attacked etc.
-	SDL_Event user_event;
-	user_event.type = SDL_USEREVENT;
-	user_event.user.code = static_cast<Sint32>(EngineUserEvents::NEW_TURN);
-	user_event.user.data1 = reinterpret_cast<void*>(turns_);
-	user_event.user.data2 = nullptr;
-	SDL_PushEvent(&user_event);
-
+	// N.B. turns_ is only written by processes which declare they write Resource::ENGINE,
+	// so they don't run alongside anything reading it.
 	turns_ += cnt;
 }
 
+void engine::post_new_turn()
+{
+	if(turns_ == posted_turns_) {
+		return;
+	}
+	// If the queue is full the turns are posted along with the next tick's.
+	events::new_turn evt = { posted_turns_, turns_ - posted_turns_ };
+	if(event_bus_.post(evt)) {
+		posted_turns_ = turns_;
+	}
+}
+
 void engine::setMap(const mercy::BaseMapPtr& map) 
 {
 	map_ = map; 
+	paths_.set_map(map_);
+	if(map_ != nullptr && map_->isFixedSize()) {
+		entity_quads_.expand(rect(0, 0, map_->getWidth(), map_->getHeight()));
+		occupancy_.set_bounds(rect(0, 0, map_->getWidth(), map_->getHeight()));
+	}
+}
+
+void engine::tile_changed(const point& p)
+{
+	map_->tileChanged(p);
+	paths_.tile_changed(p);
+	events::tile_changed evt = { p };
+	event_bus_.post(evt);
 }
 
 void engine::set_camera(const point& cam)
@@ -272,10 +567,21 @@ void engine::set_camera(const point& cam)
 
 const component_set_ptr& engine::getPlayer() const
 {
-	for(auto& e : entity_list_) {
-		if(e->is_player()) {
-			return e;
-		}
-	}
-	return nullptr;
+	return player_;
+}
+
+UNIT_TEST(engine_set_entity_mask_actors)
+{
+	using namespace component;
+	engine eng(rect(0, 0, 10, 10), std::make_shared<queued_input_source>());
+	component_set_ptr e = std::make_shared<component_set>();
+	e->mask = genmask(Component::POSITION);
+	e->pos = std::make_shared<position>(point(1, 1));
+	eng.add_entity(e);
+	CHECK_EQ(eng.get_actors().contains(e->id), false);
+	eng.set_entity_mask(e, e->mask | genmask(Component::AI));
+	CHECK_EQ(eng.get_actors().contains(e->id), true);
+	eng.set_entity_mask(e, genmask(Component::POSITION));
+	CHECK_EQ(eng.get_actors().contains(e->id), false);
 }
+
@@ -23,12 +23,22 @@
 
 #pragma once
 
+#include <map>
+
 #include "engine_fwd.hpp"
+#include "entity_query.hpp"
+#include "entity_store.hpp"
+#include "event_bus.hpp"
 #include "geometry.hpp"
+#include "input_source.hpp"
 #include "map.hpp"
+#include "occupancy_grid.hpp"
+#include "path_service.hpp"
 #include "process.hpp"
 #include "profile_timer.hpp"
 #include "quadtree.hpp"
+#include "scheduler.hpp"
+#include "turn_scheduler.hpp"
 
 #include "SceneFwd.hpp"
 #include "WindowManagerFwd.hpp"
@@ -39,58 +49,167 @@ enum class EngineState {
 	QUIT,
 };
 
-enum class EngineUserEvents {
-	NEW_TURN = 1,
-};
+namespace events
+{
+	// Posted once per tick when the turn counter advanced during it. turn is the turn 
+	// number before the tick's increments and count the number of turns added, so 
+	// things like the AI can run for the correct number of turns skipped.
+	struct new_turn
+	{
+		int turn;
+		int count;
+	};
+
+	// Posted by engine::tile_changed().
+	struct tile_changed
+	{
+		point pos;
+	};
+}
 
 class engine
 {
 public:
 	engine(const KRE::WindowPtr& wnd);
+	// Headless engine, no window or rendering. Events are taken from input.
+	engine(const rect& game_area, const input_source_ptr& input);
 	~engine();
 	
-	void add_entity(component_set_ptr e);
+	// Entities are added and removed in O(1). The list handed to processes is only 
+	// rebuilt, in z-order, at the start of the next update.
+	component::entity_handle add_entity(component_set_ptr e);
 	void remove_entity(component_set_ptr e);
+	void remove_entity(const component::entity_handle& h);
+	// nullptr if the entity has been removed.
+	component_set_ptr get_entity(const component::entity_handle& h) const;
+
+	// Changes which components an entity has, keeping the queries and the actors up to date.
+	void set_entity_mask(const component_set_ptr& e, const component_id& mask);
+
+	// Cached list of the entities whose mask contains all the bits in mask. Queries
+	// with the same mask are shared. Register them in process::start(), the lists
+	// are kept up to date as entities are added and removed and refreshed at the
+	// start of each tick.
+	typedef std::size_t query_id;
+	query_id register_query(const component_id& mask);
+	const entity_list& get_query(query_id q) const { return queries_[q].get_entities(); }
+	struct query_stats
+	{
+		component_id mask;
+		// Entities matched at the moment.
+		std::size_t count;
+		// Ticks run and the sum of the entities matched during them.
+		std::size_t ticks;
+		std::size_t total;
+	};
+	std::vector<query_stats> get_query_stats() const;
+	void reset_query_stats();
+
+	// Moves an entity to a new tile, keeping the spatial indexes up to date.
+	void move_entity(const component_set_ptr& e, const point& p);
 
 	void add_process(process::process_ptr s);
 	void remove_process(process::process_ptr s);
-	void setRenderProcess(process::process_ptr s) { render_process_ = s; }
+	void setRenderProcess(process::process_ptr s);
+	// Run non-conflicting processes in parallel on the thread pool (the default).
+	void set_parallel_processes(bool p) { scheduler_.set_parallel(p); }
 
 	void set_state(EngineState state) { state_ = state; }
 	EngineState get_state() const { return state_; }
 
+	// N.B. Marks the end of a profiler frame, see profiler.hpp.
 	bool update(float time);
 
 	int get_turns() const { return turns_; }
+	// Safe to call from any process. A single events::new_turn covering every turn 
+	// added during a tick is posted once the tick's processes have finished.
 	void inc_turns(int cnt = 1);
 
+	// Entities with an AI component, scheduled by their speed. Added and removed along
+	// with the entities.
+	turn_scheduler& get_actors() { return actors_; }
+	// Paths are searched for in the background, see path_service.
+	path_service& get_paths() { return paths_; }
+
+	// Events posted to the bus are dispatched on the main thread after each tick.
+	events::bus& get_event_bus() { return event_bus_; }
+
 	void set_camera(const point& cam);
 	const pointf& get_camera() { return camera_; }
 
-	entity_list entities_in_area(const rect& r);
+	// Collidable entities (those with position and collision components) in an area 
+	// of tiles. Updated by move_entity and at the start of each tick.
+	entity_list entities_in_area(const rect& r) const;
+	// Which collidable entities are on each tile, updated the same way.
+	const occupancy_grid& get_occupancy() const { return occupancy_; }
+	// Moves the entity in the occupancy grid ahead of its position, so that it takes the
+	// tile for the rest of the tick. Put back at the start of the next tick if the entity
+	// doesn't move there.
+	void claim_tile(component::entity_id id, const point& p);
+	template<typename F>
+	void for_each_entity_in_area(const rect& r, F fn) const {
+		entity_quads_.for_each_in_rect(r, [&fn](const component_set_ptr& e, const rect&) { fn(e); });
+	}
+	template<typename F>
+	void for_each_entity_in_radius(const point& centre, int radius, F fn) const {
+		entity_quads_.for_each_in_radius(centre, radius, [&fn](const component_set_ptr& e, const rect&) { fn(e); });
+	}
 
 	void setMap(const mercy::BaseMapPtr& map);
 	const mercy::BaseMapPtr& getMap() const { return map_; }
+	// Call after changing a tile of the map, so visibility and paths are kept up to date.
+	void tile_changed(const point& p);
 
 	const rect& getGameArea() const { return game_area_; }
 
 	KRE::WindowPtr getWindow() const { return wnd_; }
+	bool is_headless() const { return wnd_ == nullptr; }
+	const process::scheduler& get_scheduler() const { return scheduler_; }
 
 	const component_set_ptr& getPlayer() const;
+
+	// Archetype storage holding the components of all the entities in entities_.
+	component::entity_store& get_entity_store() { return entity_store_; }
 private:
 	void translate_mouse_coords(SDL_Event* evt);
 	void process_events();
-	void populate_quadtree();
+	bool update_frame(float time);
+	void compact_entities();
+	void update_spatial();
+	void update_spatial(const component_set_ptr& e);
+	void post_new_turn();
 	EngineState state_;
 	int turns_;
+	// turns_ as of the last events::new_turn posted.
+	int posted_turns_;
 	pointf camera_;
 	KRE::WindowPtr wnd_; 
-	entity_list entity_list_;
-	quadtree<component_set_ptr> entity_quads_;
+	// Every entity, z-order determines the order the processes see them in.
+	entity_query entities_;
+	std::vector<entity_query> queries_;
+	// Position and collision, the entities held in the spatial indexes.
+	query_id collidable_;
+	component_set_ptr player_;
+	typedef quadtree<component_set_ptr> entity_quadtree;
+	entity_quadtree entity_quads_;
+	// quadtree handle for each entity, indexed by entity id.
+	std::vector<entity_quadtree::handle> quad_handles_;
+	occupancy_grid occupancy_;
+	turn_scheduler actors_;
+	path_service paths_;
 	std::vector<process::process_ptr> process_list_;
 	mercy::BaseMapPtr map_;
 	rect game_area_;
+	input_source_ptr input_;
 
 	process::process_ptr render_process_;
+	// Updates the map, scheduled along with the other processes.
+	process::process_ptr map_process_;
+	process::scheduler scheduler_;
+	events::bus event_bus_;
+	bool rebuild_schedule_;
 	float lag_;
+	// N.B. Declared after the queries so it is destroyed first, which lets it hand
+	// the components back to any entities that are still referenced elsewhere.
+	component::entity_store entity_store_;
 };
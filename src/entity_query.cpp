@@ -0,0 +1,92 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include "asserts.hpp"
+#include "entity_query.hpp"
+
+entity_query::entity_query(const component_id& mask)
+	: mask_(mask),
+	  list_(),
+	  buckets_(),
+	  slots_(),
+	  dirty_(false),
+	  ticks_(0),
+	  total_(0)
+{
+}
+
+void entity_query::add(const component_set_ptr& e)
+{
+	ASSERT_LOG(!contains(e->id), "Entity " << e->id << " was already added to the query.");
+	if(e->id >= slots_.size()) {
+		slots_.resize(e->id + 1);
+	}
+	auto& bucket = buckets_[e->zorder];
+	auto& s = slots_[e->id];
+	s.zorder = e->zorder;
+	s.index = bucket.size();
+	s.present = true;
+	bucket.emplace_back(e);
+	dirty_ = true;
+}
+
+void entity_query::remove(const component_set_ptr& e)
+{
+	if(!contains(e->id)) {
+		return;
+	}
+	auto& s = slots_[e->id];
+	buckets_[s.zorder][s.index].reset();
+	s.present = false;
+	dirty_ = true;
+}
+
+const component_set_ptr& entity_query::get(component::entity_id id) const
+{
+	ASSERT_LOG(contains(id), "Entity " << id << " isn't in the query.");
+	const auto& s = slots_[id];
+	return buckets_.find(s.zorder)->second[s.index];
+}
+
+void entity_query::compact()
+{
+	list_.clear();
+	for(auto it = buckets_.begin(); it != buckets_.end(); ) {
+		auto& bucket = it->second;
+		std::size_t out = 0;
+		for(std::size_t n = 0; n != bucket.size(); ++n) {
+			if(bucket[n] != nullptr) {
+				slots_[bucket[n]->id].index = out;
+				bucket[out++] = bucket[n];
+			}
+		}
+		bucket.resize(out);
+		if(bucket.empty()) {
+			it = buckets_.erase(it);
+			continue;
+		}
+		list_.insert(list_.end(), bucket.begin(), bucket.end());
+		++it;
+	}
+	dirty_ = false;
+}
@@ -0,0 +1,93 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "component.hpp"
+#include "engine_fwd.hpp"
+
+// Entities whose component mask contains all the bits of a query mask, kept in 
+// z-order. Entities are added and removed in O(1), removal leaves a hole behind 
+// until compact() is called, so the list handed out only changes at compaction.
+class entity_query
+{
+public:
+	explicit entity_query(const component_id& mask);
+
+	const component_id& get_mask() const { return mask_; }
+	bool matches(const component::component_set& e) const { return (e.mask & mask_) == mask_; }
+	bool contains(component::entity_id id) const { 
+		return id < slots_.size() && slots_[id].present; 
+	}
+
+	void add(const component_set_ptr& e);
+	// Does nothing if the entity isn't in the query.
+	void remove(const component_set_ptr& e);
+	// The entity must be in the query.
+	const component_set_ptr& get(component::entity_id id) const;
+	// Calls fn(const component_set_ptr&) for every entity, including those added since
+	// the last compact().
+	template<typename F>
+	void for_each(F fn) const {
+		for(auto& b : buckets_) {
+			for(auto& e : b.second) {
+				if(e != nullptr) {
+					fn(e);
+				}
+			}
+		}
+	}
+
+	bool is_dirty() const { return dirty_; }
+	// Rebuilds the list of entities from the z-order buckets.
+	void compact();
+	// Matching entities, in z-order, as of the last compact().
+	const entity_list& get_entities() const { return list_; }
+
+	// Counts how many entities the query held for another tick.
+	void record_tick() { ++ticks_; total_ += list_.size(); }
+	std::size_t get_ticks() const { return ticks_; }
+	std::size_t get_total() const { return total_; }
+	void reset_stats() { ticks_ = total_ = 0; }
+private:
+	struct slot
+	{
+		slot() : zorder(0), index(0), present(false) {}
+		int zorder;
+		std::size_t index;
+		bool present;
+	};
+
+	component_id mask_;
+	entity_list list_;
+	// Entities grouped by z-order, removed entities leave a nullptr behind.
+	std::map<int, entity_list> buckets_;
+	// Where each entity is in buckets_, indexed by entity id.
+	std::vector<slot> slots_;
+	bool dirty_;
+	std::size_t ticks_;
+	std::size_t total_;
+};
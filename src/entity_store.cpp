@@ -0,0 +1,268 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include "asserts.hpp"
+#include "entity_store.hpp"
+
+namespace component
+{
+	namespace
+	{
+		template<typename T>
+		void add_default(archetype& a)
+		{
+			if(a.has(component_traits<T>::type())) {
+				a.get<T>().emplace_back();
+			}
+		}
+
+		template<typename T>
+		void remove_at(archetype& a, std::size_t row)
+		{
+			if(a.has(component_traits<T>::type())) {
+				auto& col = a.get<T>();
+				if(row != col.size() - 1) {
+					col[row] = col.back();
+				}
+				col.pop_back();
+			}
+		}
+
+		template<typename T>
+		void copy_to(const archetype& src, std::size_t row, archetype& dest, std::size_t dest_row)
+		{
+			if(src.has(component_traits<T>::type()) && dest.has(component_traits<T>::type())) {
+				dest.get<T>()[dest_row] = src.get<T>()[row];
+			}
+		}
+
+		// copy from a detached component_ref into the store.
+		template<typename T>
+		void attach_component(component_ref<T>& ref, entity_store* store, entity_id id)
+		{
+			auto& c = ref.detached();
+			if(c != nullptr) {
+				T* dest = store->get<T>(id);
+				ASSERT_LOG(dest != nullptr, "Entity has a component that isn't included in its mask: " << get_string_from_component(component_traits<T>::type()));
+				*dest = *c;
+			}
+			ref.attach(store, id);
+		}
+
+		template<typename T>
+		void detach_component(component_ref<T>& ref, entity_store* store, entity_id id)
+		{
+			T* c = store->get<T>(id);
+			ref.detach(c != nullptr ? std::make_shared<T>(*c) : std::shared_ptr<T>());
+		}
+	}
+
+	template<typename T> T* get_component(entity_store* store, entity_id id)
+	{
+		return store->get<T>(id);
+	}
+
+	template position* get_component<position>(entity_store*, entity_id);
+	template sprite* get_component<sprite>(entity_store*, entity_id);
+	template stats* get_component<stats>(entity_store*, entity_id);
+	template ai* get_component<ai>(entity_store*, entity_id);
+	template input* get_component<input>(entity_store*, entity_id);
+
+	component_set::~component_set()
+	{
+		if(store != nullptr) {
+			store->erase(id);
+		}
+	}
+
+	archetype::archetype(const component_id& mask)
+		: mask_(mask),
+		  entities_(),
+		  columns_()
+	{
+	}
+
+	std::size_t archetype::add_row(entity_id id)
+	{
+		entities_.emplace_back(id);
+		add_default<position>(*this);
+		add_default<sprite>(*this);
+		add_default<stats>(*this);
+		add_default<ai>(*this);
+		add_default<input>(*this);
+		return entities_.size() - 1;
+	}
+
+	entity_id archetype::remove_row(std::size_t row)
+	{
+		ASSERT_LOG(row < entities_.size(), "Row out of range: " << row << " >= " << entities_.size());
+		remove_at<position>(*this, row);
+		remove_at<sprite>(*this, row);
+		remove_at<stats>(*this, row);
+		remove_at<ai>(*this, row);
+		remove_at<input>(*this, row);
+		entity_id moved = invalid_entity_id;
+		if(row != entities_.size() - 1) {
+			moved = entities_[row] = entities_.back();
+		}
+		entities_.pop_back();
+		return moved;
+	}
+
+	void archetype::copy_row(std::size_t row, archetype& dest, std::size_t dest_row) const
+	{
+		copy_to<position>(*this, row, dest, dest_row);
+		copy_to<sprite>(*this, row, dest, dest_row);
+		copy_to<stats>(*this, row, dest, dest_row);
+		copy_to<ai>(*this, row, dest, dest_row);
+		copy_to<input>(*this, row, dest, dest_row);
+	}
+
+	entity_store::entity_store()
+		: archetypes_(),
+		  archetype_map_(),
+		  records_(),
+		  free_ids_(),
+		  size_(0)
+	{
+	}
+
+	entity_store::~entity_store()
+	{
+		// Anything still referencing us gets its components back.
+		for(auto& rec : records_) {
+			if(rec.owner != nullptr) {
+				auto& e = *rec.owner;
+				detach_component(e.pos, this, e.id);
+				detach_component(e.spr, this, e.id);
+				detach_component(e.stat, this, e.id);
+				detach_component(e.aip, this, e.id);
+				detach_component(e.inp, this, e.id);
+				e.store = nullptr;
+				e.id = invalid_entity_id;
+			}
+		}
+	}
+
+	archetype* entity_store::get_archetype(const component_id& mask)
+	{
+		auto it = archetype_map_.find(mask.to_ullong());
+		if(it != archetype_map_.end()) {
+			return it->second;
+		}
+		archetypes_.emplace_back(new archetype(mask));
+		archetype* a = archetypes_.back().get();
+		archetype_map_[mask.to_ullong()] = a;
+		return a;
+	}
+
+	void entity_store::add(const component_set_ptr& e)
+	{
+		ASSERT_LOG(e->store == nullptr, "Entity has already been added to a store.");
+		entity_id id;
+		if(!free_ids_.empty()) {
+			id = free_ids_.back();
+			free_ids_.pop_back();
+		} else {
+			id = static_cast<entity_id>(records_.size());
+			records_.emplace_back();
+		}
+		auto& rec = records_[id];
+		rec.arch = get_archetype(e->mask);
+		rec.row = rec.arch->add_row(id);
+		rec.owner = e.get();
+		e->store = this;
+		e->id = id;
+		attach_component(e->pos, this, id);
+		attach_component(e->spr, this, id);
+		attach_component(e->stat, this, id);
+		attach_component(e->aip, this, id);
+		attach_component(e->inp, this, id);
+		++size_;
+	}
+
+	void entity_store::remove(const component_set_ptr& e)
+	{
+		ASSERT_LOG(e->store == this, "Entity isn't held in this store.");
+		const entity_id id = e->id;
+		detach_component(e->pos, this, id);
+		detach_component(e->spr, this, id);
+		detach_component(e->stat, this, id);
+		detach_component(e->aip, this, id);
+		detach_component(e->inp, this, id);
+
+		erase(id);
+		e->store = nullptr;
+		e->id = invalid_entity_id;
+	}
+
+	void entity_store::erase(entity_id id)
+	{
+		auto& rec = records_[id];
+		entity_id moved = rec.arch->remove_row(rec.row);
+		if(moved != invalid_entity_id) {
+			records_[moved].row = rec.row;
+		}
+		const unsigned generation = rec.generation + 1;
+		rec = entity_record();
+		rec.generation = generation;
+		free_ids_.emplace_back(id);
+		--size_;
+	}
+
+	void entity_store::set_mask(const component_set_ptr& e, const component_id& mask)
+	{
+		ASSERT_LOG(e->store == this, "Entity isn't held in this store.");
+		if(e->mask == mask) {
+			return;
+		}
+		e->mask = mask;
+		auto& rec = records_[e->id];
+		archetype* dest = get_archetype(mask);
+		const std::size_t dest_row = dest->add_row(e->id);
+		rec.arch->copy_row(rec.row, *dest, dest_row);
+		entity_id moved = rec.arch->remove_row(rec.row);
+		if(moved != invalid_entity_id) {
+			records_[moved].row = rec.row;
+		}
+		rec.arch = dest;
+		rec.row = dest_row;
+	}
+
+	component_set* entity_store::get_entity(entity_id id) const
+	{
+		ASSERT_LOG(id < records_.size(), "Entity id out of range: " << id);
+		return records_[id].owner;
+	}
+
+	std::vector<archetype*> entity_store::query(const component_id& mask) const
+	{
+		std::vector<archetype*> res;
+		for(auto& a : archetypes_) {
+			if((a->mask() & mask) == mask) {
+				res.emplace_back(a.get());
+			}
+		}
+		return res;
+	}
+}
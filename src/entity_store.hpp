@@ -0,0 +1,210 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "component.hpp"
+
+namespace component
+{
+	// Maps a component type onto its Component enumeration and the column
+	// it is stored in inside an archetype.
+	template<typename T> struct component_traits;
+	template<> struct component_traits<position> { static Component type() { return Component::POSITION; } enum { column = 0 }; };
+	template<> struct component_traits<sprite>   { static Component type() { return Component::SPRITE; }   enum { column = 1 }; };
+	template<> struct component_traits<stats>    { static Component type() { return Component::STATS; }    enum { column = 2 }; };
+	template<> struct component_traits<ai>       { static Component type() { return Component::AI; }       enum { column = 3 }; };
+	template<> struct component_traits<input>    { static Component type() { return Component::INPUT; }    enum { column = 4 }; };
+
+	template<typename... Ts> struct mask_of;
+	template<> struct mask_of<>
+	{
+		static component_id value() { return component_id(0); }
+	};
+	template<typename T, typename... Ts> struct mask_of<T, Ts...>
+	{
+		static component_id value() { return genmask(component_traits<T>::type()) | mask_of<Ts...>::value(); }
+	};
+
+	// All the entities which share exactly the same component mask. Each component type
+	// is kept in its own contiguous array, row n of every array belongs to the same entity.
+	class archetype
+	{
+	public:
+		explicit archetype(const component_id& mask);
+		const component_id& mask() const { return mask_; }
+		bool has(Component c) const { return (mask_ & genmask(c)) == genmask(c); }
+		std::size_t size() const { return entities_.size(); }
+		bool empty() const { return entities_.empty(); }
+		entity_id get_entity(std::size_t row) const { return entities_[row]; }
+
+		template<typename T> std::vector<T>& get() { return std::get<component_traits<T>::column>(columns_); }
+		template<typename T> const std::vector<T>& get() const { return std::get<component_traits<T>::column>(columns_); }
+
+		// Adds a row for the given entity, with default constructed components. Returns the row.
+		std::size_t add_row(entity_id id);
+		// Removes the row by moving the last row into it. Returns the id of the entity that
+		// was moved, or invalid_entity_id if row was the last row.
+		entity_id remove_row(std::size_t row);
+		// Copy any components that both archetypes have in common from row in this
+		// archetype into dest_row of dest.
+		void copy_row(std::size_t row, archetype& dest, std::size_t dest_row) const;
+	private:
+		component_id mask_;
+		std::vector<entity_id> entities_;
+		std::tuple<std::vector<position>, 
+			std::vector<sprite>, 
+			std::vector<stats>, 
+			std::vector<ai>, 
+			std::vector<input>> columns_;
+		archetype() = delete;
+	};
+	typedef std::unique_ptr<archetype> archetype_ptr;
+
+	// Archetype based storage for all the entities in the engine.
+	class entity_store
+	{
+	public:
+		entity_store();
+		~entity_store();
+
+		// Moves the components of e into the store, e's component members refer
+		// to the stored data afterwards.
+		void add(const component_set_ptr& e);
+		// Copies the components back out of the store into e.
+		void remove(const component_set_ptr& e);
+		// Change the component mask of an entity already in the store, moving it to
+		// the archetype for the new mask. Components that were added are default constructed.
+		void set_mask(const component_set_ptr& e, const component_id& mask);
+
+		std::size_t size() const { return size_; }
+		component_set* get_entity(entity_id id) const;
+		entity_handle get_handle(entity_id id) const { 
+			return entity_handle(id, records_[id].generation); 
+		}
+		// False once the entity the handle refers to has been removed.
+		bool is_alive(const entity_handle& h) const {
+			return h.index < records_.size() && records_[h.index].owner != nullptr && records_[h.index].generation == h.generation;
+		}
+
+		template<typename T> T* get(entity_id id) {
+			const auto& rec = records_[id];
+			if(rec.arch == nullptr || !rec.arch->has(component_traits<T>::type())) {
+				return nullptr;
+			}
+			return &rec.arch->get<T>()[rec.row];
+		}
+
+		// List of all archetypes whose masks contain all the bits in mask.
+		std::vector<archetype*> query(const component_id& mask) const;
+
+		// Calls fn(entity_id, Ts&...) for every entity that has all of the components Ts
+		// and all the (tag) components in tags.
+		template<typename... Ts, typename F>
+		void each(const component_id& tags, F fn) {
+			const component_id mask = mask_of<Ts...>::value() | tags;
+			for(auto& a : archetypes_) {
+				if((a->mask() & mask) != mask) {
+					continue;
+				}
+				for(std::size_t row = 0; row != a->size(); ++row) {
+					fn(a->get_entity(row), a->get<Ts>()[row]...);
+				}
+			}
+		}
+		template<typename... Ts, typename F>
+		void each(F fn) {
+			each<Ts...>(component_id(0), fn);
+		}
+
+		// Iterable view over every entity with the components Ts (and tag bits in tags).
+		// for(auto& row : store.view<position, input>()) { row.get<position>().mov.clear(); }
+		template<typename... Ts>
+		class view
+		{
+		public:
+			class iterator
+			{
+			public:
+				iterator(const std::vector<archetype*>* archs, std::size_t ndx) : archs_(archs), ndx_(ndx), row_(0) { skip_empty(); }
+				iterator& operator*() { return *this; }
+				iterator& operator++() {
+					if(++row_ >= (*archs_)[ndx_]->size()) {
+						++ndx_;
+						row_ = 0;
+						skip_empty();
+					}
+					return *this;
+				}
+				bool operator==(const iterator& other) const { return ndx_ == other.ndx_ && row_ == other.row_; }
+				bool operator!=(const iterator& other) const { return !(*this == other); }
+				template<typename T> T& get() { return (*archs_)[ndx_]->template get<T>()[row_]; }
+				entity_id entity() const { return (*archs_)[ndx_]->get_entity(row_); }
+			private:
+				void skip_empty() {
+					while(ndx_ < archs_->size() && (*archs_)[ndx_]->empty()) {
+						++ndx_;
+					}
+				}
+				const std::vector<archetype*>* archs_;
+				std::size_t ndx_;
+				std::size_t row_;
+			};
+			explicit view(const std::vector<archetype*>& archs) : archs_(archs) {}
+			iterator begin() const { return iterator(&archs_, 0); }
+			iterator end() const { return iterator(&archs_, archs_.size()); }
+		private:
+			std::vector<archetype*> archs_;
+		};
+
+		template<typename... Ts>
+		view<Ts...> get_view(const component_id& tags=component_id(0)) const {
+			return view<Ts...>(query(mask_of<Ts...>::value() | tags));
+		}
+	private:
+		friend struct component_set;
+		archetype* get_archetype(const component_id& mask);
+		void erase(entity_id id);
+		struct entity_record
+		{
+			entity_record() : arch(nullptr), row(0), owner(nullptr), generation(0) {}
+			archetype* arch;
+			std::size_t row;
+			component_set* owner;
+			unsigned generation;
+		};
+		std::vector<archetype_ptr> archetypes_;
+		std::map<unsigned long long, archetype*> archetype_map_;
+		std::vector<entity_record> records_;
+		std::vector<entity_id> free_ids_;
+		std::size_t size_;
+
+		entity_store(const entity_store&) = delete;
+		void operator=(const entity_store&) = delete;
+	};
+}
@@ -0,0 +1,145 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include "asserts.hpp"
+#include "event_bus.hpp"
+#include "unit_test.hpp"
+
+namespace events
+{
+	namespace detail
+	{
+		type_id next_type_id()
+		{
+			static std::atomic<type_id> counter(0);
+			return counter++;
+		}
+	}
+
+	bus::bus(std::size_t queue_capacity)
+		: channels_(),
+		  queue_(new queued_event[queue_capacity]),
+		  mask_(queue_capacity - 1),
+		  enqueue_pos_(0),
+		  dequeue_pos_(0),
+		  dropped_(0)
+	{
+		ASSERT_LOG(queue_capacity >= 2 && (queue_capacity & (queue_capacity - 1)) == 0, "Event queue capacity must be a power of two: " << queue_capacity);
+		for(std::size_t n = 0; n != queue_capacity; ++n) {
+			queue_[n].sequence.store(n, std::memory_order_relaxed);
+		}
+	}
+
+	bus::~bus()
+	{
+	}
+
+	void bus::unsubscribe(const subscription& s)
+	{
+		if(s.type < channels_.size() && channels_[s.type] != nullptr) {
+			channels_[s.type]->remove(s.index);
+		}
+	}
+
+	bus::queued_event* bus::acquire_slot()
+	{
+		std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		for(;;) {
+			queued_event* slot = &queue_[pos & mask_];
+			const std::size_t seq = slot->sequence.load(std::memory_order_acquire);
+			const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+			if(diff == 0) {
+				if(enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					return slot;
+				}
+			} else if(diff < 0) {
+				// Full. The consumer may well be waiting on this thread, so don't wait for it.
+				return nullptr;
+			} else {
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void bus::release_slot(queued_event* slot)
+	{
+		const std::size_t pos = slot->sequence.load(std::memory_order_relaxed);
+		slot->sequence.store(pos + 1, std::memory_order_release);
+	}
+
+	std::size_t bus::dispatch_deferred()
+	{
+		std::size_t count = 0;
+		for(;;) {
+			queued_event* slot = &queue_[dequeue_pos_ & mask_];
+			const std::size_t seq = slot->sequence.load(std::memory_order_acquire);
+			if(seq != dequeue_pos_ + 1) {
+				// empty, or the next event is still being written.
+				break;
+			}
+			if(slot->type < channels_.size() && channels_[slot->type] != nullptr) {
+				channels_[slot->type]->dispatch(&slot->data);
+			}
+			slot->sequence.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+			++dequeue_pos_;
+			++count;
+		}
+		return count;
+	}
+}
+
+namespace
+{
+	struct test_event
+	{
+		int value;
+	};
+}
+
+UNIT_TEST(event_bus_subscribe_while_dispatching)
+{
+	events::bus b(16);
+	int first_calls = 0;
+	int added_calls = 0;
+	events::subscription self;
+	// Enough subscribers added from inside the handler to make the handlers reallocate.
+	self = b.subscribe<test_event>([&](const test_event& e) {
+		++first_calls;
+		for(int n = 0; n != 64; ++n) {
+			b.subscribe<test_event>([&added_calls](const test_event&) { ++added_calls; });
+		}
+		b.unsubscribe(self);
+		CHECK_EQ(e.value, first_calls);
+	});
+
+	b.publish(test_event{ 1 });
+	CHECK_EQ(first_calls, 1);
+	CHECK_EQ(added_calls, 0);
+
+	// Posted and dispatched the same way.
+	CHECK_EQ(b.post(test_event{ 2 }), true);
+	CHECK_EQ(b.dispatch_deferred(), 1);
+	CHECK_EQ(first_calls, 1);
+	CHECK_EQ(added_calls, 64);
+}
+
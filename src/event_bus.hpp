@@ -0,0 +1,204 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace events
+{
+	// Events are plain structs, they are copied by value into the deferred queue so 
+	// must be trivially destructible and no bigger than max_event_size.
+	const std::size_t max_event_size = 32;
+
+	typedef std::size_t type_id;
+
+	namespace detail
+	{
+		type_id next_type_id();
+
+		template<typename T>
+		struct type_index
+		{
+			static type_id get() {
+				static const type_id id = next_type_id();
+				return id;
+			}
+		};
+	}
+
+	struct subscription
+	{
+		subscription() : type(~std::size_t(0)), index(0) {}
+		subscription(type_id t, std::size_t n) : type(t), index(n) {}
+		type_id type;
+		std::size_t index;
+	};
+
+	// Typed publish/subscribe. publish() calls the subscribers straight away on the calling
+	// thread. post() may be called from any thread, it copies the event into a bounded 
+	// lock-free queue and the subscribers are called later from dispatch_deferred(), which
+	// should only be called from one thread (the main thread in the engine). Handlers may 
+	// subscribe and unsubscribe, see channel below. If the queue
+	// is full post() drops the event and returns false, it never waits for the queue to be
+	// drained, so size it for the most events posted between calls to dispatch_deferred().
+	// Neither allocates, only subscribing and unsubscribing do.
+	// Subscribing should happen on the dispatching thread.
+	class bus
+	{
+	public:
+		// N.B. queue_capacity must be a power of two.
+		explicit bus(std::size_t queue_capacity=4096);
+		~bus();
+
+		template<typename T>
+		subscription subscribe(const std::function<void(const T&)>& fn) {
+			const type_id t = detail::type_index<T>::get();
+			if(t >= channels_.size()) {
+				channels_.resize(t + 1);
+			}
+			if(channels_[t] == nullptr) {
+				channels_[t].reset(new channel<T>());
+			}
+			return subscription(t, static_cast<channel<T>*>(channels_[t].get())->add(fn));
+		}
+		void unsubscribe(const subscription& s);
+
+		template<typename T>
+		void publish(const T& evt) const {
+			const type_id t = detail::type_index<T>::get();
+			if(t < channels_.size() && channels_[t] != nullptr) {
+				channels_[t]->dispatch(&evt);
+			}
+		}
+
+		template<typename T>
+		bool post(const T& evt) {
+			static_assert(sizeof(T) <= max_event_size, "Event too large to be posted, increase events::max_event_size");
+			static_assert(std::is_trivially_destructible<T>::value, "Posted events must be trivially destructible.");
+			queued_event* slot = acquire_slot();
+			if(slot == nullptr) {
+				dropped_.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			slot->type = detail::type_index<T>::get();
+			new(&slot->data) T(evt);
+			release_slot(slot);
+			return true;
+		}
+		// Number of events post() has dropped because the queue was full.
+		std::size_t get_dropped_count() const { return dropped_.load(std::memory_order_relaxed); }
+
+		// Calls the subscribers for everything posted so far, including anything posted
+		// by those subscribers. Returns the number of events dispatched.
+		std::size_t dispatch_deferred();
+	private:
+		struct channel_base
+		{
+			virtual ~channel_base() {}
+			virtual void dispatch(const void* evt) = 0;
+			virtual void remove(std::size_t index) = 0;
+		};
+
+		// Subscribers added or removed while dispatching, possibly by the handlers being 
+		// called, are only added to or removed from handlers once the outermost dispatch 
+		// finishes. So a running handler is never moved or destroyed, and new subscribers
+		// start with the next event.
+		template<typename T>
+		struct channel : public channel_base
+		{
+			channel() : handlers(), added(), removed(), depth(0) {}
+			void dispatch(const void* evt) override {
+				const T& e = *static_cast<const T*>(evt);
+				++depth;
+				for(std::size_t n = 0; n != handlers.size(); ++n) {
+					if(handlers[n] && std::find(removed.begin(), removed.end(), n) == removed.end()) {
+						handlers[n](e);
+					}
+				}
+				if(--depth == 0) {
+					for(auto n : removed) {
+						handlers[n] = nullptr;
+					}
+					removed.clear();
+					handlers.insert(handlers.end(), added.begin(), added.end());
+					added.clear();
+				}
+			}
+			std::size_t add(const std::function<void(const T&)>& fn) {
+				if(depth > 0) {
+					added.emplace_back(fn);
+					return handlers.size() + added.size() - 1;
+				}
+				handlers.emplace_back(fn);
+				return handlers.size() - 1;
+			}
+			void remove(std::size_t index) override {
+				if(index >= handlers.size()) {
+					if(index - handlers.size() < added.size()) {
+						added[index - handlers.size()] = nullptr;
+					}
+				} else if(depth > 0) {
+					removed.emplace_back(index);
+				} else {
+					handlers[index] = nullptr;
+				}
+			}
+			std::vector<std::function<void(const T&)>> handlers;
+			std::vector<std::function<void(const T&)>> added;
+			std::vector<std::size_t> removed;
+			int depth;
+		};
+
+		struct queued_event
+		{
+			std::atomic<std::size_t> sequence;
+			type_id type;
+			typename std::aligned_storage<max_event_size>::type data;
+		};
+
+		// nullptr if the queue is full.
+		queued_event* acquire_slot();
+		void release_slot(queued_event* slot);
+
+		std::vector<std::unique_ptr<channel_base>> channels_;
+
+		// Bounded queue (after Dmitry Vyukov's), each slot's sequence number says whether
+		// it is free to be written or ready to be read.
+		std::unique_ptr<queued_event[]> queue_;
+		std::size_t mask_;
+		std::atomic<std::size_t> enqueue_pos_;
+		std::size_t dequeue_pos_;
+		std::atomic<std::size_t> dropped_;
+
+		bus(const bus&) = delete;
+		void operator=(const bus&) = delete;
+	};
+}
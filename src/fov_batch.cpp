@@ -0,0 +1,59 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include "fov_batch.hpp"
+
+namespace
+{
+	// Requests per task, a field of view is a few microseconds.
+	const int fov_grain = 16;
+}
+
+fov_batch::fov_batch()
+	: requests_(),
+	  results_()
+{
+}
+
+void fov_batch::clear()
+{
+	requests_.clear();
+}
+
+std::size_t fov_batch::add(const point& origin, int radius)
+{
+	requests_.emplace_back(origin, radius);
+	if(results_.size() < requests_.size()) {
+		results_.resize(requests_.size());
+	}
+	return requests_.size() - 1;
+}
+
+void fov_batch::compute(const mercy::BaseMap& map, threading::thread_pool& pool)
+{
+	threading::parallel_for(0, static_cast<int>(requests_.size()), fov_grain, [this, &map](int first, int last) {
+		for(int n = first; n != last; ++n) {
+			map.getVisibleTilesAt(requests_[n].origin, requests_[n].radius, &results_[n]);
+		}
+	}, pool);
+}
@@ -0,0 +1,63 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "geometry.hpp"
+#include "map.hpp"
+#include "thread_pool.hpp"
+#include "tile_bitmap.hpp"
+
+// Fields of view for many origins at once, e.g. what every monster on the level can
+// see. The requests are computed in parallel, the bitmaps are kept between batches
+// so their storage gets reused.
+class fov_batch
+{
+public:
+	fov_batch();
+
+	// Removes the requests, keeping the bitmaps.
+	void clear();
+	// Returns the index of the result.
+	std::size_t add(const point& origin, int radius);
+	std::size_t size() const { return requests_.size(); }
+
+	void compute(const mercy::BaseMap& map, threading::thread_pool& pool=threading::thread_pool::get());
+
+	const point& get_origin(std::size_t n) const { return requests_[n].origin; }
+	int get_radius(std::size_t n) const { return requests_[n].radius; }
+	// Valid after compute().
+	const tile_bitmap& get(std::size_t n) const { return results_[n]; }
+private:
+	struct request
+	{
+		request(const point& o, int r) : origin(o), radius(r) {}
+		point origin;
+		int radius;
+	};
+	std::vector<request> requests_;
+	// Never shrinks.
+	std::vector<tile_bitmap> results_;
+};
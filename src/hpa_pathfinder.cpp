@@ -0,0 +1,451 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "asserts.hpp"
+#include "hpa_pathfinder.hpp"
+
+namespace
+{
+	const point sides[4] = { point(1, 0), point(-1, 0), point(0, 1), point(0, -1) };
+
+	const int directions[8][2] = {
+		{ 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 },
+		{ 1, 1 }, { -1, 1 }, { 1, -1 }, { -1, -1 },
+	};
+
+	// Entrances at least this wide get a portal at each end rather than one in the middle.
+	const int wide_entrance = 6;
+
+	int floor_div(int n, int d)
+	{
+		return n >= 0 ? n / d : -((-n + d - 1) / d);
+	}
+}
+
+const uint32_t hpa_pathfinder::no_path;
+
+hpa_pathfinder::hpa_pathfinder(int chunk_w, int chunk_h, const point& origin, sample_fn sample)
+	: chunk_w_(chunk_w),
+	  chunk_h_(chunk_h),
+	  origin_(origin),
+	  sample_(sample),
+	  chunks_(),
+	  max_chunks_(16384),
+	  search_limit_(4096),
+	  heuristic_weight_(1.25f),
+	  expanded_(0),
+	  sampled_(0),
+	  local_(),
+	  search_stamp_(0),
+	  from_(),
+	  to_(),
+	  to_g_(no_path),
+	  to_parent_(),
+	  open_(),
+	  from_costs_(),
+	  to_costs_(),
+	  row_costs_(),
+	  near_walkable_(),
+	  near_path_()
+{
+	ASSERT_LOG(chunk_w_ > 0 && chunk_h_ > 0, "Chunk size must be positive: " << chunk_w_ << "x" << chunk_h_);
+}
+
+point hpa_pathfinder::get_chunk(const point& p) const
+{
+	return point(floor_div(p.x - origin_.x, chunk_w_), floor_div(p.y - origin_.y, chunk_h_));
+}
+
+rect hpa_pathfinder::get_chunk_area(const point& chunk) const
+{
+	return rect(origin_.x + chunk.x * chunk_w_, origin_.y + chunk.y * chunk_h_, chunk_w_, chunk_h_);
+}
+
+void hpa_pathfinder::chunk_changed(const point& chunk)
+{
+	chunks_.erase(chunk);
+	// The portals on the shared borders depend on both sides.
+	for(auto& d : sides) {
+		auto it = chunks_.find(chunk + d);
+		if(it != chunks_.end()) {
+			it->second.built = false;
+		}
+	}
+}
+
+void hpa_pathfinder::clear()
+{
+	chunks_.clear();
+	sampled_ = 0;
+}
+
+hpa_pathfinder::chunk_data& hpa_pathfinder::get_sampled(const point& chunk)
+{
+	auto it = chunks_.find(chunk);
+	if(it != chunks_.end()) {
+		return it->second;
+	}
+	chunk_data& cd = chunks_[chunk];
+	const rect area = get_chunk_area(chunk);
+	cd.walkable.reset(area);
+	sample_(area, &cd.walkable);
+	++sampled_;
+	return cd;
+}
+
+hpa_pathfinder::chunk_data& hpa_pathfinder::get_built(const point& chunk)
+{
+	chunk_data& cd = get_sampled(chunk);
+	if(!cd.built) {
+		build(chunk, cd);
+	}
+	return cd;
+}
+
+void hpa_pathfinder::build(const point& chunk, chunk_data& cd)
+{
+	cd.portals.clear();
+	for(auto& d : sides) {
+		add_portals(chunk, cd, d);
+	}
+	const std::size_t n = cd.portals.size();
+	cd.costs.assign(n * n, no_path);
+	cd.costs_ready.assign(n, 0);
+	cd.g.assign(n, no_path);
+	cd.stamp.assign(n, 0);
+	cd.parent.assign(n, node_ref());
+	cd.built = true;
+}
+
+void hpa_pathfinder::add_portals(const point& chunk, chunk_data& cd, const point& d)
+{
+	const chunk_data& neighbour = get_sampled(chunk + d);
+	const rect area = get_chunk_area(chunk);
+	// The row or column of tiles along the border, on this chunk's side.
+	const point start(d.x > 0 ? area.x2() - 1 : area.x(), d.y > 0 ? area.y2() - 1 : area.y());
+	const point step(d.x == 0 ? 1 : 0, d.y == 0 ? 1 : 0);
+	const int length = d.x == 0 ? area.w() : area.h();
+
+	auto add = [&](int n) {
+		const point p(start.x + step.x * n, start.y + step.y * n);
+		// Corner tiles can be on two borders.
+		auto it = std::find_if(cd.portals.begin(), cd.portals.end(), [&p](const portal& pt) { return pt.pos == p; });
+		if(it == cd.portals.end()) {
+			cd.portals.emplace_back();
+			it = cd.portals.end() - 1;
+			it->pos = p;
+		}
+		it->exits.emplace_back(p + d);
+	};
+
+	// Both chunks walk the border in the same order, so they agree on where the portals are.
+	int run_start = -1;
+	for(int n = 0; n <= length; ++n) {
+		const point p(start.x + step.x * n, start.y + step.y * n);
+		const bool open = n < length && cd.walkable.test(p) && neighbour.walkable.test(p + d);
+		if(open && run_start < 0) {
+			run_start = n;
+		} else if(!open && run_start >= 0) {
+			const int run_end = n - 1;
+			if(run_end - run_start + 1 >= wide_entrance) {
+				add(run_start);
+				add(run_end);
+			} else {
+				add((run_start + run_end) / 2);
+			}
+			run_start = -1;
+		}
+	}
+}
+
+const uint32_t* hpa_pathfinder::get_costs(chunk_data& cd, int a)
+{
+	const std::size_t n = cd.portals.size();
+	uint32_t* row = &cd.costs[a * n];
+	if(!cd.costs_ready[a]) {
+		local_costs(cd, cd.portals[a].pos, &row_costs_);
+		for(std::size_t b = 0; b != n; ++b) {
+			row[b] = local_cost(cd, row_costs_, cd.portals[b].pos);
+		}
+		cd.costs_ready[a] = 1;
+	}
+	return row;
+}
+
+void hpa_pathfinder::local_costs(const chunk_data& cd, const point& p, std::vector<uint32_t>* costs)
+{
+	const tile_bitmap& walkable = cd.walkable;
+	const rect& area = walkable.get_bounds();
+	costs->assign(area.w() * area.h(), no_path);
+
+	// Moves cost at most 14, so with 16 buckets each only ever holds one cost.
+	const int start = (p.y - area.y()) * area.w() + (p.x - area.x());
+	(*costs)[start] = 0;
+	buckets_[0].push_back(start);
+	std::size_t pending = 1;
+	for(uint32_t cost = 0; pending != 0; ++cost) {
+		std::vector<int>& bucket = buckets_[cost & 15];
+		pending -= bucket.size();
+		for(std::size_t n = 0; n != bucket.size(); ++n) {
+			const int node = bucket[n];
+			if((*costs)[node] != cost) {
+				continue;
+			}
+			const int x = area.x() + node % area.w();
+			const int y = area.y() + node / area.w();
+			for(auto& d : directions) {
+				const int nx = x + d[0], ny = y + d[1];
+				// Tiles outside the chunk test as unwalkable.
+				if(!walkable.test(nx, ny)) {
+					continue;
+				}
+				const bool diagonal = d[0] != 0 && d[1] != 0;
+				if(diagonal && (!walkable.test(nx, y) || !walkable.test(x, ny))) {
+					continue;
+				}
+				const uint32_t g = cost + (diagonal ? pathfinder::diagonal_cost : pathfinder::straight_cost);
+				const int next = (ny - area.y()) * area.w() + (nx - area.x());
+				if(g < (*costs)[next]) {
+					(*costs)[next] = g;
+					buckets_[g & 15].push_back(next);
+					++pending;
+				}
+			}
+		}
+		bucket.clear();
+	}
+}
+
+uint32_t hpa_pathfinder::local_cost(const chunk_data& cd, const std::vector<uint32_t>& costs, const point& p) const
+{
+	const rect& area = cd.walkable.get_bounds();
+	return costs[(p.y - area.y()) * area.w() + (p.x - area.x())];
+}
+
+uint32_t hpa_pathfinder::heuristic(const point& p) const
+{
+	const int dx = std::abs(p.x - to_.x), dy = std::abs(p.y - to_.y);
+	const uint32_t h = pathfinder::straight_cost * std::max(dx, dy) + (pathfinder::diagonal_cost - pathfinder::straight_cost) * std::min(dx, dy);
+	return static_cast<uint32_t>(h * heuristic_weight_);
+}
+
+const point& hpa_pathfinder::get_position(const node_ref& n) const
+{
+	if(n.index == -1) {
+		return from_;
+	} else if(n.index == -2) {
+		return to_;
+	}
+	return n.chunk->portals[n.index].pos;
+}
+
+void hpa_pathfinder::relax(const node_ref& n, uint32_t g, const node_ref& parent)
+{
+	if(n.index == -2) {
+		if(g < to_g_) {
+			to_g_ = g;
+			to_parent_ = parent;
+			open_.emplace_back(g, g, n);
+			std::push_heap(open_.begin(), open_.end());
+		}
+		return;
+	}
+	chunk_data& cd = *n.chunk;
+	if(cd.stamp[n.index] == search_stamp_ + 1) {
+		return;
+	} else if(cd.stamp[n.index] != search_stamp_) {
+		cd.stamp[n.index] = search_stamp_;
+		cd.g[n.index] = no_path;
+	}
+	if(g < cd.g[n.index]) {
+		cd.g[n.index] = g;
+		cd.parent[n.index] = parent;
+		open_.emplace_back(g + heuristic(cd.portals[n.index].pos), g, n);
+		std::push_heap(open_.begin(), open_.end());
+	}
+}
+
+bool hpa_pathfinder::find_abstract(const point& from, const point& to, std::vector<point>* waypoints)
+{
+	waypoints->clear();
+	expanded_ = 0;
+	if(chunks_.size() > max_chunks_) {
+		clear();
+	}
+	const point from_chunk = get_chunk(from);
+	const point to_chunk = get_chunk(to);
+	chunk_data& from_cd = get_built(from_chunk);
+	chunk_data& to_cd = get_built(to_chunk);
+	if(!from_cd.walkable.test(from) || !to_cd.walkable.test(to)) {
+		return false;
+	}
+	if(from == to) {
+		return true;
+	}
+
+	search_stamp_ += 2;
+	if(search_stamp_ < 2) {
+		for(auto& c : chunks_) {
+			std::fill(c.second.stamp.begin(), c.second.stamp.end(), 0);
+		}
+		search_stamp_ = 2;
+	}
+	from_ = from;
+	to_ = to;
+	to_g_ = no_path;
+	to_parent_ = node_ref();
+	open_.clear();
+	// The ends are joined to the portals of their chunks for this search only.
+	local_costs(from_cd, from, &from_costs_);
+	local_costs(to_cd, to, &to_costs_);
+
+	const std::size_t sampled_before = sampled_;
+	open_.emplace_back(heuristic(from), 0, node_ref(nullptr, -1));
+	while(!open_.empty()) {
+		std::pop_heap(open_.begin(), open_.end());
+		const open_node top = open_.back();
+		open_.pop_back();
+		if(top.node.index == -2) {
+			if(top.g != to_g_) {
+				continue;
+			}
+			for(node_ref n = to_parent_; n.index != -1; n = n.chunk->parent[n.index]) {
+				waypoints->emplace_back(get_position(n));
+			}
+			std::reverse(waypoints->begin(), waypoints->end());
+			waypoints->emplace_back(to);
+			return true;
+		} else if(top.node.index == -1) {
+			++expanded_;
+			for(int b = 0; b != static_cast<int>(from_cd.portals.size()); ++b) {
+				const uint32_t cost = local_cost(from_cd, from_costs_, from_cd.portals[b].pos);
+				if(cost != no_path) {
+					relax(node_ref(&from_cd, b), cost, top.node);
+				}
+			}
+			if(from_chunk == to_chunk && local_cost(to_cd, to_costs_, from) != no_path) {
+				relax(node_ref(nullptr, -2), local_cost(to_cd, to_costs_, from), top.node);
+			}
+			continue;
+		}
+
+		chunk_data& cd = *top.node.chunk;
+		const int a = top.node.index;
+		// Entries are pushed again when a cheaper route is found rather than updated.
+		if(cd.stamp[a] != search_stamp_ || top.g != cd.g[a]) {
+			continue;
+		}
+		cd.stamp[a] = search_stamp_ + 1;
+		++expanded_;
+		if(sampled_ - sampled_before > search_limit_) {
+			return false;
+		}
+
+		const point pos = cd.portals[a].pos;
+		if(&cd == &to_cd) {
+			const uint32_t cost = local_cost(to_cd, to_costs_, pos);
+			if(cost != no_path) {
+				relax(node_ref(nullptr, -2), top.g + cost, top.node);
+			}
+		}
+		const uint32_t* costs = get_costs(cd, a);
+		for(int b = 0; b != static_cast<int>(cd.portals.size()); ++b) {
+			if(b != a && costs[b] != no_path) {
+				relax(node_ref(&cd, b), top.g + costs[b], top.node);
+			}
+		}
+		for(auto& exit : cd.portals[a].exits) {
+			chunk_data& next = get_built(get_chunk(exit));
+			for(int b = 0; b != static_cast<int>(next.portals.size()); ++b) {
+				if(next.portals[b].pos == exit) {
+					relax(node_ref(&next, b), top.g + pathfinder::straight_cost, top.node);
+					break;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+bool hpa_pathfinder::refine(const point& from, const point& to, std::vector<point>* path)
+{
+	path->clear();
+	const point chunk = get_chunk(from);
+	if(chunk != get_chunk(to)) {
+		// Crossing a border, one straight step.
+		if(std::abs(from.x - to.x) + std::abs(from.y - to.y) != 1) {
+			return false;
+		}
+		path->emplace_back(to);
+		return true;
+	}
+	return local_.find(get_sampled(chunk).walkable, from, to, pathfinder::algorithm::jps, path);
+}
+
+bool hpa_pathfinder::find_near(const point& from, const point& to, std::vector<point>* path)
+{
+	const point from_chunk = get_chunk(from);
+	const point to_chunk = get_chunk(to);
+	const point c1(std::min(from_chunk.x, to_chunk.x), std::min(from_chunk.y, to_chunk.y));
+	const point c2(std::max(from_chunk.x, to_chunk.x), std::max(from_chunk.y, to_chunk.y));
+	const rect a1 = get_chunk_area(c1);
+	const rect a2 = get_chunk_area(c2);
+	near_walkable_.reset(rect(a1.x(), a1.y(), a2.x2() - a1.x(), a2.y2() - a1.y()));
+	for(int y = c1.y; y <= c2.y; ++y) {
+		for(int x = c1.x; x <= c2.x; ++x) {
+			near_walkable_ |= get_sampled(point(x, y)).walkable;
+		}
+	}
+	return local_.find(near_walkable_, from, to, pathfinder::algorithm::jps, path);
+}
+
+bool hpa_pathfinder::find(const point& from, const point& to, std::vector<point>* path)
+{
+	path->clear();
+	std::vector<point> waypoints;
+	bool found = find_abstract(from, to, &waypoints);
+	if(found) {
+		std::vector<point> leg;
+		point p = from;
+		for(auto& w : waypoints) {
+			if(!refine(p, w, &leg)) {
+				path->clear();
+				return false;
+			}
+			path->insert(path->end(), leg.begin(), leg.end());
+			p = w;
+		}
+	}
+
+	const point d = get_chunk(to) - get_chunk(from);
+	if(from != to && std::abs(d.x) <= 1 && std::abs(d.y) <= 1 && find_near(from, to, &near_path_)) {
+		if(!found || pathfinder::get_cost(near_path_, from) < pathfinder::get_cost(*path, from)) {
+			path->swap(near_path_);
+		}
+		found = true;
+	}
+	return found;
+}
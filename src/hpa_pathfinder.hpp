@@ -0,0 +1,165 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "geometry.hpp"
+#include "pathfinder.hpp"
+#include "tile_bitmap.hpp"
+
+// Hierarchical path finding (HPA*) over a map that is split into equal sized chunks 
+// and has no fixed bounds. Each chunk keeps the entrances on its borders, as portal 
+// tiles, and the cost of getting between each pair of its portals without leaving the
+// chunk. A long search then only looks at portals, a few per chunk, and each leg of 
+// the plan is turned into tiles on demand. Chunks are sampled through a callback as the
+// search reaches them, so they don't have to exist in the map. Paths are close to, but 
+// not always, the shortest, the costs are the same as for the pathfinder.
+class hpa_pathfinder
+{
+public:
+	// Sets the tiles of walkable, whose bounds are already area, that can be walked on.
+	typedef std::function<void(const rect& area, tile_bitmap* walkable)> sample_fn;
+
+	// Chunk (0,0) is the chunk_w by chunk_h tiles starting at origin.
+	hpa_pathfinder(int chunk_w, int chunk_h, const point& origin, sample_fn sample);
+
+	point get_chunk(const point& p) const;
+	rect get_chunk_area(const point& chunk) const;
+
+	// Forgets everything taken from the chunk, call when it's generated or edited.
+	void chunk_changed(const point& chunk);
+	void clear();
+	// Everything is forgotten before a search once more chunks than this are kept.
+	void set_max_chunks(std::size_t n) { max_chunks_ = n; }
+	// A search gives up after sampling this many chunks.
+	void set_search_limit(std::size_t n) { search_limit_ = n; }
+	// Above 1 the search heads more directly for the goal, looking at far fewer portals,
+	// for paths up to weight times longer than the plan could be. The default is 1.25.
+	void set_heuristic_weight(float weight) { heuristic_weight_ = weight; }
+
+	// Plans a route over the portals. waypoints are the tiles the route goes through 
+	// after from, ending with to, each pair either in the same chunk or a step apart.
+	bool find_abstract(const point& from, const point& to, std::vector<point>* waypoints);
+	// The tiles after from up to and including to, where they are consecutive waypoints.
+	bool refine(const point& from, const point& to, std::vector<point>* path);
+	// find_abstract() and refine() for every leg, path is as for pathfinder::find(). When
+	// the ends are in the same or neighbouring chunks, where the route over the portals can
+	// be far longer than the true path, those chunks are also searched directly and the 
+	// cheaper path is kept.
+	bool find(const point& from, const point& to, std::vector<point>* path);
+
+	std::size_t get_chunk_count() const { return chunks_.size(); }
+	// Portals taken off the open list by the last call to find_abstract().
+	std::size_t get_expanded() const { return expanded_; }
+	// Chunks sampled since construction or clear().
+	std::size_t get_sampled() const { return sampled_; }
+private:
+	struct portal
+	{
+		point pos;
+		// Tiles a step away in the neighbouring chunks, which are portals there.
+		std::vector<point> exits;
+	};
+	struct chunk_data;
+	// A portal, or the start (index -1) or goal (index -2) of the current search.
+	struct node_ref
+	{
+		node_ref() : chunk(nullptr), index(-1) {}
+		node_ref(chunk_data* c, int i) : chunk(c), index(i) {}
+		chunk_data* chunk;
+		int index;
+	};
+	struct chunk_data
+	{
+		chunk_data() : built(false) {}
+		tile_bitmap walkable;
+		// Whether the portals are up to date.
+		bool built;
+		std::vector<portal> portals;
+		// costs[a * portals.size() + b], no_path if there is no way inside the chunk. 
+		// Each row is only worked out when the search first leaves portal a.
+		std::vector<uint32_t> costs;
+		std::vector<char> costs_ready;
+		// Search state per portal, valid when stamp is the search's stamp (open) or one 
+		// more (closed).
+		std::vector<uint32_t> g;
+		std::vector<uint32_t> stamp;
+		std::vector<node_ref> parent;
+	};
+	struct open_node
+	{
+		open_node(uint32_t f_, uint32_t g_, const node_ref& n) : f(f_), g(g_), node(n) {}
+		uint32_t f;
+		uint32_t g;
+		node_ref node;
+		bool operator<(const open_node& o) const { return f > o.f || (f == o.f && g < o.g); }
+	};
+	static const uint32_t no_path = 0xffffffff;
+
+	chunk_data& get_sampled(const point& chunk);
+	chunk_data& get_built(const point& chunk);
+	void build(const point& chunk, chunk_data& cd);
+	// Adds the portals on the border between chunk and the neighbour in direction d.
+	void add_portals(const point& chunk, chunk_data& cd, const point& d);
+	const uint32_t* get_costs(chunk_data& cd, int a);
+	// Cost from p to every tile of the chunk without leaving it, indexed as the chunk's tiles.
+	void local_costs(const chunk_data& cd, const point& p, std::vector<uint32_t>* costs);
+	uint32_t local_cost(const chunk_data& cd, const std::vector<uint32_t>& costs, const point& p) const;
+	// Searches the tiles of the chunks from from_chunk to to_chunk, which are at most a step apart.
+	bool find_near(const point& from, const point& to, std::vector<point>* path);
+	uint32_t heuristic(const point& p) const;
+	void relax(const node_ref& n, uint32_t g, const node_ref& parent);
+	const point& get_position(const node_ref& n) const;
+
+	int chunk_w_;
+	int chunk_h_;
+	point origin_;
+	sample_fn sample_;
+	std::map<point, chunk_data> chunks_;
+	std::size_t max_chunks_;
+	std::size_t search_limit_;
+	float heuristic_weight_;
+	std::size_t expanded_;
+	std::size_t sampled_;
+	pathfinder local_;
+
+	// The current search.
+	uint32_t search_stamp_;
+	point from_;
+	point to_;
+	uint32_t to_g_;
+	node_ref to_parent_;
+	std::vector<open_node> open_;
+	// Scratch space kept between searches.
+	std::vector<uint32_t> from_costs_;
+	std::vector<uint32_t> to_costs_;
+	std::vector<uint32_t> row_costs_;
+	tile_bitmap near_walkable_;
+	std::vector<point> near_path_;
+	std::vector<int> buckets_[16];
+};
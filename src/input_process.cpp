@@ -24,13 +24,25 @@
 #include "SDL.h"
 
 #include "component.hpp"
+#include "engine.hpp"
 #include "input_process.hpp"
 
 namespace process
 {
 	input::input()
-		: process(ProcessPriority::input)
+		: process(ProcessPriority::input),
+		  keys_pressed_(),
+		  query_(0)
 	{
+		using namespace component;
+		declare_access(genmask(Component::PLAYER) | genmask(Component::POSITION) | genmask(Component::INPUT),
+			genmask(Component::POSITION) | genmask(Component::INPUT));
+	}
+
+	void input::start(engine& eng)
+	{
+		using namespace component;
+		query_ = eng.register_query(genmask(Component::POSITION) | genmask(Component::INPUT) | genmask(Component::PLAYER));
 	}
 
 	bool input::handle_event(const SDL_Event& evt)
@@ -44,35 +56,29 @@ namespace process
 
 	void input::update(engine& eng, float t, const entity_list& elist)
 	{
-		static component_id input_mask 
-			= component::genmask(component::Component::POSITION) 
-			| component::genmask(component::Component::INPUT)
-			| component::genmask(component::Component::PLAYER);
-		for(auto& e : elist) {
-			if((e->mask & input_mask) == input_mask) {
-				auto& inp = e->inp;
-				auto& pos = e->pos;
-				inp->action = component::input::Action::none;
-				if(!keys_pressed_.empty()) {
-					auto key = keys_pressed_.front();
-					keys_pressed_.pop();
-					if(key == SDL_SCANCODE_LEFT) {
-						pos->mov.x -= 1;
-						inp->action = component::input::Action::moved;
-					} else if(key == SDL_SCANCODE_RIGHT) {
-						pos->mov.x += 1;
-						inp->action = component::input::Action::moved;
-					} else if(key == SDL_SCANCODE_UP) {
-						pos->mov.y -= 1;
-						inp->action = component::input::Action::moved;
-					} else if(key == SDL_SCANCODE_DOWN) {
-						pos->mov.y += 1;
-						inp->action = component::input::Action::moved;
-					} else if(key == SDL_SCANCODE_PERIOD) {
-						inp->action = component::input::Action::pass;
-					} else if(key == SDL_SCANCODE_1) {
-						inp->action = component::input::Action::spell;						
-					}
+		for(auto& e : eng.get_query(query_)) {
+			auto& inp = e->inp;
+			auto& pos = e->pos;
+			inp->action = component::input::Action::none;
+			if(!keys_pressed_.empty()) {
+				auto key = keys_pressed_.front();
+				keys_pressed_.pop();
+				if(key == SDL_SCANCODE_LEFT) {
+					pos->mov.x -= 1;
+					inp->action = component::input::Action::moved;
+				} else if(key == SDL_SCANCODE_RIGHT) {
+					pos->mov.x += 1;
+					inp->action = component::input::Action::moved;
+				} else if(key == SDL_SCANCODE_UP) {
+					pos->mov.y -= 1;
+					inp->action = component::input::Action::moved;
+				} else if(key == SDL_SCANCODE_DOWN) {
+					pos->mov.y += 1;
+					inp->action = component::input::Action::moved;
+				} else if(key == SDL_SCANCODE_PERIOD) {
+					inp->action = component::input::Action::pass;
+				} else if(key == SDL_SCANCODE_1) {
+					inp->action = component::input::Action::spell;						
 				}
 			}
 		}
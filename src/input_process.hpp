@@ -32,9 +32,12 @@ namespace process
 	{
 	public:
 		input();
+		void start(engine& eng) override;
 		void update(engine& eng, float t, const entity_list& elist) override;
+		const char* get_name() const override { return "input"; }
 	private:
 		bool handle_event(const SDL_Event& evt);
 		std::queue<SDL_Scancode> keys_pressed_;
+		std::size_t query_;
 	};
 }
@@ -0,0 +1,66 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <cstring>
+
+#include "input_source.hpp"
+
+input_source::~input_source()
+{
+}
+
+bool sdl_input_source::poll(SDL_Event* evt)
+{
+	return SDL_PollEvent(evt) != 0;
+}
+
+void sdl_input_source::push(const SDL_Event& evt)
+{
+	SDL_Event e = evt;
+	SDL_PushEvent(&e);
+}
+
+bool queued_input_source::poll(SDL_Event* evt)
+{
+	if(events_.empty()) {
+		return false;
+	}
+	*evt = events_.front();
+	events_.pop_front();
+	return true;
+}
+
+void queued_input_source::push(const SDL_Event& evt)
+{
+	events_.emplace_back(evt);
+}
+
+void queued_input_source::push_key(SDL_Scancode scancode)
+{
+	SDL_Event evt;
+	std::memset(&evt, 0, sizeof(evt));
+	evt.type = SDL_KEYDOWN;
+	evt.key.state = SDL_PRESSED;
+	evt.key.keysym.scancode = scancode;
+	push(evt);
+}
@@ -0,0 +1,62 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <deque>
+#include <memory>
+
+#include "SDL.h"
+
+// Where the engine gets its events from. Normally this is just the SDL event queue,
+// but running headless (or replaying input) can supply events from elsewhere.
+class input_source
+{
+public:
+	virtual ~input_source();
+	// Returns true and fills in evt if there was an event waiting.
+	virtual bool poll(SDL_Event* evt) = 0;
+	// Queue an event, to be returned by a later call to poll().
+	virtual void push(const SDL_Event& evt) = 0;
+};
+typedef std::shared_ptr<input_source> input_source_ptr;
+
+class sdl_input_source : public input_source
+{
+public:
+	bool poll(SDL_Event* evt) override;
+	void push(const SDL_Event& evt) override;
+};
+
+// Simple FIFO of events, doesn't require SDL to be initialised.
+class queued_input_source : public input_source
+{
+public:
+	bool poll(SDL_Event* evt) override;
+	void push(const SDL_Event& evt) override;
+	// Helper to queue a key down event.
+	void push_key(SDL_Scancode scancode);
+	bool empty() const { return events_.empty(); }
+private:
+	std::deque<SDL_Event> events_;
+};
@@ -263,28 +263,50 @@ private:
 };
 
 // XXX convert this to a helper class
-KRE::ColoredFontRenderablePtr text_block_renderer(const std::vector<std::string>& strs, const std::vector<KRE::Color>& colors, float* ts_x, float* ts_y)
+namespace
 {
-	static std::vector<std::string> ff;
-	if(ff.empty()) {
-		ff.emplace_back("SourceCodePro-Regular");
-		ff.emplace_back("square");
-		ff.emplace_back("whitrabt");
-		ff.emplace_back("monospace");
+	// Size of the font used for text blocks, in pixels.
+	float text_block_font_size()
+	{
+		static DeviceMetrics dm;
+		static const int font_size = 16;
+		static const float fs = static_cast<float>(font_size * dm.getDpiY()) / 72.0f;
+		return fs;
 	}
 
-	static DeviceMetrics dm;
-	
-	static const int font_size = 16;
-	static const float fs = static_cast<float>(font_size * dm.getDpiY()) / 72.0f;
-	static auto fh = KRE::FontDriver::getFontHandle(ff, fs);
+	const KRE::FontHandlePtr& text_block_font()
+	{
+		static std::vector<std::string> ff;
+		if(ff.empty()) {
+			ff.emplace_back("SourceCodePro-Regular");
+			ff.emplace_back("square");
+			ff.emplace_back("whitrabt");
+			ff.emplace_back("monospace");
+		}
+		static auto fh = KRE::FontDriver::getFontHandle(ff, text_block_font_size());
+		return fh;
+	}
+}
+
+pointf text_block_tile_size()
+{
+	return pointf(static_cast<float>(text_block_font()->calculateCharAdvance('M') / 65536.0f), text_block_font_size());
+}
+
+KRE::ColoredFontRenderablePtr text_block_renderer(const std::vector<std::string>& strs, const std::vector<KRE::Color>& colors, float* ts_x, float* ts_y)
+{
+	const float fs = text_block_font_size();
+	auto& fh = text_block_font();
 	int y = static_cast<int>(fh->getScaleFactor() * fs);
 
-	if(ts_x != nullptr) {
-		*ts_x = static_cast<float>(fh->calculateCharAdvance('M') / 65536.0f);
-	}
-	if(ts_y != nullptr) {
-		*ts_y = fs;
+	if(ts_x != nullptr || ts_y != nullptr) {
+		const pointf ts = text_block_tile_size();
+		if(ts_x != nullptr) {
+			*ts_x = ts.x;
+		}
+		if(ts_y != nullptr) {
+			*ts_y = ts.y;
+		}
 	}
 
 	std::vector<point> final_path;
@@ -21,6 +21,8 @@
 	   distribution.
 */
 
+#include <cmath>
+
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/prim_minimum_spanning_tree.hpp>
 #include <boost/bimap.hpp>
@@ -32,18 +34,21 @@
 #include "profile_timer.hpp"
 #include "random.hpp"
 #include "terrain.hpp"
+#include "unit_test.hpp"
 #include "utf8_to_codepoint.hpp"
 #include "variant_utils.hpp"
 #include "visibility.hpp"
 
 extern KRE::ColoredFontRenderablePtr text_block_renderer(const std::vector<std::string>& strs, const std::vector<KRE::Color>& colors, float* ts_x, float* ts_y);
+// Size of a glyph of text_block_renderer()'s font, i.e. of a tile drawn with it.
+extern pointf text_block_tile_size();
 
 namespace mercy
 {
 	namespace
 	{
 		// XX move these and symbols to external file.
-		enum class DungeonTile {
+		enum class DungeonTile : uint8_t {
 			ceiling,
 			floor,
 			wall,
@@ -54,6 +59,11 @@ namespace mercy
 			perimeter,
 		};
 
+		int floor_div(int n, int d)
+		{
+			return n >= 0 ? n / d : -((-n + d - 1) / d);
+		}
+
 		typedef boost::bimap<DungeonTile, char> tile_string_bimap;
 		typedef tile_string_bimap::value_type mapped_dungeon_tile;
 
@@ -88,16 +98,34 @@ namespace mercy
 			return it->get_left();
 		}
 
+		// Maps without an opacity grid are accessed through their virtuals.
+		struct virtual_access
+		{
+			explicit virtual_access(const BaseMap* m) : map(m) {}
+			bool blocks_light(int x, int y) const { return map->blocksLight(x, y); }
+			bool in_range(int x, int y, int range) const { return map->getDistance(x, y) <= range; }
+			const BaseMap* map;
+		};
+
 		class DungeonMap : public BaseMap
 		{
 		public:
 			DungeonMap(int width, int height, const variant& features)
 				: BaseMap(width, height),
 				  tiles_(),
+				  tiles_width_(0),
+				  tiles_height_(0),
+				  visible_(),
+				  explored_(),
+				  walkable_(),
+				  opaque_(),
 				  dpi_x_(96),
 				  dpi_y_(96),
 				  start_location_(),
-				  renderable_(nullptr),
+				  chunks_w_(0),
+				  chunks_h_(0),
+				  chunks_(),
+				  dirty_chunks_(),
 				  renderable_list_()
 			{
 				if(features.has_key("dpi_x")) {
@@ -106,15 +134,26 @@ namespace mercy
 				if(features.has_key("dpi_y")) {
 					dpi_y_ = features["dpi_y"].as_int32();
 				}
+				const pointf ts = text_block_tile_size();
+				setTileSize(ts.x, ts.y);
 			}
 			DungeonMap(const variant& node, const variant& features) 
 				: BaseMap(node),
 				  tiles_(),
+				  tiles_width_(0),
+				  tiles_height_(0),
+				  visible_(),
+				  explored_(),
+				  walkable_(),
+				  opaque_(),
 				  dpi_x_(96),
 				  dpi_y_(96),
 				  start_location_(),
-				  renderable_(nullptr),
-				  renderable_list_()				  
+				  chunks_w_(0),
+				  chunks_h_(0),
+				  chunks_(),
+				  dirty_chunks_(),
+				  renderable_list_()
 			{
 				if(features.has_key("dpi_x")) {
 					dpi_x_ = features["dpi_x"].as_int32();
@@ -122,32 +161,39 @@ namespace mercy
 				if(features.has_key("dpi_y")) {
 					dpi_y_ = features["dpi_y"].as_int32();
 				}
+				const pointf ts = text_block_tile_size();
+				setTileSize(ts.x, ts.y);
 				ASSERT_LOG(node.has_key("tiles") && node["tiles"].is_list(), "No 'tiles' attribute found in dungeon map while loading.");
 				ASSERT_LOG(node.has_key("start_location") && node["start_location"].is_list(), "No 'start_location' attribute found in dungeon map while loading.");
 
 				auto tiles = node["tiles"].as_list_string();
 				
-				tiles_.resize(tiles.size());
+				// Short rows are padded with ceiling.
+				std::size_t width = 0;
+				for(auto& row : tiles) {
+					width = std::max(width, row.size());
+				}
+				resizeTiles(static_cast<int>(width), static_cast<int>(tiles.size()));
 				int n = 0;
 				for(auto& row : tiles) {
-					tiles_[n].resize(row.size(), TileInfo(DungeonTile::ceiling));
 					int m = 0;
 					for(auto& col : row) {
-						tiles_[n][m] = get_tile_for_symbol(col);
+						tile(m, n) = get_tile_for_symbol(col);
 						++m;
 					}
 					++n;
 				}
+				updateFlags();
 			}
 			variant handleWrite() override
 			{
 				variant_builder res;
 				res.add("start_location", start_location_.x);
 				res.add("start_location", start_location_.y);
-				for(auto& row : tiles_) {
+				for(int y = 0; y != tiles_height_; ++y) {
 					std::string s;
-					for(auto& col : row) {
-						s += get_symbol_for_tile(col.type);
+					for(int x = 0; x != tiles_width_; ++x) {
+						s += get_symbol_for_tile(tile(x, y));
 					}
 					res.add("tiles", s);
 				}
@@ -155,131 +201,121 @@ namespace mercy
 			}
 			void update(engine& eng) override
 			{
-				if(renderable_list_.empty()) {
-					recreate_renderable_ = false;
-					renderable_ = createRenderable();
-					renderable_list_.emplace_back(renderable_);
-				} else if(renderable_list_[0] == nullptr) {
-					renderable_ = createRenderable();
-					renderable_list_[0] = renderable_;
-				} else if(recreate_renderable_) {
-					recreate_renderable_ = false;
-					updateColors();
-				}
 			}
-			const std::vector<KRE::SceneObjectPtr>& getRenderable(const rect&) const override
+			// Only the chunks overlapping r are returned. They are built the first time they're
+			// needed and have their colours updated if their tiles changed visibility since.
+			const std::vector<KRE::SceneObjectPtr>& getRenderable(const rect& r) const override
 			{
+				renderable_list_.clear();
+				if(chunks_.empty()) {
+					return renderable_list_;
+				}
+				const int cx1 = std::max(floor_div(r.x1(), chunk_size), 0);
+				const int cy1 = std::max(floor_div(r.y1(), chunk_size), 0);
+				const int cx2 = std::min(floor_div(r.x2() - 1, chunk_size), chunks_w_ - 1);
+				const int cy2 = std::min(floor_div(r.y2() - 1, chunk_size), chunks_h_ - 1);
+				for(int cy = cy1; cy <= cy2; ++cy) {
+					for(int cx = cx1; cx <= cx2; ++cx) {
+						auto& chunk = chunks_[cy * chunks_w_ + cx];
+						if(chunk == nullptr) {
+							pointf ts;
+							chunk = createChunk(cx, cy, &ts);
+						} else if(dirty_chunks_.test(cx, cy)) {
+							updateChunkColors(cx, cy);
+						}
+						dirty_chunks_.unset(cx, cy);
+						renderable_list_.emplace_back(chunk);
+					}
+				}
 				return renderable_list_;
 			}
-			void updateColors()
+			static KRE::Color getTileColor(DungeonTile t)
 			{
-				profile::manager pman("DungeonMap::updateColors");
+				switch(t) {
+					case DungeonTile::floor:		return KRE::Color::colorSaddlebrown();
+					case DungeonTile::wall:			return KRE::Color::colorDarkslategrey();
+					case DungeonTile::door:			return KRE::Color::colorBrown();
+					case DungeonTile::pit:			return KRE::Color::colorBlack();
+					case DungeonTile::lava:			return KRE::Color::colorOrange();
+					case DungeonTile::water:		return KRE::Color::colorBlue();
+					case DungeonTile::perimeter:	return KRE::Color::colorRed();
+					case DungeonTile::ceiling:
+					default:  break;
+				}
+				return KRE::Color();
+			}
+			static std::string getTileGlyph(DungeonTile t)
+			{
+				switch(t) {
+					case DungeonTile::ceiling:		return " ";
+					case DungeonTile::floor:		return utils::codepoint_to_utf8(0xb7);
+					case DungeonTile::wall:			return "#";
+					case DungeonTile::door:			return "D";
+					case DungeonTile::pit:			return "X";
+					case DungeonTile::lava:			return "~";
+					case DungeonTile::water:		return "~";
+					case DungeonTile::perimeter:	return "+";
+					default: break;
+				}
+				return "?";
+			}
+			KRE::Color getColorAt(int x, int y) const
+			{
+				KRE::Color color = getTileColor(tile(x, y));
+				if(visible_.test(x, y)) {
+					color.setAlpha(255);
+				} else if(explored_.test(x, y)) {
+					color.setAlpha(128);
+				} else {
+					color.setAlpha(0);
+				}
+				return color;
+			}
+			rect getChunkArea(int cx, int cy) const
+			{
+				return rect::from_coordinates(cx * chunk_size, 
+					cy * chunk_size, 
+					std::min((cx + 1) * chunk_size, tiles_width_) - 1, 
+					std::min((cy + 1) * chunk_size, tiles_height_) - 1);
+			}
+			void updateChunkColors(int cx, int cy) const
+			{
+				const rect area = getChunkArea(cx, cy);
 				std::vector<KRE::Color> colors;
-				for(auto& row : tiles_) {
-					KRE::Color color;
-					for(auto& col : row) {
-						switch(col.type) {
-							case DungeonTile::floor:
-								color = KRE::Color::colorSaddlebrown();
-								break;
-							case DungeonTile::wall:
-								color = KRE::Color::colorDarkslategrey();
-								break;
-							case DungeonTile::door:
-								color = KRE::Color::colorBrown();
-								break;
-							case DungeonTile::pit:
-								color = KRE::Color::colorBlack();
-								break;
-							case DungeonTile::lava:
-								color = KRE::Color::colorOrange();
-								break;
-							case DungeonTile::water:
-								color = KRE::Color::colorBlue();
-								break;
-							case DungeonTile::perimeter:
-								color = KRE::Color::colorRed();
-								break;
-							case DungeonTile::ceiling:
-							default:  
-								break;
-						}
-						if(col.visibility & 1) {
-							color.setAlpha(255);
-						} else if(col.visibility & 2) {
-							color.setAlpha(128);
-						} else {
-							color.setAlpha(0);
-						}
-						colors.emplace_back(color);
+				colors.reserve(area.w() * area.h());
+				for(int y = area.y1(); y != area.y2(); ++y) {
+					for(int x = area.x1(); x != area.x2(); ++x) {
+						colors.emplace_back(getColorAt(x, y));
 					}
 				}
-				ASSERT_LOG(!renderable_list_.empty() && renderable_list_[0] != nullptr, "Nothing in renderable list.");
-				renderable_->updateColors(colors);
+				chunks_[cy * chunks_w_ + cx]->updateColors(colors);
 			}
-			KRE::ColoredFontRenderablePtr createRenderable()
+			KRE::ColoredFontRenderablePtr createChunk(int cx, int cy, pointf* ts) const
 			{
-				profile::manager pman("DungeonMap::createRenderable");
+				profile::manager pman("DungeonMap::createChunk");
+				const rect area = getChunkArea(cx, cy);
 				std::vector<KRE::Color> colors;
-
+				colors.reserve(area.w() * area.h());
 				std::vector<std::string> transformed_output;
-				for(auto& row : tiles_) {
+				for(int y = area.y1(); y != area.y2(); ++y) {
 					std::string txf_row;
-					KRE::Color color;
-					for(auto& col : row) {
-						switch(col.type) {
-							case DungeonTile::ceiling:
-								txf_row += ' ';
-								break;
-							case DungeonTile::floor:
-								txf_row += utils::codepoint_to_utf8(0xb7);
-								color = KRE::Color::colorSaddlebrown();
-								break;
-							case DungeonTile::wall:
-								txf_row += '#';
-								color = KRE::Color::colorDarkslategrey();
-								break;
-							case DungeonTile::door:
-								txf_row += 'D';
-								color = KRE::Color::colorBrown();
-								break;
-							case DungeonTile::pit:
-								txf_row += 'X';
-								color = KRE::Color::colorBlack();
-								break;
-							case DungeonTile::lava:
-								txf_row += '~';
-								color = KRE::Color::colorOrange();
-								break;
-							case DungeonTile::water:
-								txf_row += '~';
-								color = KRE::Color::colorBlue();
-								break;
-							case DungeonTile::perimeter:
-								txf_row += '+';
-								color = KRE::Color::colorRed();
-								break;
-							default: 
-								txf_row += '?';
-								break;
-						}
-						if(col.visibility & 1) {
-							color.setAlpha(255);
-						} else if(col.visibility & 2) {
-							color.setAlpha(128);
-						} else {
-							color.setAlpha(0);
-						}
-						colors.emplace_back(color);
+					for(int x = area.x1(); x != area.x2(); ++x) {
+						txf_row += getTileGlyph(tile(x, y));
+						colors.emplace_back(getColorAt(x, y));
 					}
 					transformed_output.emplace_back(txf_row);
 				}
-
-				float ts_x, ts_y;
-				auto r = text_block_renderer(transformed_output, colors, &ts_x, &ts_y);
-				setTileSize(ts_x, ts_y);
+				auto r = text_block_renderer(transformed_output, colors, &ts->x, &ts->y);
+				ASSERT_LOG(r != nullptr, "Unable to create the renderable for map chunk " << cx << "," << cy);
+				r->setPosition(area.x1() * ts->x, area.y1() * ts->y);
 				return r;
 			}
+			void markChunkDirty(int x, int y)
+			{
+				if(inMap(x, y)) {
+					dirty_chunks_.set(x / chunk_size, y / chunk_size);
+				}
+			}
 			void generate(engine& eng) override
 			{
 				profile::manager pman("DungeonMap::generate");
@@ -322,32 +358,28 @@ namespace mercy
 					}
 				}
 
-				tiles_.clear();
-				tiles_.resize(map_height);
-				for(auto& t : tiles_) {
-					t.resize(map_width, TileInfo(DungeonTile::ceiling));
-				}
+				resizeTiles(map_width, map_height);
 				for(int x = 0; x != map_width; ++x) { 
-					tiles_[0][x].type = DungeonTile::perimeter;
-					tiles_[map_height-1][x].type = DungeonTile::perimeter;
+					tile(x, 0) = DungeonTile::perimeter;
+					tile(x, map_height-1) = DungeonTile::perimeter;
 				}
 				for(int y = 0;y != map_height; ++y) { 
-					tiles_[y][0] = DungeonTile::perimeter;
-					tiles_[y][map_width-1] = DungeonTile::perimeter;
+					tile(0, y) = DungeonTile::perimeter;
+					tile(map_width-1, y) = DungeonTile::perimeter;
 				}
 				for(auto& room : rooms) {
 					for(int x = room.x1(); x <= room.x2()-1; ++x) {
-						tiles_[room.y1()][x].type = DungeonTile::wall;
-						tiles_[room.y2()-1][x].type = DungeonTile::wall;
+						tile(x, room.y1()) = DungeonTile::wall;
+						tile(x, room.y2()-1) = DungeonTile::wall;
 					}
 					for(int y = room.y1()+1; y <= room.y2()-1; ++y) {
-						tiles_[y][room.x1()].type = DungeonTile::wall;
-						tiles_[y][room.x2()-1].type = DungeonTile::wall;
+						tile(room.x1(), y) = DungeonTile::wall;
+						tile(room.x2()-1, y) = DungeonTile::wall;
 					}
 
 					for(int y = room.y1()+1; y < room.y2()-1; ++y) {
 						for(int x = room.x1()+1; x < room.x2()-1; ++x) {
-							tiles_[y][x].type = DungeonTile::floor;
+							tile(x, y) = DungeonTile::floor;
 						}
 					}
 				}
@@ -371,16 +403,16 @@ namespace mercy
 									const int start_y = r1.y1()+1;
 									const int end_y = std::min(r2.y2(), r1.y2())-1;
 									for(int y = start_y; y < end_y; ++y) {
-										tiles_[y][r1.x2()-1].type = DungeonTile::floor;
-										tiles_[y][r2.x1()].type = DungeonTile::floor;
+										tile(r1.x2()-1, y) = DungeonTile::floor;
+										tile(r2.x1(), y) = DungeonTile::floor;
 										is_connected = true;
 									}
 								} else if(r1.y2() >= r2.y1() && r1.y1() <= r2.y2()) {
 									const int start_y = std::max(r1.y1(), r2.y1())+1;
 									const int end_y = std::min(r1.y2(),r2.y2())-1;
 									for(int y = start_y; y < end_y; ++y) {
-										tiles_[y][r1.x2()-1].type = DungeonTile::floor;
-										tiles_[y][r2.x1()].type = DungeonTile::floor;
+										tile(r1.x2()-1, y) = DungeonTile::floor;
+										tile(r2.x1(), y) = DungeonTile::floor;
 										is_connected = true;
 									}
 								}
@@ -389,16 +421,16 @@ namespace mercy
 									const int start_x = r1.x1()+1;
 									const int end_x = std::min(r2.x2(), r1.x2())-1;
 									for(int x = start_x; x < end_x; ++x) {
-										tiles_[r1.y2()-1][x].type = DungeonTile::floor;
-										tiles_[r2.y1()][x].type = DungeonTile::floor;
+										tile(x, r1.y2()-1) = DungeonTile::floor;
+										tile(x, r2.y1()) = DungeonTile::floor;
 										is_connected = true;
 									}
 								} else if(r1.x2() >= r2.x1() && r1.x1() <= r2.x2()) {
 									const int start_x = std::max(r1.x1(), r2.x1())+1;
 									const int end_x = std::min(r1.x2(),r2.x2())-1;
 									for(int x = start_x; x < end_x; ++x) {
-										tiles_[r1.y2()-1][x].type = DungeonTile::floor;
-										tiles_[r2.y1()][x].type = DungeonTile::floor;
+										tile(x, r1.y2()-1) = DungeonTile::floor;
+										tile(x, r2.y1()) = DungeonTile::floor;
 										is_connected = true;
 									}
 								}
@@ -436,58 +468,61 @@ namespace mercy
 						const int start_y = p1.x < p2.x ? p1.y : p2.y;
 						const int end_y   = p1.x < p2.x ? p2.y : p1.y;
 						for(int x = start_x; x != end_x; ++x) {
-							if(tiles_[start_y][x].type == DungeonTile::ceiling) {
-								tiles_[start_y][x].type = DungeonTile::floor;
-							} else if(tiles_[start_y][x].type == DungeonTile::wall) {
-								tiles_[start_y][x].type = DungeonTile::floor;
+							if(tile(x, start_y) == DungeonTile::ceiling) {
+								tile(x, start_y) = DungeonTile::floor;
+							} else if(tile(x, start_y) == DungeonTile::wall) {
+								tile(x, start_y) = DungeonTile::floor;
 							}
 
-							if(tiles_[start_y-1][x].type == DungeonTile::ceiling) {
-								tiles_[start_y-1][x].type = DungeonTile::wall;
+							if(tile(x, start_y-1) == DungeonTile::ceiling) {
+								tile(x, start_y-1) = DungeonTile::wall;
 							} 
-							if(tiles_[start_y+1][x].type == DungeonTile::ceiling) {
-								tiles_[start_y+1][x].type = DungeonTile::wall;
+							if(tile(x, start_y+1) == DungeonTile::ceiling) {
+								tile(x, start_y+1) = DungeonTile::wall;
 							}
 						}
-						if(tiles_[start_y-1][end_x].type == DungeonTile::ceiling) {
-							tiles_[start_y-1][end_x].type = DungeonTile::wall;
+						if(tile(end_x, start_y-1) == DungeonTile::ceiling) {
+							tile(end_x, start_y-1) = DungeonTile::wall;
 						} 
-						if(tiles_[start_y+1][end_x].type == DungeonTile::ceiling) {
-							tiles_[start_y+1][end_x].type = DungeonTile::wall;
+						if(tile(end_x, start_y+1) == DungeonTile::ceiling) {
+							tile(end_x, start_y+1) = DungeonTile::wall;
 						}
 						if(end_x+1 < map_width) {
-							if(tiles_[start_y-1][end_x+1].type == DungeonTile::ceiling) {
-								tiles_[start_y-1][end_x+1].type = DungeonTile::wall;
+							if(tile(end_x+1, start_y-1) == DungeonTile::ceiling) {
+								tile(end_x+1, start_y-1) = DungeonTile::wall;
 							} 
-							if(tiles_[start_y+1][end_x+1].type == DungeonTile::ceiling) {
-								tiles_[start_y+1][end_x+1].type = DungeonTile::wall;
+							if(tile(end_x+1, start_y+1) == DungeonTile::ceiling) {
+								tile(end_x+1, start_y+1) = DungeonTile::wall;
 							}
 						}
 
 						const int y_incr  = start_y < end_y ? 1 : -1;
 						for(int y = start_y; y != end_y; y += y_incr) {
-							if(tiles_[y][end_x].type == DungeonTile::ceiling) {
-								tiles_[y][end_x].type = DungeonTile::floor;
-							} else if(tiles_[y][end_x].type == DungeonTile::wall) {
-								tiles_[y][end_x].type = DungeonTile::floor;
+							if(tile(end_x, y) == DungeonTile::ceiling) {
+								tile(end_x, y) = DungeonTile::floor;
+							} else if(tile(end_x, y) == DungeonTile::wall) {
+								tile(end_x, y) = DungeonTile::floor;
 							}
-							if(tiles_[y][end_x-1].type == DungeonTile::ceiling) {
-								tiles_[y][end_x-1].type = DungeonTile::wall;
+							if(tile(end_x-1, y) == DungeonTile::ceiling) {
+								tile(end_x-1, y) = DungeonTile::wall;
 							} 
-							if(tiles_[y][end_x+1].type == DungeonTile::ceiling) {
-								tiles_[y][end_x+1].type = DungeonTile::wall;
+							if(tile(end_x+1, y) == DungeonTile::ceiling) {
+								tile(end_x+1, y) = DungeonTile::wall;
 							}
 						}
-						if(tiles_[end_y][end_x-1].type == DungeonTile::ceiling) {
-							tiles_[end_y][end_x-1].type = DungeonTile::wall;
+						if(tile(end_x-1, end_y) == DungeonTile::ceiling) {
+							tile(end_x-1, end_y) = DungeonTile::wall;
 						} 
-						if(tiles_[end_y][end_x+1].type == DungeonTile::ceiling) {
-							tiles_[end_y][end_x+1].type = DungeonTile::wall;
+						if(tile(end_x+1, end_y) == DungeonTile::ceiling) {
+							tile(end_x+1, end_y) = DungeonTile::wall;
 						}
 					}
 				}
 
 				chooseStartLocation(rooms);
+				updateFlags();
+				// Any cached view belongs to the old layout.
+				clearVisible();
 
 				LOG_DEBUG("map size: " << map_width << "x" << map_height);
 				LOG_DEBUG("rooms built: " << rooms.size());
@@ -504,34 +539,83 @@ namespace mercy
 			}
 			bool blocksLight(int x, int y) const override
 			{
-				if(x < 0 || y < 0 || y >= static_cast<int>(tiles_.size())) {
-					return true;
+				return !inMap(x, y) || opaque_.test(x, y);
+			}
+			static bool isOpaque(DungeonTile t) 
+			{
+				return t != DungeonTile::floor && t != DungeonTile::pit && t != DungeonTile::lava;
+			}
+			static bool isWalkable(DungeonTile t)
+			{
+				return t == DungeonTile::floor || t == DungeonTile::pit || t == DungeonTile::lava;
+			}
+			// N.B. Must be called whenever tile types change, clears the visibility.
+			void updateFlags()
+			{
+				const rect area(0, 0, tiles_width_, tiles_height_);
+				visible_.reset(area);
+				explored_.reset(area);
+				walkable_.reset(area);
+				opaque_.reset(area);
+				for(int y = 0; y != tiles_height_; ++y) {
+					for(int x = 0; x != tiles_width_; ++x) {
+						updateFlags(x, y);
+					}
+				}
+			}
+			void updateFlags(int x, int y)
+			{
+				const DungeonTile t = tile(x, y);
+				if(isWalkable(t)) {
+					walkable_.set(x, y);
+				} else {
+					walkable_.unset(x, y);
 				}
-				if(x >= static_cast<int>(tiles_[y].size())) {
-					return true;
+				if(isOpaque(t)) {
+					opaque_.set(x, y);
+				} else {
+					opaque_.unset(x, y);
 				}
-				auto& ti = tiles_[y][x];
-				if(ti.type == DungeonTile::floor || ti.type == DungeonTile::pit || ti.type == DungeonTile::lava) {
+			}
+			bool getOpacityGrid(fov::grid_access* grid) const override
+			{
+				if(tiles_.empty()) {
 					return false;
 				}
+				*grid = fov::grid_access(opaque_.data(), opaque_.get_words_per_row(), tiles_width_, tiles_height_);
 				return true;
 			}
-			void clearVisible() override 
+			const tile_bitmap* getWalkableGrid() const override
 			{
-				recreate_renderable_ = true;
-				for(auto& row : tiles_) {
-					for(auto& col : row) {
-						col.visibility &= ~(1 << 0);
+				return &walkable_;
+			}
+			void handleClearVisible() override 
+			{
+				visible_.clear();
+				for(int cy = 0; cy != chunks_h_; ++cy) {
+					for(int cx = 0; cx != chunks_w_; ++cx) {
+						dirty_chunks_.set(cx, cy);
 					}
 				}
 			}
 			void handleSetVisible(int x, int y) override
 			{
-				if(x < 0 || y < 0 || y >= static_cast<int>(tiles_.size()) || x >= static_cast<int>(tiles_[y].size())) {
-					return;
+				visible_.set(x, y);
+				explored_.set(x, y);
+				markChunkDirty(x, y);
+			}
+			void handleSetInvisible(int x, int y) override
+			{
+				visible_.unset(x, y);
+				markChunkDirty(x, y);
+			}
+			void handleTileChanged(const point& p) override
+			{
+				if(inMap(p.x, p.y)) {
+					updateFlags(p.x, p.y);
+					// The glyph may be different, so the chunk is built again.
+					chunks_[(p.y / chunk_size) * chunks_w_ + p.x / chunk_size].reset();
 				}
-				auto& ti = tiles_[y][x];
-				ti.visibility |= (1 << 0) | (1 << 1);
 			}
 			int getDistance(int x, int y) const override
 			{
@@ -540,14 +624,7 @@ namespace mercy
 			}
 			bool isWalkable(int x, int y) const
 			{
-				if(x < 0 || y < 0 || y >= static_cast<int>(tiles_.size()) || x >= static_cast<int>(tiles_[y].size())) {
-					return false;
-				}
-				auto& ti = tiles_[y][x];
-				if(ti.type == DungeonTile::floor || ti.type == DungeonTile::pit || ti.type == DungeonTile::lava) {
-					return true;
-				}
-				return false;
+				return walkable_.test(x, y);
 			}
 			bool isFixedSize() const override 
 			{
@@ -558,23 +635,47 @@ namespace mercy
 				return start_location_;
 			}
 		private:
-			struct TileInfo {
-				// XXX: visibility should default to 0. Is 2 for testing.
-				TileInfo(DungeonTile t) : type(t), visibility(0) {}
-				DungeonTile type;
-				// XXX codify these with some constants.
-				// Visibility information.
-				//	bit 0 -- 1 if currently visible, 0 if can't be seen
-				//  bit 1 -- 1 if has been seen in the past, 0 if never been seen.
-				int visibility;
-			};
-			std::vector<std::vector<TileInfo>> tiles_;
+			bool inMap(int x, int y) const
+			{
+				return static_cast<unsigned>(x) < static_cast<unsigned>(tiles_width_) 
+					&& static_cast<unsigned>(y) < static_cast<unsigned>(tiles_height_);
+			}
+			DungeonTile& tile(int x, int y) { return tiles_[y * tiles_width_ + x]; }
+			DungeonTile tile(int x, int y) const { return tiles_[y * tiles_width_ + x]; }
+			// Fills the map with ceiling, the flags must be updated afterwards.
+			void resizeTiles(int width, int height)
+			{
+				tiles_width_ = width;
+				tiles_height_ = height;
+				tiles_.assign(width * height, DungeonTile::ceiling);
+				chunks_w_ = (width + chunk_size - 1) / chunk_size;
+				chunks_h_ = (height + chunk_size - 1) / chunk_size;
+				chunks_.clear();
+				chunks_.resize(chunks_w_ * chunks_h_);
+				dirty_chunks_.reset(rect(0, 0, chunks_w_, chunks_h_));
+			}
+			// Row major, one byte per tile.
+			std::vector<DungeonTile> tiles_;
+			int tiles_width_;
+			int tiles_height_;
+			// One bit per tile for each of these, derived from tiles_ apart from the 
+			// visibility. Explored tiles have been visible at some point.
+			tile_bitmap visible_;
+			tile_bitmap explored_;
+			tile_bitmap walkable_;
+			tile_bitmap opaque_;
 			int dpi_x_;
 			int dpi_y_;
-			bool recreate_renderable_ = false;
 			point start_location_;
-			KRE::ColoredFontRenderablePtr renderable_;
-			std::vector<KRE::SceneObjectPtr> renderable_list_;
+			// Square blocks of tiles that are rendered together.
+			enum { chunk_size = 32 };
+			int chunks_w_;
+			int chunks_h_;
+			// Built lazily, null until first needed.
+			mutable std::vector<KRE::ColoredFontRenderablePtr> chunks_;
+			// Chunks with tiles that changed visibility since their colours were updated.
+			mutable tile_bitmap dirty_chunks_;
+			mutable std::vector<KRE::SceneObjectPtr> renderable_list_;
 		};
 	}
 
@@ -582,22 +683,18 @@ namespace mercy
 		: width_(width),
 		  height_(height),
 		  tile_size_(0, 0),
-		  visibility_(nullptr),
-		  player_visible_tiles_()
+		  visibility_(*this),
+		  player_observer_(visibility_.add())
 	{
-		visibility_ = std::make_shared<ShadowCastVisibility>(std::bind(&BaseMap::blocksLight, this, std::placeholders::_1, std::placeholders::_2),
-			std::bind(&BaseMap::getDistance, this, std::placeholders::_1, std::placeholders::_2));
 	}
 
 	BaseMap::BaseMap(const variant& node)
 		: width_(node["width"].as_int32()),
 		  height_(node["height"].as_int32()),
 		  tile_size_(0, 0),
-		  visibility_(nullptr),
-		  player_visible_tiles_()
+		  visibility_(*this),
+		  player_observer_(visibility_.add())
 	{
-		visibility_ = std::make_shared<ShadowCastVisibility>(std::bind(&BaseMap::blocksLight, this, std::placeholders::_1, std::placeholders::_2),
-			std::bind(&BaseMap::getDistance, this, std::placeholders::_1, std::placeholders::_2));
 	}
 
 	BaseMap::~BaseMap()
@@ -616,23 +713,85 @@ namespace mercy
 		return nullptr;
 	}
 
+	template<typename F> 
+	void BaseMap::computeVisibility(const point& pos, int visible_radius, unsigned octants, F fn) const
+	{
+		fov::grid_access grid;
+		if(getOpacityGrid(&grid)) {
+			fov::shadow_cast(grid, pos, visible_radius, octants, fn);
+		} else {
+			fov::shadow_cast(virtual_access(this), pos, visible_radius, octants, fn);
+		}
+	}
+
+	namespace
+	{
+		rect visible_bounds(const point& pos, int visible_radius)
+		{
+			const int r = std::max(visible_radius, 0);
+			return rect(pos.x - r, pos.y - r, r * 2 + 1, r * 2 + 1);
+		}
+	}
+
+	void BaseMap::clearVisible()
+	{
+		handleClearVisible();
+		visibility_.reset(player_observer_);
+	}
+
 	void BaseMap::updatePlayerVisibility(const point& pos, int visible_radius)
 	{
-		std::set<point> visible_tiles;
-		visibility_->Compute(pos, visible_radius, [&visible_tiles, this](int x, int y) { 
-			visible_tiles.emplace(x, y);
-			handleSetVisible(x, y);
+		visibility_.move(player_observer_, pos, visible_radius, [this](visibility_cache::observer_id, int x, int y, bool visible) {
+			if(visible) {
+				handleSetVisible(x, y);
+			} else {
+				handleSetInvisible(x, y);
+			}
 		});
-		player_visible_tiles_ = visible_tiles;
 	}
 
-	std::set<point> BaseMap::getVisibleTilesAt(const point& pos, int visible_radius)
+	void BaseMap::tileChanged(const point& p)
 	{
-		std::set<point> visible_tiles;
-		visibility_->Compute(pos, visible_radius, [&visible_tiles](int x, int y) { 
-			visible_tiles.emplace(x, y);
+		handleTileChanged(p);
+		visibility_.tile_changed(p, [this](visibility_cache::observer_id id, int x, int y, bool visible) {
+			if(id != player_observer_) {
+				return;
+			}
+			if(visible) {
+				handleSetVisible(x, y);
+			} else {
+				handleSetInvisible(x, y);
+			}
+		});
+	}
+
+	void BaseMap::getVisibleTilesAt(const point& pos, int visible_radius, tile_bitmap* out) const
+	{
+		out->reset(visible_bounds(pos, visible_radius));
+		addVisibleTiles(pos, visible_radius, fov::all_octants, out);
+	}
+
+	void BaseMap::addVisibleTiles(const point& pos, int visible_radius, unsigned octants, tile_bitmap* out) const
+	{
+		computeVisibility(pos, visible_radius, octants, [out](int x, int y) { 
+			out->set(x, y);
 		});
-		return visible_tiles;
+	}
+
+	bool BaseMap::canSee(const point& pos, const point& target, int visible_radius) const
+	{
+		fov::grid_access grid;
+		if(getOpacityGrid(&grid)) {
+			return fov::can_see(grid, pos, target, visible_radius);
+		}
+		return fov::can_see(virtual_access(this), pos, target, visible_radius);
+	}
+
+	std::set<point> BaseMap::getVisibleTilesAt(const point& pos, int visible_radius)
+	{
+		tile_bitmap visible_tiles;
+		getVisibleTilesAt(pos, visible_radius, &visible_tiles);
+		return visible_tiles.to_set();
 	}
 
 	std::set<point> BaseMap::getVisibleTilesAt(int x, int y, int visible_radius)
@@ -662,3 +821,117 @@ namespace mercy
 		return nullptr;
 	}
 }
+
+namespace
+{
+	// Random walls, read through an opacity grid or through blocksLight(). Keeps the 
+	// tiles marked visible the way a real map would.
+	class test_map : public mercy::BaseMap
+	{
+	public:
+		test_map(int w, int h, bool use_grid) : BaseMap(w, h), opaque_(rect(0, 0, w, h)), visible_(rect(0, 0, w, h)), use_grid_(use_grid) {
+			for(int y = 0; y != h; ++y) {
+				for(int x = 0; x != w; ++x) {
+					if(generator::get_uniform_int<int>(0, 4) == 0) {
+						opaque_.set(x, y);
+					}
+				}
+			}
+		}
+		void toggle(const point& p) {
+			if(opaque_.test(p)) {
+				opaque_.unset(p.x, p.y);
+			} else {
+				opaque_.set(p);
+			}
+			tileChanged(p);
+		}
+		const tile_bitmap& get_marked() const { return visible_; }
+		void set_use_grid(bool use_grid) { use_grid_ = use_grid; }
+		const std::vector<KRE::SceneObjectPtr>& getRenderable(const rect& r) const override { return renderable_; }
+		void generate(engine& eng) override {}
+		bool blocksLight(int x, int y) const override { return x < 0 || y < 0 || x >= getWidth() || y >= getHeight() || opaque_.test(x, y); }
+		int getDistance(int x, int y) const override { return static_cast<int>(std::sqrt(x * x + y * y)); }
+		bool isWalkable(int x, int y) const override { return !blocksLight(x, y); }
+		bool getOpacityGrid(fov::grid_access* grid) const override {
+			*grid = fov::grid_access(opaque_.data(), opaque_.get_words_per_row(), getWidth(), getHeight());
+			return use_grid_;
+		}
+		bool isFixedSize() const override { return true; }
+		const point& getStartLocation() const override { return start_; }
+	private:
+		void handleClearVisible() override { visible_.clear(); }
+		void handleSetVisible(int x, int y) override { visible_.set(x, y); }
+		void handleSetInvisible(int x, int y) override { visible_.unset(x, y); }
+		variant handleWrite() override { return variant(); }
+		tile_bitmap opaque_;
+		tile_bitmap visible_;
+		bool use_grid_;
+		std::vector<KRE::SceneObjectPtr> renderable_;
+		point start_;
+	};
+
+	bool same_tiles(const tile_bitmap& a, const tile_bitmap& b)
+	{
+		bool same = a.count() == b.count();
+		b.for_each([&a, &same](int x, int y) { same = same && a.test(x, y); });
+		return same;
+	}
+
+	point random_tile(const mercy::BaseMap& m)
+	{
+		return point(generator::get_uniform_int<int>(0, m.getWidth() - 1), generator::get_uniform_int<int>(0, m.getHeight() - 1));
+	}
+}
+
+UNIT_TEST(map_incremental_visibility)
+{
+	for(bool use_grid : { true, false }) {
+		for(int radius : { 5, 20 }) {
+			test_map m(60, 40, use_grid);
+			point p = random_tile(m);
+			tile_bitmap expected, on_map(rect(0, 0, m.getWidth(), m.getHeight()));
+			for(int step = 0; step != 40; ++step) {
+				// Steps to the side and jumps, and walls coming and going near the player.
+				if(step % 4 == 3) {
+					const int x = std::min(std::max(p.x + generator::get_uniform_int<int>(-3, 3), 0), m.getWidth() - 1);
+					const int y = std::min(std::max(p.y + generator::get_uniform_int<int>(-3, 3), 0), m.getHeight() - 1);
+					m.toggle(point(x, y));
+				} else {
+					p = step % 4 == 0 ? random_tile(m) : point(std::min(p.x + 1, m.getWidth() - 1), p.y);
+					m.updatePlayerVisibility(p, radius);
+				}
+				m.getVisibleTilesAt(p, radius, &expected);
+				CHECK(same_tiles(m.getPlayerVisibleTiles(), expected), "Incremental visibility differs from a recast at radius " << radius << " from " << p);
+				// Tiles off the map can be visible, but aren't marked.
+				on_map.clear();
+				expected.for_each([&on_map](int x, int y) { on_map.set(x, y); });
+				CHECK(same_tiles(m.get_marked(), on_map), "Tiles marked visible differ from a recast at radius " << radius << " from " << p);
+			}
+		}
+	}
+}
+
+UNIT_TEST(map_can_see)
+{
+	test_map m(60, 40, true);
+	tile_bitmap visible, expected;
+	for(bool use_grid : { true, false }) {
+		for(int radius : { 0, 3, 12, 40 }) {
+			for(int n = 0; n != 20; ++n) {
+				const point p = random_tile(m);
+				m.set_use_grid(!use_grid);
+				m.getVisibleTilesAt(p, radius, &expected);
+				m.set_use_grid(use_grid);
+				m.getVisibleTilesAt(p, radius, &visible);
+				CHECK(same_tiles(visible, expected), "The opacity grid and blocksLight() disagree at radius " << radius << " from " << p);
+				for(int y = p.y - radius - 1; y <= p.y + radius + 1; ++y) {
+					for(int x = p.x - radius - 1; x <= p.x + radius + 1; ++x) {
+						CHECK(m.canSee(p, point(x, y), radius) == visible.test(x, y), 
+							"canSee() disagrees with the visible tiles at radius " << radius << " from " << p << " to " << point(x, y));
+					}
+				}
+			}
+		}
+	}
+}
@@ -28,7 +28,9 @@
 
 #include "SceneFwd.hpp"
 #include "engine_fwd.hpp"
+#include "tile_bitmap.hpp"
 #include "variant.hpp"
+#include "visibility_cache.hpp"
 #include "visibility_fwd.hpp"
 
 namespace mercy
@@ -50,18 +52,38 @@ namespace mercy
 
 		virtual void update(engine& eng) {}
 
-		virtual void clearVisible() = 0;
+		// Marks every tile as not currently visible.
+		void clearVisible();
 		virtual bool blocksLight(int x, int y) const = 0;
 		virtual int getDistance(int x, int y) const = 0;
 		
 		virtual bool isWalkable(int x, int y) const = 0;
 
+		// Dense opacity of the map, one bit per tile (bit x & 63 of word x >> 6, set if it
+		// blocks light) with rows grid->stride 64-bit words apart, as in a tile_bitmap. Used
+		// by the visibility calculations in place of blocksLight() and getDistance(). Maps 
+		// without one return false.
+		virtual bool getOpacityGrid(fov::grid_access* grid) const { return false; }
+		// Walkability of the whole map, one bit per tile, for maps that keep one. 
+		virtual const tile_bitmap* getWalkableGrid() const { return nullptr; }
+
 		virtual bool isFixedSize() const = 0;
 
+		// Only the tiles whose visibility changed since the last call are updated.
 		void updatePlayerVisibility(const point& pos, int visible_radius);
-		const std::set<point>& getPlayerVisibleTiles() const { return player_visible_tiles_; }
+		const tile_bitmap& getPlayerVisibleTiles() const { return visibility_.get_visible(player_observer_); }
+		// Must be called when a tile starts or stops blocking light.
+		void tileChanged(const point& p);
+		visibility_cache& getVisibilityCache() { return visibility_; }
+		// Tiles visible from pos, out covers the square of the given radius around pos.
+		void getVisibleTilesAt(const point& pos, int visible_radius, tile_bitmap* out) const;
+		// Adds the tiles visible from pos in the given octants to out, which must already 
+		// cover the square of the given radius around pos.
+		void addVisibleTiles(const point& pos, int visible_radius, unsigned octants, tile_bitmap* out) const;
 		std::set<point> getVisibleTilesAt(const point& pos, int visible_radius);
 		std::set<point> getVisibleTilesAt(int x, int y, int visible_radius);
+		// Cheaper than computing all the visible tiles when only one tile matters.
+		bool canSee(const point& pos, const point& target, int visible_radius) const;
 
 		variant write();
 
@@ -72,12 +94,16 @@ namespace mercy
 	protected:
 		void setTileSize(float x, float y) { tile_size_.x = x; tile_size_.y = y; }
 	private:
+		virtual void handleClearVisible() = 0;
 		virtual void handleSetVisible(int x, int y) = 0;
+		virtual void handleSetInvisible(int x, int y) = 0;
+		virtual void handleTileChanged(const point& p) {}
 		virtual variant handleWrite() = 0;
+		template<typename F> void computeVisibility(const point& pos, int visible_radius, unsigned octants, F fn) const;
 		int width_;
 		int height_;
 		pointf tile_size_;
-		VisibilityPtr visibility_;
-		std::set<point> player_visible_tiles_;
+		visibility_cache visibility_;
+		visibility_cache::observer_id player_observer_;
 	};
 }
@@ -0,0 +1,462 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <cstdint>
+
+#include <noise/interp.h>
+#include <noise/module/perlin.h>
+
+#include "asserts.hpp"
+#include "noise_batch.hpp"
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NOISE_BATCH_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER) || defined(__GNUC__)
+#define NOISE_BATCH_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define NOISE_BATCH_TARGET_AVX2
+#else
+#define NOISE_BATCH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+#endif
+
+namespace noise
+{
+	namespace batch
+	{
+		namespace
+		{
+			// libnoise's gradients, included here rather than linked to as libnoise doesn't
+			// export them and its copy would clash with another.
+			#include <noise/vectortable.h>
+			const double* const gradients = noise::g_randomVectors;
+
+			// libnoise's constants for hashing a lattice point to a gradient.
+			const uint32_t x_noise_gen = 1619;
+			const uint32_t y_noise_gen = 31337;
+			const uint32_t z_noise_gen = 6971;
+			const uint32_t seed_noise_gen = 1013;
+			const int shift_noise_gen = 8;
+
+			const double int32_range = 1073741824.0;
+			const double gradient_scale = 2.12;
+
+			// The y and z parts of an octave, the same for every point in a row.
+			struct octave_row
+			{
+				double yv0, yv1;
+				double zv0, zv1;
+				double ys, zs;
+				// Hash of y, z and the seed for the corners (y0,z0), (y1,z0), (y0,z1), (y1,z1).
+				uint32_t hash[4];
+				double persistence;
+			};
+
+			template<NoiseQuality Q> double s_curve(double a);
+			template<> double s_curve<QUALITY_FAST>(double a) { return a; }
+			template<> double s_curve<QUALITY_STD>(double a) { return SCurve3(a); }
+			template<> double s_curve<QUALITY_BEST>(double a) { return SCurve5(a); }
+
+			// libnoise's integer part, which isn't floor() for zero or negative integers.
+			int lattice(double n)
+			{
+				return n > 0.0 ? static_cast<int>(n) : static_cast<int>(n) - 1;
+			}
+
+			int gradient_index(uint32_t hash)
+			{
+				hash ^= hash >> shift_noise_gen;
+				return static_cast<int>(hash & 0xff) << 2;
+			}
+
+			double gradient(uint32_t hash, double xv, double yv, double zv)
+			{
+				const double* g = gradients + gradient_index(hash);
+				return ((g[0] * xv) + (g[1] * yv) + (g[2] * zv)) * gradient_scale;
+			}
+
+			template<NoiseQuality Q>
+			void make_octave_rows(double y, double z, double frequency, double lacunarity, double persistence, int octaves, int seed, octave_row* rows)
+			{
+				y *= frequency;
+				z *= frequency;
+				double cur_persistence = 1.0;
+				for(int n = 0; n != octaves; ++n) {
+					octave_row& r = rows[n];
+					const double ny = MakeInt32Range(y);
+					const double nz = MakeInt32Range(z);
+					const int y0 = lattice(ny), z0 = lattice(nz);
+					const int y1 = y0 + 1, z1 = z0 + 1;
+					r.ys = s_curve<Q>(ny - static_cast<double>(y0));
+					r.zs = s_curve<Q>(nz - static_cast<double>(z0));
+					r.yv0 = ny - static_cast<double>(y0);
+					r.yv1 = ny - static_cast<double>(y1);
+					r.zv0 = nz - static_cast<double>(z0);
+					r.zv1 = nz - static_cast<double>(z1);
+					const uint32_t s = seed_noise_gen * static_cast<uint32_t>(seed + n);
+					r.hash[0] = y_noise_gen * static_cast<uint32_t>(y0) + z_noise_gen * static_cast<uint32_t>(z0) + s;
+					r.hash[1] = y_noise_gen * static_cast<uint32_t>(y1) + z_noise_gen * static_cast<uint32_t>(z0) + s;
+					r.hash[2] = y_noise_gen * static_cast<uint32_t>(y0) + z_noise_gen * static_cast<uint32_t>(z1) + s;
+					r.hash[3] = y_noise_gen * static_cast<uint32_t>(y1) + z_noise_gen * static_cast<uint32_t>(z1) + s;
+					r.persistence = cur_persistence;
+					y *= lacunarity;
+					z *= lacunarity;
+					cur_persistence *= persistence;
+				}
+			}
+
+			template<NoiseQuality Q>
+			double point_value(double x, const octave_row* rows, int octaves, double frequency, double lacunarity)
+			{
+				double value = 0.0;
+				x *= frequency;
+				for(int n = 0; n != octaves; ++n) {
+					const octave_row& r = rows[n];
+					const double nx = MakeInt32Range(x);
+					const int x0 = lattice(nx);
+					const int x1 = x0 + 1;
+					const double xs = s_curve<Q>(nx - static_cast<double>(x0));
+					const double xv0 = nx - static_cast<double>(x0);
+					const double xv1 = nx - static_cast<double>(x1);
+					const uint32_t hx0 = x_noise_gen * static_cast<uint32_t>(x0);
+					const uint32_t hx1 = x_noise_gen * static_cast<uint32_t>(x1);
+
+					double ix0 = LinearInterp(gradient(hx0 + r.hash[0], xv0, r.yv0, r.zv0), gradient(hx1 + r.hash[0], xv1, r.yv0, r.zv0), xs);
+					double ix1 = LinearInterp(gradient(hx0 + r.hash[1], xv0, r.yv1, r.zv0), gradient(hx1 + r.hash[1], xv1, r.yv1, r.zv0), xs);
+					const double iy0 = LinearInterp(ix0, ix1, r.ys);
+					ix0 = LinearInterp(gradient(hx0 + r.hash[2], xv0, r.yv0, r.zv1), gradient(hx1 + r.hash[2], xv1, r.yv0, r.zv1), xs);
+					ix1 = LinearInterp(gradient(hx0 + r.hash[3], xv0, r.yv1, r.zv1), gradient(hx1 + r.hash[3], xv1, r.yv1, r.zv1), xs);
+					const double iy1 = LinearInterp(ix0, ix1, r.ys);
+					const double signal = LinearInterp(iy0, iy1, r.zs);
+
+					value += signal * r.persistence;
+					x *= lacunarity;
+				}
+				return value;
+			}
+
+			template<NoiseQuality Q>
+			void row_scalar(const double* xs, int w, const octave_row* rows, int octaves, double frequency, double lacunarity, double* out)
+			{
+				for(int col = 0; col != w; ++col) {
+					out[col] = point_value<Q>(xs[col], rows, octaves, frequency, lacunarity);
+				}
+			}
+
+#if defined(NOISE_BATCH_SSE2)
+			template<NoiseQuality Q> __m128d s_curve_sse2(__m128d a);
+			template<> __m128d s_curve_sse2<QUALITY_FAST>(__m128d a) { return a; }
+			template<> __m128d s_curve_sse2<QUALITY_STD>(__m128d a)
+			{
+				return _mm_mul_pd(_mm_mul_pd(a, a), _mm_sub_pd(_mm_set1_pd(3.0), _mm_mul_pd(_mm_set1_pd(2.0), a)));
+			}
+			template<> __m128d s_curve_sse2<QUALITY_BEST>(__m128d a)
+			{
+				const __m128d a3 = _mm_mul_pd(_mm_mul_pd(a, a), a);
+				const __m128d a4 = _mm_mul_pd(a3, a);
+				const __m128d a5 = _mm_mul_pd(a4, a);
+				return _mm_add_pd(_mm_sub_pd(_mm_mul_pd(_mm_set1_pd(6.0), a5), _mm_mul_pd(_mm_set1_pd(15.0), a4)), _mm_mul_pd(_mm_set1_pd(10.0), a3));
+			}
+
+			__m128d lerp_sse2(__m128d n0, __m128d n1, __m128d a)
+			{
+				return _mm_add_pd(_mm_mul_pd(_mm_sub_pd(_mm_set1_pd(1.0), a), n0), _mm_mul_pd(a, n1));
+			}
+
+			// Gradients for two points, there is no gather so the table is read a lane at a time.
+			__m128d gradient_sse2(uint32_t h0, uint32_t h1, __m128d xv, double yv, double zv)
+			{
+				const double* g0 = gradients + gradient_index(h0);
+				const double* g1 = gradients + gradient_index(h1);
+				const __m128d gx = _mm_set_pd(g1[0], g0[0]);
+				const __m128d gy = _mm_set_pd(g1[1], g0[1]);
+				const __m128d gz = _mm_set_pd(g1[2], g0[2]);
+				const __m128d sum = _mm_add_pd(_mm_add_pd(_mm_mul_pd(gx, xv), _mm_mul_pd(gy, _mm_set1_pd(yv))), _mm_mul_pd(gz, _mm_set1_pd(zv)));
+				return _mm_mul_pd(sum, _mm_set1_pd(gradient_scale));
+			}
+
+			template<NoiseQuality Q>
+			void row_sse2(const double* xs, int w, const octave_row* rows, int octaves, double frequency, double lacunarity, double* out)
+			{
+				const __m128d one = _mm_set1_pd(1.0);
+				const __m128d range = _mm_set1_pd(int32_range);
+				const __m128d sign_mask = _mm_set1_pd(-0.0);
+				int col = 0;
+				for(; col + 2 <= w; col += 2) {
+					__m128d x = _mm_mul_pd(_mm_loadu_pd(xs + col), _mm_set1_pd(frequency));
+					__m128d value = _mm_setzero_pd();
+					for(int n = 0; n != octaves; ++n) {
+						const octave_row& r = rows[n];
+						__m128d nx = x;
+						if(_mm_movemask_pd(_mm_cmpge_pd(_mm_andnot_pd(sign_mask, x), range)) != 0) {
+							double lanes[2];
+							_mm_storeu_pd(lanes, x);
+							nx = _mm_set_pd(MakeInt32Range(lanes[1]), MakeInt32Range(lanes[0]));
+						}
+						// Truncated, and one less unless positive.
+						const __m128i ix = _mm_cvttpd_epi32(nx);
+						const __m128d x0 = _mm_sub_pd(_mm_cvtepi32_pd(ix), _mm_andnot_pd(_mm_cmpgt_pd(nx, _mm_setzero_pd()), one));
+						const __m128d xv0 = _mm_sub_pd(nx, x0);
+						const __m128d xv1 = _mm_sub_pd(nx, _mm_add_pd(x0, one));
+						const __m128d s = s_curve_sse2<Q>(xv0);
+
+						const uint32_t a0 = x_noise_gen * static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_cvttpd_epi32(x0)));
+						const uint32_t b0 = x_noise_gen * static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(_mm_cvttpd_epi32(x0), 4)));
+						const uint32_t a1 = a0 + x_noise_gen;
+						const uint32_t b1 = b0 + x_noise_gen;
+
+						__m128d ix0 = lerp_sse2(gradient_sse2(a0 + r.hash[0], b0 + r.hash[0], xv0, r.yv0, r.zv0), gradient_sse2(a1 + r.hash[0], b1 + r.hash[0], xv1, r.yv0, r.zv0), s);
+						__m128d ix1 = lerp_sse2(gradient_sse2(a0 + r.hash[1], b0 + r.hash[1], xv0, r.yv1, r.zv0), gradient_sse2(a1 + r.hash[1], b1 + r.hash[1], xv1, r.yv1, r.zv0), s);
+						const __m128d iy0 = lerp_sse2(ix0, ix1, _mm_set1_pd(r.ys));
+						ix0 = lerp_sse2(gradient_sse2(a0 + r.hash[2], b0 + r.hash[2], xv0, r.yv0, r.zv1), gradient_sse2(a1 + r.hash[2], b1 + r.hash[2], xv1, r.yv0, r.zv1), s);
+						ix1 = lerp_sse2(gradient_sse2(a0 + r.hash[3], b0 + r.hash[3], xv0, r.yv1, r.zv1), gradient_sse2(a1 + r.hash[3], b1 + r.hash[3], xv1, r.yv1, r.zv1), s);
+						const __m128d iy1 = lerp_sse2(ix0, ix1, _mm_set1_pd(r.ys));
+						const __m128d signal = lerp_sse2(iy0, iy1, _mm_set1_pd(r.zs));
+
+						value = _mm_add_pd(value, _mm_mul_pd(signal, _mm_set1_pd(r.persistence)));
+						x = _mm_mul_pd(x, _mm_set1_pd(lacunarity));
+					}
+					_mm_storeu_pd(out + col, value);
+				}
+				row_scalar<Q>(xs + col, w - col, rows, octaves, frequency, lacunarity, out + col);
+			}
+#endif
+
+#if defined(NOISE_BATCH_AVX2)
+			template<NoiseQuality Q> NOISE_BATCH_TARGET_AVX2 __m256d s_curve_avx2(__m256d a);
+			template<> NOISE_BATCH_TARGET_AVX2 __m256d s_curve_avx2<QUALITY_FAST>(__m256d a) { return a; }
+			template<> NOISE_BATCH_TARGET_AVX2 __m256d s_curve_avx2<QUALITY_STD>(__m256d a)
+			{
+				return _mm256_mul_pd(_mm256_mul_pd(a, a), _mm256_sub_pd(_mm256_set1_pd(3.0), _mm256_mul_pd(_mm256_set1_pd(2.0), a)));
+			}
+			template<> NOISE_BATCH_TARGET_AVX2 __m256d s_curve_avx2<QUALITY_BEST>(__m256d a)
+			{
+				const __m256d a3 = _mm256_mul_pd(_mm256_mul_pd(a, a), a);
+				const __m256d a4 = _mm256_mul_pd(a3, a);
+				const __m256d a5 = _mm256_mul_pd(a4, a);
+				return _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(6.0), a5), _mm256_mul_pd(_mm256_set1_pd(15.0), a4)), _mm256_mul_pd(_mm256_set1_pd(10.0), a3));
+			}
+
+			NOISE_BATCH_TARGET_AVX2 __m256d lerp_avx2(__m256d n0, __m256d n1, __m256d a)
+			{
+				return _mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(1.0), a), n0), _mm256_mul_pd(a, n1));
+			}
+
+			// Gradients for four points, hash is the x part of each lattice point's hash.
+			NOISE_BATCH_TARGET_AVX2 __m256d gradient_avx2(__m128i hash, uint32_t yz_hash, __m256d xv, double yv, double zv)
+			{
+				__m128i h = _mm_add_epi32(hash, _mm_set1_epi32(static_cast<int>(yz_hash)));
+				h = _mm_xor_si128(h, _mm_srli_epi32(h, shift_noise_gen));
+				const __m128i index = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0xff)), 2);
+				// The masked form with a zeroed source avoids the unmasked gather's uninitialised destination.
+				const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+				const __m256d gx = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), gradients, index, all, 8);
+				const __m256d gy = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), gradients + 1, index, all, 8);
+				const __m256d gz = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), gradients + 2, index, all, 8);
+				const __m256d sum = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(gx, xv), _mm256_mul_pd(gy, _mm256_set1_pd(yv))), _mm256_mul_pd(gz, _mm256_set1_pd(zv)));
+				return _mm256_mul_pd(sum, _mm256_set1_pd(gradient_scale));
+			}
+
+			template<NoiseQuality Q>
+			NOISE_BATCH_TARGET_AVX2 void row_avx2(const double* xs, int w, const octave_row* rows, int octaves, double frequency, double lacunarity, double* out)
+			{
+				const __m256d one = _mm256_set1_pd(1.0);
+				const __m256d range = _mm256_set1_pd(int32_range);
+				const __m256d sign_mask = _mm256_set1_pd(-0.0);
+				const __m128i x_gen = _mm_set1_epi32(static_cast<int>(x_noise_gen));
+				int col = 0;
+				for(; col + 4 <= w; col += 4) {
+					__m256d x = _mm256_mul_pd(_mm256_loadu_pd(xs + col), _mm256_set1_pd(frequency));
+					__m256d value = _mm256_setzero_pd();
+					for(int n = 0; n != octaves; ++n) {
+						const octave_row& r = rows[n];
+						__m256d nx = x;
+						if(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_andnot_pd(sign_mask, x), range, _CMP_GE_OQ)) != 0) {
+							double lanes[4];
+							_mm256_storeu_pd(lanes, x);
+							nx = _mm256_set_pd(MakeInt32Range(lanes[3]), MakeInt32Range(lanes[2]), MakeInt32Range(lanes[1]), MakeInt32Range(lanes[0]));
+						}
+						// Truncated, and one less unless positive.
+						const __m128i trunc = _mm256_cvttpd_epi32(nx);
+						const __m256d x0 = _mm256_sub_pd(_mm256_cvtepi32_pd(trunc), _mm256_andnot_pd(_mm256_cmp_pd(nx, _mm256_setzero_pd(), _CMP_GT_OQ), one));
+						const __m256d xv0 = _mm256_sub_pd(nx, x0);
+						const __m256d xv1 = _mm256_sub_pd(nx, _mm256_add_pd(x0, one));
+						const __m256d s = s_curve_avx2<Q>(xv0);
+						const __m128i h0 = _mm_mullo_epi32(_mm256_cvttpd_epi32(x0), x_gen);
+						const __m128i h1 = _mm_add_epi32(h0, x_gen);
+
+						__m256d ix0 = lerp_avx2(gradient_avx2(h0, r.hash[0], xv0, r.yv0, r.zv0), gradient_avx2(h1, r.hash[0], xv1, r.yv0, r.zv0), s);
+						__m256d ix1 = lerp_avx2(gradient_avx2(h0, r.hash[1], xv0, r.yv1, r.zv0), gradient_avx2(h1, r.hash[1], xv1, r.yv1, r.zv0), s);
+						const __m256d iy0 = lerp_avx2(ix0, ix1, _mm256_set1_pd(r.ys));
+						ix0 = lerp_avx2(gradient_avx2(h0, r.hash[2], xv0, r.yv0, r.zv1), gradient_avx2(h1, r.hash[2], xv1, r.yv0, r.zv1), s);
+						ix1 = lerp_avx2(gradient_avx2(h0, r.hash[3], xv0, r.yv1, r.zv1), gradient_avx2(h1, r.hash[3], xv1, r.yv1, r.zv1), s);
+						const __m256d iy1 = lerp_avx2(ix0, ix1, _mm256_set1_pd(r.ys));
+						const __m256d signal = lerp_avx2(iy0, iy1, _mm256_set1_pd(r.zs));
+
+						value = _mm256_add_pd(value, _mm256_mul_pd(signal, _mm256_set1_pd(r.persistence)));
+						x = _mm256_mul_pd(x, _mm256_set1_pd(lacunarity));
+					}
+					_mm256_storeu_pd(out + col, value);
+				}
+				row_scalar<Q>(xs + col, w - col, rows, octaves, frequency, lacunarity, out + col);
+			}
+
+			bool cpu_has_avx2()
+			{
+#if defined(_MSC_VER)
+				int info[4];
+				__cpuid(info, 0);
+				if(info[0] < 7) {
+					return false;
+				}
+				__cpuid(info, 1);
+				// AVX, and the OS saving the AVX registers.
+				if((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6) {
+					return false;
+				}
+				__cpuidex(info, 7, 0);
+				return (info[1] & (1 << 5)) != 0;
+#else
+				__builtin_cpu_init();
+				return __builtin_cpu_supports("avx2") != 0;
+#endif
+			}
+#endif
+
+			instruction_set get_best_instruction_set()
+			{
+#if defined(NOISE_BATCH_AVX2)
+				if(cpu_has_avx2()) {
+					return instruction_set::avx2;
+				}
+#endif
+#if defined(NOISE_BATCH_SSE2)
+				return instruction_set::sse2;
+#else
+				return instruction_set::scalar;
+#endif
+			}
+
+			instruction_set& current_instruction_set()
+			{
+				static instruction_set res = get_best_instruction_set();
+				return res;
+			}
+
+			template<NoiseQuality Q>
+			void get_row(instruction_set is, const double* xs, int w, const octave_row* rows, int octaves, double frequency, double lacunarity, double* out)
+			{
+				switch(is) {
+#if defined(NOISE_BATCH_AVX2)
+				case instruction_set::avx2:
+					row_avx2<Q>(xs, w, rows, octaves, frequency, lacunarity, out);
+					return;
+#endif
+#if defined(NOISE_BATCH_SSE2)
+				case instruction_set::sse2:
+					row_sse2<Q>(xs, w, rows, octaves, frequency, lacunarity, out);
+					return;
+#endif
+				default:
+					row_scalar<Q>(xs, w, rows, octaves, frequency, lacunarity, out);
+					return;
+				}
+			}
+
+			template<NoiseQuality Q>
+			void get_grid(const double* xs, int w, const double* ys, int h, double z, double frequency, double lacunarity, double persistence, int octaves, int seed, double* out)
+			{
+				const instruction_set is = current_instruction_set();
+				octave_row rows[module::PERLIN_MAX_OCTAVE];
+				for(int row = 0; row != h; ++row) {
+					make_octave_rows<Q>(ys[row], z, frequency, lacunarity, persistence, octaves, seed, rows);
+					get_row<Q>(is, xs, w, rows, octaves, frequency, lacunarity, out + row * w);
+				}
+			}
+		}
+
+		instruction_set get_instruction_set()
+		{
+			return current_instruction_set();
+		}
+
+		void set_instruction_set(instruction_set is)
+		{
+			if(static_cast<int>(is) <= static_cast<int>(get_best_instruction_set())) {
+				current_instruction_set() = is;
+			}
+		}
+
+		const char* get_instruction_set_name(instruction_set is)
+		{
+			switch(is) {
+			case instruction_set::scalar: return "scalar";
+			case instruction_set::sse2: return "sse2";
+			case instruction_set::avx2: return "avx2";
+			}
+			return "unknown";
+		}
+
+		perlin::perlin()
+			: frequency_(module::DEFAULT_PERLIN_FREQUENCY),
+			  lacunarity_(module::DEFAULT_PERLIN_LACUNARITY),
+			  octaves_(module::DEFAULT_PERLIN_OCTAVE_COUNT),
+			  persistence_(module::DEFAULT_PERLIN_PERSISTENCE),
+			  quality_(module::DEFAULT_PERLIN_QUALITY),
+			  seed_(module::DEFAULT_PERLIN_SEED)
+		{
+		}
+
+		void perlin::set_octave_count(int octaves)
+		{
+			ASSERT_LOG(octaves >= 1 && octaves <= module::PERLIN_MAX_OCTAVE, "Perlin octave count out of range: " << octaves);
+			octaves_ = octaves;
+		}
+
+		double perlin::get_value(double x, double y, double z) const
+		{
+			double res;
+			get_grid(&x, 1, &y, 1, z, &res);
+			return res;
+		}
+
+		void perlin::get_grid(const double* xs, int w, const double* ys, int h, double z, double* out) const
+		{
+			switch(quality_) {
+			case QUALITY_FAST:
+				batch::get_grid<QUALITY_FAST>(xs, w, ys, h, z, frequency_, lacunarity_, persistence_, octaves_, seed_, out);
+				break;
+			case QUALITY_STD:
+				batch::get_grid<QUALITY_STD>(xs, w, ys, h, z, frequency_, lacunarity_, persistence_, octaves_, seed_, out);
+				break;
+			case QUALITY_BEST:
+				batch::get_grid<QUALITY_BEST>(xs, w, ys, h, z, frequency_, lacunarity_, persistence_, octaves_, seed_, out);
+				break;
+			}
+		}
+	}
+}
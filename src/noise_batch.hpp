@@ -0,0 +1,75 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <noise/noisegen.h>
+
+namespace noise
+{
+	namespace batch
+	{
+		enum class instruction_set {
+			scalar,
+			sse2,
+			avx2,
+		};
+		// The best the CPU supports, unless set_instruction_set() was called.
+		instruction_set get_instruction_set();
+		// For benchmarks and testing. Asking for more than the CPU has is ignored.
+		void set_instruction_set(instruction_set is);
+		const char* get_instruction_set_name(instruction_set is);
+
+		// The same noise as noise::module::Perlin, with the same settings and defaults,
+		// but evaluated over a grid of points at a time. Rows share their y and z,
+		// so the work for those is only done once a row, and a row's points are done
+		// several at a time with SSE2 or AVX2. The arithmetic is done in the same order
+		// as libnoise, the results are the same to the last bit where libnoise was
+		// built for SSE2 doubles without fused multiply-adds; any other build can
+		// differ in the last few bits, well within 1e-12.
+		class perlin
+		{
+		public:
+			perlin();
+
+			void set_frequency(double frequency) { frequency_ = frequency; }
+			void set_lacunarity(double lacunarity) { lacunarity_ = lacunarity; }
+			void set_octave_count(int octaves);
+			void set_persistence(double persistence) { persistence_ = persistence; }
+			void set_quality(NoiseQuality quality) { quality_ = quality; }
+			void set_seed(int seed) { seed_ = seed; }
+
+			double get_value(double x, double y, double z) const;
+			// out[row * w + col] is the value at (xs[col], ys[row], z). Safe to call from
+			// several threads at once.
+			void get_grid(const double* xs, int w, const double* ys, int h, double z, double* out) const;
+		private:
+			double frequency_;
+			double lacunarity_;
+			int octaves_;
+			double persistence_;
+			NoiseQuality quality_;
+			int seed_;
+		};
+	}
+}
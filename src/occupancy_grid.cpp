@@ -0,0 +1,152 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include "asserts.hpp"
+#include "occupancy_grid.hpp"
+
+occupancy_grid::occupancy_grid()
+	: bounds_(),
+	  cells_(),
+	  overflow_(),
+	  slots_()
+{
+}
+
+void occupancy_grid::set_bounds(const rect& bounds)
+{
+	std::vector<component::entity_id> present;
+	for(component::entity_id id = 0; id != slots_.size(); ++id) {
+		if(slots_[id].present) {
+			unlink(id);
+			present.emplace_back(id);
+		}
+	}
+	bounds_ = bounds;
+	cells_.assign(static_cast<size_t>(bounds_.w()) * bounds_.h(), component::invalid_entity_id);
+	overflow_.clear();
+	for(auto id : present) {
+		link(id);
+	}
+}
+
+void occupancy_grid::clear()
+{
+	cells_.assign(cells_.size(), component::invalid_entity_id);
+	overflow_.clear();
+	slots_.clear();
+}
+
+component::entity_id* occupancy_grid::head(const point& p, bool create)
+{
+	if(in_bounds(p)) {
+		return &cells_[(p.y - bounds_.y1()) * bounds_.w() + (p.x - bounds_.x1())];
+	}
+	auto it = overflow_.find(key(p));
+	if(it == overflow_.end()) {
+		if(!create) {
+			return nullptr;
+		}
+		it = overflow_.emplace(key(p), component::invalid_entity_id).first;
+	}
+	return &it->second;
+}
+
+void occupancy_grid::link(component::entity_id id)
+{
+	slot& s = slots_[id];
+	component::entity_id* h = head(s.pos, true);
+	s.prev = component::invalid_entity_id;
+	s.next = *h;
+	if(s.next != component::invalid_entity_id) {
+		slots_[s.next].prev = id;
+	}
+	*h = id;
+	s.present = true;
+}
+
+void occupancy_grid::unlink(component::entity_id id)
+{
+	slot& s = slots_[id];
+	if(s.prev != component::invalid_entity_id) {
+		slots_[s.prev].next = s.next;
+	} else {
+		component::entity_id* h = head(s.pos, false);
+		ASSERT_LOG(h != nullptr && *h == id, "occupancy_grid out of sync for entity " << id);
+		*h = s.next;
+		if(s.next == component::invalid_entity_id && !in_bounds(s.pos)) {
+			overflow_.erase(key(s.pos));
+		}
+	}
+	if(s.next != component::invalid_entity_id) {
+		slots_[s.next].prev = s.prev;
+	}
+	s.prev = s.next = component::invalid_entity_id;
+	s.present = false;
+}
+
+void occupancy_grid::add(component::entity_id id, const point& p)
+{
+	ASSERT_LOG(id != component::invalid_entity_id, "Can't add an invalid entity to the occupancy grid.");
+	if(id >= slots_.size()) {
+		slots_.resize(id + 1);
+	}
+	ASSERT_LOG(!slots_[id].present, "Entity " << id << " is already in the occupancy grid.");
+	slots_[id].pos = p;
+	link(id);
+}
+
+void occupancy_grid::move(component::entity_id id, const point& p)
+{
+	ASSERT_LOG(contains(id), "Entity " << id << " isn't in the occupancy grid.");
+	if(slots_[id].pos == p) {
+		return;
+	}
+	unlink(id);
+	slots_[id].pos = p;
+	link(id);
+}
+
+void occupancy_grid::remove(component::entity_id id)
+{
+	ASSERT_LOG(contains(id), "Entity " << id << " isn't in the occupancy grid.");
+	unlink(id);
+}
+
+component::entity_id occupancy_grid::first_at(const point& p) const
+{
+	if(in_bounds(p)) {
+		return cells_[(p.y - bounds_.y1()) * bounds_.w() + (p.x - bounds_.x1())];
+	}
+	auto it = overflow_.find(key(p));
+	return it == overflow_.end() ? component::invalid_entity_id : it->second;
+}
+
+bool occupancy_grid::is_occupied(const point& p, component::entity_id ignore) const
+{
+	for(component::entity_id id = first_at(p); id != component::invalid_entity_id; id = slots_[id].next) {
+		if(id != ignore) {
+			return true;
+		}
+	}
+	return false;
+}
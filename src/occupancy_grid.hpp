@@ -0,0 +1,90 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "component.hpp"
+#include "geometry.hpp"
+
+// Which entities are standing on each tile. Tiles within the bounds are held in a 
+// flat array, anything outside (i.e. on maps without a fixed size) goes into a hash 
+// table. Entities on the same tile are chained together, indexed by entity id, so 
+// adding, moving and removing an entity is O(1).
+class occupancy_grid
+{
+public:
+	occupancy_grid();
+	// Sets the area held densely, entities already in the grid are kept.
+	void set_bounds(const rect& bounds);
+	const rect& get_bounds() const { return bounds_; }
+
+	void add(component::entity_id id, const point& p);
+	void move(component::entity_id id, const point& p);
+	void remove(component::entity_id id);
+	void clear();
+
+	bool contains(component::entity_id id) const { 
+		return id < slots_.size() && slots_[id].present; 
+	}
+	const point& get_position(component::entity_id id) const { return slots_[id].pos; }
+
+	// First entity on the tile, or invalid_entity_id if there is none.
+	component::entity_id first_at(const point& p) const;
+	// True if any entity other than ignore is on the tile.
+	bool is_occupied(const point& p, component::entity_id ignore=component::invalid_entity_id) const;
+
+	template<typename F>
+	void for_each_at(const point& p, F fn) const {
+		for(component::entity_id id = first_at(p); id != component::invalid_entity_id; id = slots_[id].next) {
+			fn(id);
+		}
+	}
+private:
+	struct slot
+	{
+		slot() : pos(), prev(component::invalid_entity_id), next(component::invalid_entity_id), present(false) {}
+		point pos;
+		component::entity_id prev;
+		component::entity_id next;
+		bool present;
+	};
+
+	static long long key(const point& p) {
+		return static_cast<long long>((static_cast<unsigned long long>(static_cast<uint32_t>(p.y)) << 32) | static_cast<uint32_t>(p.x));
+	}
+	bool in_bounds(const point& p) const {
+		return p.x >= bounds_.x1() && p.y >= bounds_.y1() && p.x < bounds_.x2() && p.y < bounds_.y2();
+	}
+	component::entity_id* head(const point& p, bool create);
+	void link(component::entity_id id);
+	void unlink(component::entity_id id);
+
+	rect bounds_;
+	std::vector<component::entity_id> cells_;
+	std::unordered_map<long long, component::entity_id> overflow_;
+	std::vector<slot> slots_;
+};
@@ -0,0 +1,248 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <algorithm>
+
+#include "asserts.hpp"
+#include "path_service.hpp"
+
+namespace
+{
+	// The cache is emptied when it gets this big.
+	const std::size_t max_cached_paths = 4096;
+}
+
+path_service::path_service(threading::thread_pool& pool)
+	: map_(),
+	  grid_(),
+	  grid_stale_(true),
+	  version_(0),
+	  algorithm_(pathfinder::algorithm::jps),
+	  next_ticket_(0),
+	  stats_(),
+	  mutex_(),
+	  results_(),
+	  cache_(),
+	  finders_(),
+	  tasks_(pool)
+{
+	reset_stats();
+}
+
+path_service::~path_service()
+{
+	tasks_.wait();
+}
+
+void path_service::set_map(const mercy::BaseMapPtr& map)
+{
+	map_ = map;
+	grid_stale_ = true;
+}
+
+void path_service::update_grid()
+{
+	grid_stale_ = false;
+	std::lock_guard<std::mutex> lock(mutex_);
+	++version_;
+	cache_.clear();
+	if(map_ == nullptr) {
+		grid_.reset();
+		return;
+	}
+	const tile_bitmap* walkable = map_->getWalkableGrid();
+	if(walkable != nullptr) {
+		grid_ = std::make_shared<tile_bitmap>(*walkable);
+		return;
+	}
+	// Maps without a grid are read tile by tile, unbounded maps can't be searched.
+	auto grid = std::make_shared<tile_bitmap>(rect(0, 0, std::max(map_->getWidth(), 0), std::max(map_->getHeight(), 0)));
+	for(int y = 0; y < map_->getHeight(); ++y) {
+		for(int x = 0; x < map_->getWidth(); ++x) {
+			if(map_->isWalkable(x, y)) {
+				grid->set(x, y);
+			}
+		}
+	}
+	grid_ = grid;
+}
+
+path_service::ticket path_service::request(const point& from, const point& to)
+{
+	if(grid_stale_) {
+		update_grid();
+	}
+	const ticket t = next_ticket_++;
+	++stats_.requests;
+	const path_key key(from, to);
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto& res = results_[t];
+		auto it = cache_.find(key);
+		if(it != cache_.end()) {
+			++stats_.cache_hits;
+			res.done = true;
+			res.path = it->second;
+			return t;
+		}
+	}
+	if(grid_ == nullptr) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		results_[t].done = true;
+		return t;
+	}
+	++stats_.searches;
+	grid_ptr grid = grid_;
+	const unsigned version = version_;
+	const pathfinder::algorithm alg = algorithm_;
+	tasks_.run([this, t, key, grid, version, alg]() {
+		auto pf = acquire_finder();
+		std::vector<point> path;
+		pf->find(*grid, key.first, key.second, alg, &path);
+		release_finder(std::move(pf));
+		finish(t, key, version, path);
+	});
+	return t;
+}
+
+void path_service::finish(ticket t, const path_key& key, unsigned version, std::vector<point>& path)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	// version_ is only written with the lock held while searches can be running.
+	if(version == version_) {
+		if(cache_.size() >= max_cached_paths) {
+			cache_.clear();
+		}
+		cache_[key] = path;
+	}
+	auto it = results_.find(t);
+	if(it == results_.end()) {
+		return;
+	}
+	if(it->second.cancelled) {
+		results_.erase(it);
+		return;
+	}
+	it->second.path.swap(path);
+	it->second.done = true;
+}
+
+bool path_service::get(ticket t, std::vector<point>* path)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = results_.find(t);
+	ASSERT_LOG(it != results_.end() && !it->second.cancelled, "Invalid path ticket: " << t);
+	if(!it->second.done) {
+		return false;
+	}
+	path->swap(it->second.path);
+	results_.erase(it);
+	return true;
+}
+
+void path_service::cancel(ticket t)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = results_.find(t);
+	if(it == results_.end()) {
+		return;
+	}
+	if(it->second.done) {
+		results_.erase(it);
+	} else {
+		it->second.cancelled = true;
+	}
+}
+
+void path_service::wait()
+{
+	tasks_.wait();
+}
+
+void path_service::tile_changed(const point& p)
+{
+	if(grid_stale_ || grid_ == nullptr || map_ == nullptr) {
+		return;
+	}
+	const bool walkable = map_->isWalkable(p.x, p.y);
+	if(grid_->test(p) == walkable) {
+		return;
+	}
+	// Searches in flight keep the grid they started with.
+	std::shared_ptr<tile_bitmap> grid;
+	if(grid_.use_count() > 1) {
+		grid = std::make_shared<tile_bitmap>(*grid_);
+	} else {
+		grid = std::const_pointer_cast<tile_bitmap>(grid_);
+	}
+	if(walkable) {
+		grid->set(p);
+	} else {
+		grid->unset(p.x, p.y);
+	}
+	grid_ = grid;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	++version_;
+	if(walkable) {
+		// Any path might now have a shorter way round.
+		stats_.invalidated += cache_.size();
+		cache_.clear();
+		return;
+	}
+	for(auto it = cache_.begin(); it != cache_.end(); ) {
+		if(std::find(it->second.begin(), it->second.end(), p) != it->second.end()) {
+			++stats_.invalidated;
+			it = cache_.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void path_service::reset_stats()
+{
+	stats_.requests = 0;
+	stats_.cache_hits = 0;
+	stats_.searches = 0;
+	stats_.invalidated = 0;
+}
+
+std::unique_ptr<pathfinder> path_service::acquire_finder()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if(!finders_.empty()) {
+			std::unique_ptr<pathfinder> pf = std::move(finders_.back());
+			finders_.pop_back();
+			return pf;
+		}
+	}
+	return std::unique_ptr<pathfinder>(new pathfinder());
+}
+
+void path_service::release_finder(std::unique_ptr<pathfinder> pf)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	finders_.emplace_back(std::move(pf));
+}
@@ -0,0 +1,110 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "geometry.hpp"
+#include "map.hpp"
+#include "pathfinder.hpp"
+#include "thread_pool.hpp"
+#include "tile_bitmap.hpp"
+
+// Asynchronous pathfinding for the AI. Requests are searched on the thread pool against
+// a snapshot of the map's walkability, so they never hold up the tick, and the result
+// is collected with get() on a later update. Finished paths are cached until a tile
+// they depend on changes.
+class path_service
+{
+public:
+	typedef std::size_t ticket;
+
+	explicit path_service(threading::thread_pool& pool=threading::thread_pool::get());
+	// Waits for any searches that are still running.
+	~path_service();
+
+	// The walkability snapshot is taken from the map when the next request is made.
+	void set_map(const mercy::BaseMapPtr& map);
+	void set_algorithm(pathfinder::algorithm alg) { algorithm_ = alg; }
+
+	ticket request(const point& from, const point& to);
+	// Returns false if the search hasn't finished. Otherwise the result is handed over and
+	// the ticket is no longer valid, path is empty if there was no path.
+	bool get(ticket t, std::vector<point>* path);
+	// Forgets a request, the search may still run but the result is discarded.
+	void cancel(ticket t);
+	// Blocks until every request made so far has finished.
+	void wait();
+
+	// Must be called when a tile becomes walkable or stops being walkable.
+	void tile_changed(const point& p);
+
+	struct stats
+	{
+		std::size_t requests;
+		std::size_t cache_hits;
+		std::size_t searches;
+		// Cached paths dropped because of a tile change.
+		std::size_t invalidated;
+	};
+	const stats& get_stats() const { return stats_; }
+	void reset_stats();
+private:
+	typedef std::shared_ptr<const tile_bitmap> grid_ptr;
+	typedef std::pair<point, point> path_key;
+	struct result
+	{
+		result() : done(false), cancelled(false), path() {}
+		bool done;
+		bool cancelled;
+		std::vector<point> path;
+	};
+	void update_grid();
+	void finish(ticket t, const path_key& key, unsigned version, std::vector<point>& path);
+	std::unique_ptr<pathfinder> acquire_finder();
+	void release_finder(std::unique_ptr<pathfinder> pf);
+
+	mercy::BaseMapPtr map_;
+	// Shared with the searches in flight, copied before being changed if it is in use.
+	grid_ptr grid_;
+	bool grid_stale_;
+	// Bumped whenever the grid changes, results of searches on older grids aren't cached.
+	unsigned version_;
+	pathfinder::algorithm algorithm_;
+	ticket next_ticket_;
+	stats stats_;
+
+	// Guards the results, the cache and the finders, which the searches touch.
+	std::mutex mutex_;
+	std::map<ticket, result> results_;
+	std::map<path_key, std::vector<point>> cache_;
+	std::vector<std::unique_ptr<pathfinder>> finders_;
+	threading::task_group tasks_;
+
+	path_service(const path_service&) = delete;
+	void operator=(const path_service&) = delete;
+};
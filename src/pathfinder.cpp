@@ -0,0 +1,380 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+#include "pathfinder.hpp"
+#include "unit_test.hpp"
+
+namespace
+{
+	const int directions[8][2] = {
+		{ 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 },
+		{ 1, 1 }, { -1, 1 }, { 1, -1 }, { -1, -1 },
+	};
+
+	int sign(int n)
+	{
+		return n > 0 ? 1 : (n < 0 ? -1 : 0);
+	}
+
+	// Cost of moving in a straight or diagonal line.
+	uint32_t line_cost(int dx, int dy)
+	{
+		const int n = std::max(std::abs(dx), std::abs(dy));
+		return n * (dx != 0 && dy != 0 ? pathfinder::diagonal_cost : pathfinder::straight_cost);
+	}
+
+	rect intersection(const rect& a, const rect& b)
+	{
+		const int x1 = std::max(a.x1(), b.x1());
+		const int y1 = std::max(a.y1(), b.y1());
+		const int x2 = std::min(a.x2(), b.x2());
+		const int y2 = std::min(a.y2(), b.y2());
+		return rect(x1, y1, std::max(x2 - x1, 0), std::max(y2 - y1, 0));
+	}
+
+	// Least a path from a to b could cost if it leaves window, a part of bounds, at least
+	// the straight distance to the nearest side it can leave by and back.
+	uint32_t leaving_cost(const point& a, const point& b, const rect& window, const rect& bounds)
+	{
+		uint32_t res = std::numeric_limits<uint32_t>::max();
+		if(window.x1() > bounds.x1()) {
+			res = std::min<uint32_t>(res, pathfinder::straight_cost * ((a.x - window.x1() + 1) + (b.x - window.x1() + 1)));
+		}
+		if(window.x2() < bounds.x2()) {
+			res = std::min<uint32_t>(res, pathfinder::straight_cost * ((window.x2() - a.x) + (window.x2() - b.x)));
+		}
+		if(window.y1() > bounds.y1()) {
+			res = std::min<uint32_t>(res, pathfinder::straight_cost * ((a.y - window.y1() + 1) + (b.y - window.y1() + 1)));
+		}
+		if(window.y2() < bounds.y2()) {
+			res = std::min<uint32_t>(res, pathfinder::straight_cost * ((window.y2() - a.y) + (window.y2() - b.y)));
+		}
+		return res;
+	}
+}
+
+pathfinder::pathfinder()
+	: g_(),
+	  parent_(),
+	  stamp_(),
+	  open_stamp_(0),
+	  open_(),
+	  walkable_(nullptr),
+	  window_(),
+	  goal_(),
+	  expanded_(0),
+	  max_window_(1 << 22)
+{
+}
+
+bool pathfinder::find(const tile_bitmap& walkable, const point& from, const point& to, algorithm alg, std::vector<point>* path)
+{
+	path->clear();
+	expanded_ = 0;
+	if(!walkable.test(from) || !walkable.test(to)) {
+		return false;
+	}
+	if(from == to) {
+		return true;
+	}
+	const rect& bounds = walkable.get_bounds();
+	const rect ends = rect::from_coordinates(std::min(from.x, to.x), std::min(from.y, to.y), std::max(from.x, to.x), std::max(from.y, to.y));
+	// Most paths stay close to the line between the ends.
+	int margin = 16 + std::max(ends.w(), ends.h()) / 2;
+	for(;;) {
+		const rect window = intersection(rect(ends.x() - margin, ends.y() - margin, ends.w() + margin * 2, ends.h() + margin * 2), bounds);
+		if(window.w() * window.h() > max_window_) {
+			// Whatever a smaller window found, which may not be the shortest.
+			return !path->empty();
+		}
+		path->clear();
+		const bool whole_map = window.w() == bounds.w() && window.h() == bounds.h();
+		if(search(walkable, from, to, alg, window, path)) {
+			// A path that goes outside the window may still be shorter.
+			if(whole_map || get_cost(*path, from) <= leaving_cost(from, to, window, bounds)) {
+				return true;
+			}
+		} else if(whole_map) {
+			return false;
+		}
+		margin *= 4;
+	}
+}
+
+bool pathfinder::search(const tile_bitmap& walkable, const point& from, const point& to, algorithm alg, const rect& window, std::vector<point>* path)
+{
+	walkable_ = &walkable;
+	window_ = window;
+	goal_ = to;
+	const std::size_t nodes = window.w() * window.h();
+	if(stamp_.size() < nodes) {
+		g_.resize(nodes);
+		parent_.resize(nodes);
+		stamp_.resize(nodes, 0);
+	}
+	open_stamp_ += 2;
+	if(open_stamp_ < 2) {
+		std::fill(stamp_.begin(), stamp_.end(), 0);
+		open_stamp_ = 2;
+	}
+	open_.clear();
+
+	const int goal = index(to.x, to.y);
+	push(index(from.x, from.y), -1, 0);
+	while(!open_.empty()) {
+		std::pop_heap(open_.begin(), open_.end());
+		const open_node top = open_.back();
+		open_.pop_back();
+		// Nodes are pushed again when a cheaper route is found rather than updated.
+		if(stamp_[top.node] != open_stamp_ || top.g != g_[top.node]) {
+			continue;
+		}
+		stamp_[top.node] = open_stamp_ + 1;
+		++expanded_;
+		if(top.node == goal) {
+			// Jump points can be several tiles apart, so fill in the tiles between.
+			for(int n = goal; parent_[n] >= 0; n = parent_[n]) {
+				const int x = node_x(n), y = node_y(n);
+				const int px = node_x(parent_[n]), py = node_y(parent_[n]);
+				const int dx = sign(px - x), dy = sign(py - y);
+				for(int tx = x, ty = y; tx != px || ty != py; tx += dx, ty += dy) {
+					path->emplace_back(tx, ty);
+				}
+			}
+			std::reverse(path->begin(), path->end());
+			return true;
+		}
+		if(alg == algorithm::jps) {
+			expand_jps(top.node);
+		} else {
+			expand_astar(top.node);
+		}
+	}
+	return false;
+}
+
+void pathfinder::push(int node, int parent, uint32_t g)
+{
+	if(stamp_[node] == open_stamp_ + 1 || (stamp_[node] == open_stamp_ && g_[node] <= g)) {
+		return;
+	}
+	stamp_[node] = open_stamp_;
+	g_[node] = g;
+	parent_[node] = parent;
+	open_node on = { g + heuristic(node_x(node), node_y(node)), g, node };
+	open_.emplace_back(on);
+	std::push_heap(open_.begin(), open_.end());
+}
+
+uint32_t pathfinder::heuristic(int x, int y) const
+{
+	// Octile distance.
+	const int dx = std::abs(goal_.x - x);
+	const int dy = std::abs(goal_.y - y);
+	return straight_cost * std::max(dx, dy) + (diagonal_cost - straight_cost) * std::min(dx, dy);
+}
+
+void pathfinder::expand_astar(int node)
+{
+	const int x = node_x(node), y = node_y(node);
+	for(auto& d : directions) {
+		const int nx = x + d[0], ny = y + d[1];
+		if(!walkable(nx, ny)) {
+			continue;
+		}
+		if(d[0] != 0 && d[1] != 0 && (!walkable(nx, y) || !walkable(x, ny))) {
+			continue;
+		}
+		push(index(nx, ny), node, g_[node] + line_cost(d[0], d[1]));
+	}
+}
+
+void pathfinder::expand_jps(int node)
+{
+	const int x = node_x(node), y = node_y(node);
+	// Directions worth searching in, given how we got here.
+	int dirs[8][2];
+	int count = 0;
+	auto add = [&dirs, &count](int dx, int dy) { dirs[count][0] = dx; dirs[count][1] = dy; ++count; };
+	if(parent_[node] < 0) {
+		for(auto& d : directions) {
+			if(d[0] == 0 || d[1] == 0 || (walkable(x + d[0], y) && walkable(x, y + d[1]))) {
+				add(d[0], d[1]);
+			}
+		}
+	} else {
+		const int dx = sign(x - node_x(parent_[node]));
+		const int dy = sign(y - node_y(parent_[node]));
+		if(dx != 0 && dy != 0) {
+			const bool horz = walkable(x + dx, y);
+			const bool vert = walkable(x, y + dy);
+			if(vert) {
+				add(0, dy);
+			}
+			if(horz) {
+				add(dx, 0);
+			}
+			if(horz && vert) {
+				add(dx, dy);
+			}
+		} else if(dx != 0) {
+			const bool next = walkable(x + dx, y);
+			const bool down = walkable(x, y + 1);
+			const bool up = walkable(x, y - 1);
+			if(next) {
+				add(dx, 0);
+				if(down) {
+					add(dx, 1);
+				}
+				if(up) {
+					add(dx, -1);
+				}
+			}
+			if(down) {
+				add(0, 1);
+			}
+			if(up) {
+				add(0, -1);
+			}
+		} else {
+			const bool next = walkable(x, y + dy);
+			const bool right = walkable(x + 1, y);
+			const bool left = walkable(x - 1, y);
+			if(next) {
+				add(0, dy);
+				if(right) {
+					add(1, dy);
+				}
+				if(left) {
+					add(-1, dy);
+				}
+			}
+			if(right) {
+				add(1, 0);
+			}
+			if(left) {
+				add(-1, 0);
+			}
+		}
+	}
+	for(int n = 0; n != count; ++n) {
+		const int jp = jump(x, y, dirs[n][0], dirs[n][1]);
+		if(jp >= 0) {
+			push(jp, node, g_[node] + line_cost(node_x(jp) - x, node_y(jp) - y));
+		}
+	}
+}
+
+int pathfinder::jump(int x, int y, int dx, int dy) const
+{
+	if(dx == 0 || dy == 0) {
+		return jump_straight(x, y, dx, dy);
+	}
+	for(;;) {
+		x += dx;
+		y += dy;
+		if(!walkable(x, y)) {
+			return -1;
+		}
+		if(x == goal_.x && y == goal_.y) {
+			return index(x, y);
+		}
+		if(jump_straight(x, y, dx, 0) >= 0 || jump_straight(x, y, 0, dy) >= 0) {
+			return index(x, y);
+		}
+		// No cutting corners.
+		if(!walkable(x + dx, y) || !walkable(x, y + dy)) {
+			return -1;
+		}
+	}
+}
+
+int pathfinder::jump_straight(int x, int y, int dx, int dy) const
+{
+	for(;;) {
+		x += dx;
+		y += dy;
+		if(!walkable(x, y)) {
+			return -1;
+		}
+		if(x == goal_.x && y == goal_.y) {
+			return index(x, y);
+		}
+		// A jump point if there is a neighbour that can only be reached best through here.
+		if(dx != 0) {
+			if((walkable(x, y - 1) && !walkable(x - dx, y - 1)) || (walkable(x, y + 1) && !walkable(x - dx, y + 1))) {
+				return index(x, y);
+			}
+		} else {
+			if((walkable(x - 1, y) && !walkable(x - 1, y - dy)) || (walkable(x + 1, y) && !walkable(x + 1, y - dy))) {
+				return index(x, y);
+			}
+		}
+	}
+}
+
+uint32_t pathfinder::get_cost(const std::vector<point>& path, const point& from)
+{
+	uint32_t cost = 0;
+	point prev = from;
+	for(auto& p : path) {
+		cost += line_cost(p.x - prev.x, p.y - prev.y);
+		prev = p;
+	}
+	return cost;
+}
+
+UNIT_TEST(pathfinder_window_shortest)
+{
+	// A wall between the ends, crossed inside the first window only by a long way round 
+	// and outside it by a gap a few tiles away.
+	tile_bitmap walkable(rect(0, 0, 400, 400));
+	for(int y = 0; y != 400; ++y) {
+		for(int x = 0; x != 400; ++x) {
+			walkable.set(x, y);
+		}
+	}
+	for(int x = 0; x != 400; ++x) {
+		if(x != 120 && x != 125) {
+			walkable.unset(x, 105);
+		}
+	}
+	for(int x = 0; x <= 121; ++x) {
+		if(x != 79) {
+			walkable.unset(x, 109);
+		}
+	}
+	for(int y = 106; y <= 109; ++y) {
+		walkable.unset(122, y);
+	}
+	pathfinder pf;
+	std::vector<point> path;
+	for(auto alg : { pathfinder::algorithm::astar, pathfinder::algorithm::jps }) {
+		CHECK_EQ(pf.find(walkable, point(100, 100), point(100, 110), alg, &path), true);
+		CHECK_EQ(pathfinder::get_cost(path, point(100, 100)), 564u);
+	}
+}
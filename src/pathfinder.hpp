@@ -0,0 +1,104 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "geometry.hpp"
+#include "tile_bitmap.hpp"
+
+// Shortest paths over a walkability bitmap. Moves are to any of the eight neighbours, 
+// straight moves cost 10 and diagonal ones 14, and a diagonal move can't cut the corner
+// of an unwalkable tile. Searches are limited to a window around the end points that 
+// grows until it holds a path that no path leaving the window could be shorter than, or 
+// it covers the whole map. A pathfinder keeps its node storage and open list between 
+// searches, so use one per thread and reuse it.
+class pathfinder
+{
+public:
+	enum class algorithm {
+		astar,
+		// Jump point search, the same paths as A* but far fewer nodes on the open list.
+		jps,
+	};
+	enum {
+		straight_cost = 10,
+		diagonal_cost = 14,
+	};
+
+	pathfinder();
+
+	// path is the tiles after from up to and including to. Returns false, with path 
+	// empty, if there is no path or either end isn't walkable.
+	bool find(const tile_bitmap& walkable, const point& from, const point& to, algorithm alg, std::vector<point>* path);
+
+	// Nodes taken off the open list by the last call to find().
+	std::size_t get_expanded() const { return expanded_; }
+	// Largest window searched, in tiles. If a search needs a larger one find() returns
+	// the path from the largest window searched, which may not be the shortest, or 
+	// false if that had none.
+	void set_max_window(int area) { max_window_ = area; }
+
+	static uint32_t get_cost(const std::vector<point>& path, const point& from);
+private:
+	bool search(const tile_bitmap& walkable, const point& from, const point& to, algorithm alg, const rect& window, std::vector<point>* path);
+	void expand_astar(int node);
+	void expand_jps(int node);
+	// Follows the direction from a node until reaching a jump point, the goal or
+	// something in the way. Returns the jump point's index or -1.
+	int jump(int x, int y, int dx, int dy) const;
+	int jump_straight(int x, int y, int dx, int dy) const;
+	void push(int node, int parent, uint32_t g);
+
+	bool walkable(int x, int y) const {
+		return x >= window_.x1() && y >= window_.y1() && x < window_.x2() && y < window_.y2() && walkable_->test(x, y);
+	}
+	int index(int x, int y) const { return (y - window_.y1()) * window_.w() + (x - window_.x1()); }
+	int node_x(int node) const { return window_.x1() + node % window_.w(); }
+	int node_y(int node) const { return window_.y1() + node / window_.w(); }
+	uint32_t heuristic(int x, int y) const;
+
+	struct open_node
+	{
+		uint32_t f;
+		uint32_t g;
+		int node;
+		// Lowest f first, ties to the node furthest along.
+		bool operator<(const open_node& o) const { return f > o.f || (f == o.f && g < o.g); }
+	};
+	// Per node, valid when stamp_ is open_stamp_ or open_stamp_+1 (closed). Bumping the
+	// stamp empties the sets without touching the storage.
+	std::vector<uint32_t> g_;
+	std::vector<int> parent_;
+	std::vector<uint32_t> stamp_;
+	uint32_t open_stamp_;
+	std::vector<open_node> open_;
+
+	const tile_bitmap* walkable_;
+	rect window_;
+	point goal_;
+	std::size_t expanded_;
+	int max_window_;
+};
@@ -0,0 +1,319 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+
+#include "asserts.hpp"
+#include "png_writer.hpp"
+
+namespace mercy
+{
+	namespace
+	{
+		const uint8_t png_signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+		const int bytes_per_pixel = 4;
+		// Compressed data is written out in IDAT chunks of at most this.
+		const std::size_t idat_size = 64 * 1024;
+
+		enum class filter_type : uint8_t {
+			NONE,
+			SUB,
+			UP,
+			AVERAGE,
+			PAETH,
+		};
+
+		void put_u32_be(uint8_t* p, uint32_t n)
+		{
+			p[0] = static_cast<uint8_t>(n >> 24);
+			p[1] = static_cast<uint8_t>(n >> 16);
+			p[2] = static_cast<uint8_t>(n >> 8);
+			p[3] = static_cast<uint8_t>(n);
+		}
+
+		uint8_t paeth(int a, int b, int c)
+		{
+			const int p = a + b - c;
+			const int pa = std::abs(p - a);
+			const int pb = std::abs(p - b);
+			const int pc = std::abs(p - c);
+			if(pa <= pb && pa <= pc) {
+				return static_cast<uint8_t>(a);
+			}
+			return static_cast<uint8_t>(pb <= pc ? b : c);
+		}
+
+		// Filters row into out, which starts with the filter type. Returns the sum of the 
+		// filtered bytes as signed values, smaller usually compresses better.
+		unsigned filter_row(filter_type ft, const uint8_t* row, const uint8_t* prev, int size, uint8_t* out)
+		{
+			out[0] = static_cast<uint8_t>(ft);
+			unsigned sum = 0;
+			for(int n = 0; n != size; ++n) {
+				const int a = n >= bytes_per_pixel ? row[n - bytes_per_pixel] : 0;
+				const int b = prev[n];
+				const int c = n >= bytes_per_pixel ? prev[n - bytes_per_pixel] : 0;
+				uint8_t v = row[n];
+				switch(ft) {
+				case filter_type::NONE:		break;
+				case filter_type::SUB:		v = static_cast<uint8_t>(v - a); break;
+				case filter_type::UP:		v = static_cast<uint8_t>(v - b); break;
+				case filter_type::AVERAGE:	v = static_cast<uint8_t>(v - (a + b) / 2); break;
+				case filter_type::PAETH:	v = static_cast<uint8_t>(v - paeth(a, b, c)); break;
+				}
+				out[n + 1] = v;
+				sum += v < 128 ? v : 256 - v;
+			}
+			return sum;
+		}
+	}
+
+	png_writer::png_writer(const std::string& filename, int width, int height)
+		: filename_(filename),
+		  file_(filename, std::ios_base::binary),
+		  width_(width),
+		  height_(height),
+		  rows_written_(0),
+		  finished_(false),
+		  stream_(),
+		  prev_row_(width * bytes_per_pixel),
+		  filtered_(width * bytes_per_pixel + 1),
+		  out_(idat_size)
+	{
+		ASSERT_LOG(width > 0 && height > 0, "Invalid PNG size " << width << "x" << height << ": " << filename);
+		ASSERT_LOG(file_.is_open(), "Couldn't open " << filename << " for writing.");
+		file_.write(reinterpret_cast<const char*>(png_signature), sizeof(png_signature));
+
+		uint8_t ihdr[13];
+		put_u32_be(ihdr, width);
+		put_u32_be(ihdr + 4, height);
+		// 8 bits, RGBA, deflate, adaptive filtering, no interlace.
+		ihdr[8] = 8;
+		ihdr[9] = 6;
+		ihdr[10] = 0;
+		ihdr[11] = 0;
+		ihdr[12] = 0;
+		write_chunk("IHDR", ihdr, sizeof(ihdr));
+
+		const int res = deflateInit(&stream_, Z_DEFAULT_COMPRESSION);
+		ASSERT_LOG(res == Z_OK, "deflateInit failed: " << res);
+		stream_.next_out = out_.data();
+		stream_.avail_out = static_cast<uInt>(out_.size());
+	}
+
+	png_writer::~png_writer()
+	{
+		if(!finished_) {
+			if(rows_written_ == height_) {
+				finish();
+			} else {
+				deflateEnd(&stream_);
+			}
+		}
+	}
+
+	void png_writer::write_chunk(const char* type, const uint8_t* data, std::size_t size)
+	{
+		uint8_t header[8];
+		put_u32_be(header, static_cast<uint32_t>(size));
+		std::copy(type, type + 4, header + 4);
+		uLong crc = crc32(0, header + 4, 4);
+		if(size != 0) {
+			crc = crc32(crc, data, static_cast<uInt>(size));
+		}
+		uint8_t footer[4];
+		put_u32_be(footer, static_cast<uint32_t>(crc));
+		file_.write(reinterpret_cast<const char*>(header), sizeof(header));
+		if(size != 0) {
+			file_.write(reinterpret_cast<const char*>(data), size);
+		}
+		file_.write(reinterpret_cast<const char*>(footer), sizeof(footer));
+		ASSERT_LOG(file_.good(), "Failed writing " << filename_);
+	}
+
+	void png_writer::deflate_rows(int flush)
+	{
+		for(;;) {
+			const int res = deflate(&stream_, flush);
+			ASSERT_LOG(res == Z_OK || res == Z_STREAM_END || res == Z_BUF_ERROR, "deflate failed: " << res);
+			if(stream_.avail_out == 0 || res == Z_STREAM_END) {
+				const std::size_t size = out_.size() - stream_.avail_out;
+				if(size != 0) {
+					write_chunk("IDAT", out_.data(), size);
+				}
+				stream_.next_out = out_.data();
+				stream_.avail_out = static_cast<uInt>(out_.size());
+			}
+			if(res == Z_STREAM_END || (flush == Z_NO_FLUSH && stream_.avail_in == 0 && stream_.avail_out != 0)) {
+				return;
+			}
+		}
+	}
+
+	void png_writer::write_rows(const uint8_t* data, int rows, int stride)
+	{
+		ASSERT_LOG(rows_written_ + rows <= height_, "Too many rows written to " << filename_ << ": " << rows_written_ + rows << " > " << height_);
+		const int size = width_ * bytes_per_pixel;
+		std::vector<uint8_t> candidate(size + 1);
+		for(int y = 0; y != rows; ++y) {
+			const uint8_t* row = data + y * stride;
+			// The filter giving the smallest sum, as libpng does.
+			unsigned best = filter_row(filter_type::NONE, row, prev_row_.data(), size, filtered_.data());
+			for(auto ft : { filter_type::SUB, filter_type::UP, filter_type::AVERAGE, filter_type::PAETH }) {
+				const unsigned sum = filter_row(ft, row, prev_row_.data(), size, candidate.data());
+				if(sum < best) {
+					best = sum;
+					filtered_.swap(candidate);
+				}
+			}
+			stream_.next_in = filtered_.data();
+			stream_.avail_in = static_cast<uInt>(filtered_.size());
+			deflate_rows(Z_NO_FLUSH);
+			std::copy(row, row + size, prev_row_.begin());
+			++rows_written_;
+		}
+	}
+
+	void png_writer::finish()
+	{
+		ASSERT_LOG(!finished_, "PNG already finished: " << filename_);
+		ASSERT_LOG(rows_written_ == height_, "Only " << rows_written_ << " of " << height_ << " rows written to " << filename_);
+		stream_.next_in = nullptr;
+		stream_.avail_in = 0;
+		deflate_rows(Z_FINISH);
+		deflateEnd(&stream_);
+		write_chunk("IEND", nullptr, 0);
+		file_.flush();
+		finished_ = true;
+	}
+
+	tile_pyramid::level::level(int w, int h, int tile_size)
+		: zoom(0),
+		  width(w),
+		  height(h),
+		  rows_done(0),
+		  band(w * tile_size * bytes_per_pixel),
+		  band_rows(0),
+		  pending(),
+		  has_pending(false)
+	{
+	}
+
+	tile_pyramid::tile_pyramid(const std::string& path, int width, int height, int tile_size)
+		: path_(path),
+		  tile_size_(tile_size),
+		  levels_()
+	{
+		ASSERT_LOG(width > 0 && height > 0 && tile_size > 0, "Invalid tile pyramid, " << width << "x" << height << " in tiles of " << tile_size);
+		if(!path_.empty() && path_.back() != '/') {
+			path_ += '/';
+		}
+		for(;;) {
+			levels_.emplace_back(width, height, tile_size);
+			if(width <= tile_size && height <= tile_size) {
+				break;
+			}
+			width = (width + 1) / 2;
+			height = (height + 1) / 2;
+		}
+		for(std::size_t n = 0; n != levels_.size(); ++n) {
+			levels_[n].zoom = static_cast<int>(levels_.size() - n - 1);
+		}
+	}
+
+	void tile_pyramid::write_rows(const uint8_t* data, int rows, int stride)
+	{
+		ASSERT_LOG(levels_.front().rows_done + rows <= levels_.front().height, "Too many rows written to tile pyramid " << path_);
+		for(int y = 0; y != rows; ++y) {
+			add_row(0, data + y * stride);
+		}
+	}
+
+	void tile_pyramid::finish()
+	{
+		for(auto& lvl : levels_) {
+			ASSERT_LOG(lvl.rows_done == lvl.height && lvl.band_rows == 0, 
+				"Only " << lvl.rows_done << " of " << lvl.height << " rows written to zoom " << lvl.zoom << " of " << path_);
+		}
+	}
+
+	void tile_pyramid::add_row(std::size_t n, const uint8_t* row)
+	{
+		level& lvl = levels_[n];
+		const int size = lvl.width * bytes_per_pixel;
+		std::copy(row, row + size, lvl.band.begin() + lvl.band_rows * size);
+		++lvl.band_rows;
+		++lvl.rows_done;
+		if(lvl.band_rows == tile_size_ || lvl.rows_done == lvl.height) {
+			write_tiles(lvl);
+		}
+		if(n + 1 == levels_.size()) {
+			return;
+		}
+		if(lvl.has_pending) {
+			lvl.has_pending = false;
+			add_halved_row(n, lvl.pending.data(), row);
+		} else if(lvl.rows_done == lvl.height) {
+			// The last row of an odd height is halved with itself.
+			add_halved_row(n, row, row);
+		} else {
+			lvl.pending.assign(row, row + size);
+			lvl.has_pending = true;
+		}
+	}
+
+	void tile_pyramid::add_halved_row(std::size_t n, const uint8_t* top, const uint8_t* bottom)
+	{
+		const int width = levels_[n].width;
+		const int halved_width = levels_[n + 1].width;
+		std::vector<uint8_t> halved(halved_width * bytes_per_pixel);
+		for(int x = 0; x != halved_width; ++x) {
+			const int x0 = x * 2 * bytes_per_pixel;
+			const int x1 = std::min(x * 2 + 1, width - 1) * bytes_per_pixel;
+			for(int c = 0; c != bytes_per_pixel; ++c) {
+				halved[x * bytes_per_pixel + c] = static_cast<uint8_t>((top[x0 + c] + top[x1 + c] + bottom[x0 + c] + bottom[x1 + c] + 2) / 4);
+			}
+		}
+		add_row(n + 1, halved.data());
+	}
+
+	void tile_pyramid::write_tiles(level& lvl)
+	{
+		const int ty = (lvl.rows_done - 1) / tile_size_;
+		for(int tx = 0; tx * tile_size_ < lvl.width; ++tx) {
+			std::stringstream dir;
+			dir << path_ << lvl.zoom << "/" << tx << "/";
+			boost::filesystem::create_directories(dir.str());
+			std::stringstream filename;
+			filename << dir.str() << ty << ".png";
+			png_writer png(filename.str(), std::min(tile_size_, lvl.width - tx * tile_size_), lvl.band_rows);
+			png.write_rows(lvl.band.data() + tx * tile_size_ * bytes_per_pixel, lvl.band_rows, lvl.width * bytes_per_pixel);
+			png.finish();
+		}
+		lvl.band_rows = 0;
+	}
+}
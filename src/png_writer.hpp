@@ -0,0 +1,112 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+namespace mercy
+{
+	// Writes an 8-bit RGBA PNG a few rows at a time, compressing each row as it is 
+	// given, so the whole image is never held in memory.
+	class png_writer
+	{
+	public:
+		png_writer(const std::string& filename, int width, int height);
+		// Finishes the file if it hasn't been.
+		~png_writer();
+
+		// rows rows of width pixels, each stride bytes after the last.
+		void write_rows(const uint8_t* data, int rows, int stride);
+		// Must be called once all height rows have been written.
+		void finish();
+
+		int get_rows_written() const { return rows_written_; }
+	private:
+		void write_chunk(const char* type, const uint8_t* data, std::size_t size);
+		// Writes the compressed data out as IDAT chunks, flush is passed to deflate().
+		void deflate_rows(int flush);
+
+		std::string filename_;
+		std::ofstream file_;
+		int width_;
+		int height_;
+		int rows_written_;
+		bool finished_;
+		z_stream stream_;
+		// The previous row, for the filters, and the row being filtered.
+		std::vector<uint8_t> prev_row_;
+		std::vector<uint8_t> filtered_;
+		std::vector<uint8_t> out_;
+
+		png_writer(const png_writer&) = delete;
+		void operator=(const png_writer&) = delete;
+	};
+
+	// Writes an image as square PNG tiles at every zoom level from the whole image in one 
+	// tile to full size, as path/<zoom>/<x>/<y>.png. Rows are given from the top down, a 
+	// few at a time, and only a row of tiles for each zoom level is kept. Each zoom level
+	// halves the one above by averaging 2x2 pixels.
+	class tile_pyramid
+	{
+	public:
+		tile_pyramid(const std::string& path, int width, int height, int tile_size=256);
+
+		// rows rows of width pixels, each stride bytes after the last.
+		void write_rows(const uint8_t* data, int rows, int stride);
+		// Must be called once all height rows have been written.
+		void finish();
+
+		int get_zoom_levels() const { return static_cast<int>(levels_.size()); }
+	private:
+		struct level
+		{
+			level(int w, int h, int tile_size);
+			int zoom;
+			int width;
+			int height;
+			int rows_done;
+			// The rows of the current row of tiles.
+			std::vector<uint8_t> band;
+			int band_rows;
+			// A row waiting for the one below it to be halved with.
+			std::vector<uint8_t> pending;
+			bool has_pending;
+		};
+		void add_row(std::size_t n, const uint8_t* row);
+		// Halves the two rows into the next level down.
+		void add_halved_row(std::size_t n, const uint8_t* top, const uint8_t* bottom);
+		void write_tiles(level& lvl);
+
+		std::string path_;
+		int tile_size_;
+		// Full size first.
+		std::vector<level> levels_;
+	};
+}
@@ -28,7 +28,11 @@
 namespace process
 {
 	process::process(ProcessPriority priority)
-		: priority_(priority)
+		: priority_(priority),
+		  declared_access_(false),
+		  reads_(~0ULL),
+		  writes_(~0ULL),
+		  main_thread_only_(true)
 	{
 	}
 
@@ -40,4 +44,12 @@ namespace process
 	{
 		return handle_event(evt);
 	}
+
+	void process::declare_access(const access_mask& reads, const access_mask& writes, bool main_thread_only)
+	{
+		declared_access_ = true;
+		reads_ = reads;
+		writes_ = writes;
+		main_thread_only_ = main_thread_only;
+	}
 }
@@ -23,6 +23,8 @@
 
 #pragma once
 
+#include <bitset>
+
 #include "SDL.h"
 
 #include "engine_fwd.hpp"
@@ -39,22 +41,54 @@ namespace process
 		render			= 900
 	};
 
+	// Which components/resources a process reads and writes. The component bits
+	// are the same as component_id, the bits for the Resource values start at 32.
+	typedef std::bitset<64> access_mask;
+
+	// Shared state, other than components, which processes may touch.
+	enum class Resource {
+		MAP			= 32,	// tiles, visibility and renderables of the map
+		ENGINE,				// turn counter, actor schedule, camera, game area, etc
+		RANDOM,				// the random number generator
+	};
+
+	inline access_mask genmask(Resource r)
+	{
+		return access_mask(1ULL << static_cast<unsigned long long>(r));
+	}
+
 	// abstract system interface
 	class process
 	{
 	public:
 		explicit process(ProcessPriority priority);
 		virtual ~process();
-		virtual void start() {}
-		virtual void end() {}
+		// Called when the process is added to/removed from the engine.
+		virtual void start(engine& eng) {}
+		virtual void end(engine& eng) {}
 		virtual void update(engine& eng, float t, const entity_list& elist) = 0;
+		// Name used when reporting timings.
+		virtual const char* get_name() const { return "process"; }
 
 		bool process_event(const SDL_Event& evt);
 		ProcessPriority get_priority() const { return priority_; }
+
+		// A process which doesn't declare what it accesses is assumed to access everything
+		// and will be run on its own on the main thread.
+		bool has_declared_access() const { return declared_access_; }
+		const access_mask& get_reads() const { return reads_; }
+		const access_mask& get_writes() const { return writes_; }
+		bool is_main_thread_only() const { return main_thread_only_; }
+	protected:
+		void declare_access(const access_mask& reads, const access_mask& writes, bool main_thread_only=false);
 	private:
 		process();
 		virtual bool handle_event(const SDL_Event& evt) { return false; }
 		ProcessPriority priority_;
+		bool declared_access_;
+		access_mask reads_;
+		access_mask writes_;
+		bool main_thread_only_;
 	};
 
 	typedef std::shared_ptr<process> process_ptr;
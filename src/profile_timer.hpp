@@ -27,26 +27,26 @@
 #include <string>
 #include "SDL.h"
 
+#include "profiler.hpp"
+
 namespace profile 
 {
+	// Scoped timer, recorded as a zone in the profiler (see profiler.hpp). Set 
+	// profile::set_log_scopes(true) to also have each one printed as it ends.
 	struct manager
 	{
-		Uint64 frequency;
-		Uint64 t1, t2;
-		double elapsedTime;
+		zone z;
 		const char* name;
 
-		manager(const char* const str) : name(str)
+		manager(const char* const str) : z(str), name(str)
 		{
-			frequency = SDL_GetPerformanceFrequency();
-			t1 = SDL_GetPerformanceCounter();
 		}
 
 		~manager()
 		{
-			t2 = SDL_GetPerformanceCounter();
-			elapsedTime = (t2 - t1) * 1000.0 / frequency;
-			std::cerr << name << ": " << elapsedTime << " milliseconds" << std::endl;
+			if(log_scopes()) {
+				std::cerr << name << ": " << z.elapsed_ms() << " milliseconds" << std::endl;
+			}
 		}
 	};
 
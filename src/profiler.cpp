@@ -0,0 +1,471 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "asserts.hpp"
+#include "profiler.hpp"
+
+// Only used for a pointer, so the compiler specific forms (which VS2013 needs) are fine.
+#if defined(_MSC_VER)
+#define PROFILE_THREAD_LOCAL __declspec(thread)
+#else
+#define PROFILE_THREAD_LOCAL __thread
+#endif
+
+namespace profile
+{
+	namespace
+	{
+		// Per thread, must be a power of two.
+		const std::size_t ring_size = 1 << 14;
+
+		struct zone_record
+		{
+			const char* name;
+			int64_t start;
+			int64_t end;
+			int depth;
+		};
+
+		// Single producer (the owning thread), single consumer (frame_mark). The owner 
+		// publishes a record by releasing head, frame_mark hands the slots back by 
+		// releasing tail, so neither side ever touches a record the other may be using.
+		// When the ring is full new records are dropped rather than overwriting old ones.
+		struct thread_buffer
+		{
+			explicit thread_buffer(int id) : tid(id), depth(0), head(0), tail(0), dropped(0), dropped_seen(0), records(ring_size) {}
+			int tid;
+			int depth;
+			std::atomic<uint64_t> head;
+			std::atomic<uint64_t> tail;
+			std::atomic<uint64_t> dropped;
+			uint64_t dropped_seen;
+			std::vector<zone_record> records;
+		};
+
+		std::atomic<bool>& enabled_flag() 
+		{
+			static std::atomic<bool> res(true);
+			return res;
+		}
+
+		std::atomic<bool>& log_scopes_flag() 
+		{
+			static std::atomic<bool> res(false);
+			return res;
+		}
+
+		std::mutex& get_registry_mutex()
+		{
+			static std::mutex res;
+			return res;
+		}
+
+		std::vector<std::unique_ptr<thread_buffer>>& get_buffers()
+		{
+			static std::vector<std::unique_ptr<thread_buffer>> res;
+			return res;
+		}
+
+		PROFILE_THREAD_LOCAL thread_buffer* current_buffer = nullptr;
+
+		thread_buffer* get_thread_buffer()
+		{
+			if(current_buffer == nullptr) {
+				std::lock_guard<std::mutex> lock(get_registry_mutex());
+				auto& bufs = get_buffers();
+				bufs.emplace_back(new thread_buffer(static_cast<int>(bufs.size()) + 1));
+				current_buffer = bufs.back().get();
+			}
+			return current_buffer;
+		}
+
+		struct zone_accumulator
+		{
+			zone_accumulator() : name(), durations(), total(0) {}
+			std::string name;
+			std::vector<int64_t> durations;
+			int64_t total;
+		};
+
+		// Durations over all frames are kept as a log scale histogram with 8 linear 
+		// sub-buckets per power of two, so the size is fixed however long it runs and 
+		// percentiles are within 12.5%.
+		const int histogram_sub_bits = 3;
+		const int histogram_sub_count = 1 << histogram_sub_bits;
+		const int histogram_buckets = (64 - histogram_sub_bits + 1) * histogram_sub_count;
+
+		int histogram_bucket(int64_t ns)
+		{
+			uint64_t v = ns < 0 ? 0 : static_cast<uint64_t>(ns);
+			if(v < static_cast<uint64_t>(histogram_sub_count)) {
+				return static_cast<int>(v);
+			}
+			int e = 0;
+			while((v >> e) >= static_cast<uint64_t>(histogram_sub_count) * 2) {
+				++e;
+			}
+			return (e + 1) * histogram_sub_count + static_cast<int>((v >> e) & (histogram_sub_count - 1));
+		}
+
+		// Largest duration that falls in the bucket.
+		int64_t histogram_bucket_max(int ndx)
+		{
+			if(ndx < histogram_sub_count) {
+				return ndx;
+			}
+			const int e = ndx / histogram_sub_count - 1;
+			const uint64_t lo = static_cast<uint64_t>(histogram_sub_count + ndx % histogram_sub_count) << e;
+			return static_cast<int64_t>(lo + (uint64_t(1) << e) - 1);
+		}
+
+		struct zone_histogram
+		{
+			zone_histogram() : name(), calls(0), total(0), min(0), max(0), buckets(histogram_buckets) {}
+			std::string name;
+			int64_t calls;
+			int64_t total;
+			int64_t min;
+			int64_t max;
+			std::vector<uint64_t> buckets;
+		};
+
+		struct captured_zone
+		{
+			const char* name;
+			int tid;
+			int64_t start;
+			int64_t end;
+		};
+
+		// Everything below is only touched by the thread calling frame_mark().
+		struct collector
+		{
+			collector() : frame(), frame_lookup(), accumulated(), frame_stats(), scratch(), captured(), capture_start(0), capturing(false), dropped(0) {}
+			std::map<std::string, zone_accumulator> frame;
+			std::unordered_map<const char*, zone_accumulator*> frame_lookup;
+			std::map<std::string, zone_histogram> accumulated;
+			std::vector<zone_stats> frame_stats;
+			std::vector<zone_record> scratch;
+			std::vector<captured_zone> captured;
+			int64_t capture_start;
+			bool capturing;
+			std::size_t dropped;
+		};
+
+		collector& get_collector()
+		{
+			static collector res;
+			return res;
+		}
+
+		zone_stats make_stats(const zone_accumulator& acc)
+		{
+			zone_stats zs;
+			zs.name = acc.name;
+			zs.calls = static_cast<int>(acc.durations.size());
+			zs.total_ms = acc.total / 1e6;
+			zs.min_ms = zs.max_ms = zs.mean_ms = zs.p99_ms = 0;
+			if(acc.durations.empty()) {
+				return zs;
+			}
+			// N.B. works on a copy, nth_element reorders.
+			std::vector<int64_t> d(acc.durations);
+			const std::size_t p99 = (d.size() * 99) / 100;
+			std::nth_element(d.begin(), d.begin() + p99, d.end());
+			zs.p99_ms = d[p99] / 1e6;
+			zs.min_ms = *std::min_element(d.begin(), d.end()) / 1e6;
+			zs.max_ms = *std::max_element(d.begin(), d.end()) / 1e6;
+			zs.mean_ms = zs.total_ms / zs.calls;
+			return zs;
+		}
+
+		zone_stats make_stats(const zone_histogram& hist)
+		{
+			zone_stats zs;
+			zs.name = hist.name;
+			zs.calls = static_cast<int>(hist.calls);
+			zs.total_ms = hist.total / 1e6;
+			zs.min_ms = zs.max_ms = zs.mean_ms = zs.p99_ms = 0;
+			if(hist.calls == 0) {
+				return zs;
+			}
+			const uint64_t p99 = (static_cast<uint64_t>(hist.calls) * 99) / 100;
+			uint64_t seen = 0;
+			for(int n = 0; n != histogram_buckets; ++n) {
+				seen += hist.buckets[n];
+				if(seen > p99) {
+					zs.p99_ms = std::max(hist.min, std::min(hist.max, histogram_bucket_max(n))) / 1e6;
+					break;
+				}
+			}
+			zs.min_ms = hist.min / 1e6;
+			zs.max_ms = hist.max / 1e6;
+			zs.mean_ms = zs.total_ms / hist.calls;
+			return zs;
+		}
+
+		void sort_stats(std::vector<zone_stats>& stats)
+		{
+			std::sort(stats.begin(), stats.end(), [](const zone_stats& lhs, const zone_stats& rhs) {
+				return lhs.total_ms > rhs.total_ms;
+			});
+		}
+
+		void write_json_string(std::ostream& os, const char* s)
+		{
+			os << '"';
+			for(; *s; ++s) {
+				if(*s == '"' || *s == '\\') {
+					os << '\\' << *s;
+				} else if(static_cast<unsigned char>(*s) < 0x20) {
+					os << ' ';
+				} else {
+					os << *s;
+				}
+			}
+			os << '"';
+		}
+	}
+
+	void set_enabled(bool en)
+	{
+		enabled_flag() = en;
+	}
+
+	bool is_enabled()
+	{
+		return enabled_flag().load(std::memory_order_relaxed);
+	}
+
+	void set_log_scopes(bool en)
+	{
+		log_scopes_flag() = en;
+	}
+
+	bool log_scopes()
+	{
+		return log_scopes_flag().load(std::memory_order_relaxed);
+	}
+
+	int64_t now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+	}
+
+	zone::zone(const char* name)
+		: name_(name),
+		  start_(0),
+		  recording_(is_enabled())
+	{
+		if(recording_) {
+			++get_thread_buffer()->depth;
+		}
+		start_ = now_ns();
+	}
+
+	zone::~zone()
+	{
+		if(!recording_) {
+			return;
+		}
+		const int64_t end = now_ns();
+		thread_buffer* buf = get_thread_buffer();
+		const int depth = --buf->depth;
+		const uint64_t h = buf->head.load(std::memory_order_relaxed);
+		if(h - buf->tail.load(std::memory_order_acquire) >= ring_size) {
+			buf->dropped.store(buf->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return;
+		}
+		zone_record& rec = buf->records[h & (ring_size - 1)];
+		rec.name = name_;
+		rec.start = start_;
+		rec.end = end;
+		rec.depth = depth;
+		buf->head.store(h + 1, std::memory_order_release);
+	}
+
+	double zone::elapsed_ms() const
+	{
+		return (now_ns() - start_) / 1e6;
+	}
+
+	void frame_mark()
+	{
+		auto& col = get_collector();
+		for(auto& f : col.frame) {
+			f.second.durations.clear();
+			f.second.total = 0;
+		}
+
+		std::vector<thread_buffer*> bufs;
+		{
+			std::lock_guard<std::mutex> lock(get_registry_mutex());
+			for(auto& b : get_buffers()) {
+				bufs.emplace_back(b.get());
+			}
+		}
+
+		for(auto buf : bufs) {
+			const uint64_t h = buf->head.load(std::memory_order_acquire);
+			const uint64_t t = buf->tail.load(std::memory_order_relaxed);
+			col.scratch.clear();
+			for(uint64_t n = t; n != h; ++n) {
+				col.scratch.emplace_back(buf->records[n & (ring_size - 1)]);
+			}
+			buf->tail.store(h, std::memory_order_release);
+
+			const uint64_t dropped = buf->dropped.load(std::memory_order_relaxed);
+			col.dropped += static_cast<std::size_t>(dropped - buf->dropped_seen);
+			buf->dropped_seen = dropped;
+
+			for(std::size_t n = 0; n != col.scratch.size(); ++n) {
+				const zone_record& rec = col.scratch[n];
+				zone_accumulator*& acc = col.frame_lookup[rec.name];
+				if(acc == nullptr) {
+					acc = &col.frame[rec.name];
+					acc->name = rec.name;
+				}
+				acc->durations.emplace_back(rec.end - rec.start);
+				acc->total += rec.end - rec.start;
+				if(col.capturing) {
+					captured_zone cz = { rec.name, buf->tid, rec.start, rec.end };
+					col.captured.emplace_back(cz);
+				}
+			}
+		}
+
+		col.frame_stats.clear();
+		for(auto& f : col.frame) {
+			if(f.second.durations.empty()) {
+				continue;
+			}
+			col.frame_stats.emplace_back(make_stats(f.second));
+			auto& hist = col.accumulated[f.first];
+			if(hist.calls == 0) {
+				hist.name = f.first;
+				hist.min = hist.max = f.second.durations.front();
+			}
+			for(auto d : f.second.durations) {
+				++hist.buckets[histogram_bucket(d)];
+				hist.min = std::min(hist.min, d);
+				hist.max = std::max(hist.max, d);
+			}
+			hist.calls += f.second.durations.size();
+			hist.total += f.second.total;
+		}
+		sort_stats(col.frame_stats);
+	}
+
+	const std::vector<zone_stats>& get_frame_stats()
+	{
+		return get_collector().frame_stats;
+	}
+
+	std::vector<zone_stats> get_accumulated_stats()
+	{
+		std::vector<zone_stats> res;
+		for(auto& acc : get_collector().accumulated) {
+			res.emplace_back(make_stats(acc.second));
+		}
+		sort_stats(res);
+		return res;
+	}
+
+	void reset_accumulated_stats()
+	{
+		get_collector().accumulated.clear();
+	}
+
+	std::size_t get_dropped_count()
+	{
+		return get_collector().dropped;
+	}
+
+	void begin_capture()
+	{
+		auto& col = get_collector();
+		col.captured.clear();
+		col.capture_start = now_ns();
+		col.capturing = true;
+	}
+
+	void end_capture()
+	{
+		// pick up anything recorded since the last frame.
+		frame_mark();
+		get_collector().capturing = false;
+	}
+
+	bool is_capturing()
+	{
+		return get_collector().capturing;
+	}
+
+	void write_chrome_trace(std::ostream& os)
+	{
+		auto& col = get_collector();
+		os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		bool first = true;
+		std::vector<int> tids;
+		for(auto& cz : col.captured) {
+			if(std::find(tids.begin(), tids.end(), cz.tid) == tids.end()) {
+				tids.emplace_back(cz.tid);
+			}
+		}
+		for(int tid : tids) {
+			os << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid 
+				<< ",\"args\":{\"name\":\"thread " << tid << "\"}}";
+			first = false;
+		}
+		for(auto& cz : col.captured) {
+			os << (first ? "" : ",") << "\n{\"name\":";
+			write_json_string(os, cz.name);
+			os << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << cz.tid
+				<< ",\"ts\":" << (cz.start - col.capture_start) / 1000.0
+				<< ",\"dur\":" << (cz.end - cz.start) / 1000.0 << "}";
+			first = false;
+		}
+		os << "\n]}\n";
+	}
+
+	bool write_chrome_trace(const std::string& filename)
+	{
+		std::ofstream os(filename.c_str());
+		if(!os) {
+			LOG_ERROR("Unable to open " << filename << " to write trace.");
+			return false;
+		}
+		write_chrome_trace(os);
+		return true;
+	}
+}
@@ -0,0 +1,106 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Hierarchical zone profiler.
+//
+// Zones are scoped timers, each thread records completed zones into its own ring buffer
+// so recording is just two clock reads and a store. Once per frame (engine update) 
+// frame_mark() collects everything recorded by all threads, aggregates it per zone 
+// name and, if a capture is running, keeps the raw zones for export as Chrome trace 
+// event JSON (chrome://tracing or https://ui.perfetto.dev).
+//
+//   void foo() {
+//       PROFILE_ZONE("foo");
+//       ...
+//   }
+//
+// Zone names must be string literals, or otherwise outlive the profiler.
+namespace profile 
+{
+	// Turns recording on or off globally, zones are very cheap when it's off.
+	void set_enabled(bool en);
+	bool is_enabled();
+
+	// If set, each profile::manager scope is also printed to std::cerr when it ends.
+	void set_log_scopes(bool en);
+	bool log_scopes();
+
+	// Nanoseconds from an arbitrary epoch.
+	int64_t now_ns();
+
+	class zone
+	{
+	public:
+		explicit zone(const char* name);
+		~zone();
+		// Time since the zone started, in milliseconds.
+		double elapsed_ms() const;
+	private:
+		const char* name_;
+		int64_t start_;
+		bool recording_;
+		zone(const zone&) = delete;
+		void operator=(const zone&) = delete;
+	};
+
+	struct zone_stats
+	{
+		std::string name;
+		int calls;
+		double total_ms;
+		double min_ms;
+		double mean_ms;
+		double p99_ms;
+		double max_ms;
+	};
+
+	// Collects the zones recorded since the last call and aggregates them. Call once per
+	// frame from a single thread.
+	void frame_mark();
+	// Stats for the previous frame, in order of total time descending.
+	const std::vector<zone_stats>& get_frame_stats();
+	// Stats accumulated over all frames since the last reset. Memory use is fixed per 
+	// zone name, so p99 comes from a histogram and is approximate.
+	std::vector<zone_stats> get_accumulated_stats();
+	void reset_accumulated_stats();
+	// Number of zones lost because a thread's ring buffer filled between frames.
+	std::size_t get_dropped_count();
+
+	// While capturing every zone is kept, to be written with write_chrome_trace().
+	void begin_capture();
+	void end_capture();
+	bool is_capturing();
+	void write_chrome_trace(std::ostream& os);
+	bool write_chrome_trace(const std::string& filename);
+}
+
+#define PROFILE_ZONE_CONCAT2(a, b) a##b
+#define PROFILE_ZONE_CONCAT(a, b) PROFILE_ZONE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) profile::zone PROFILE_ZONE_CONCAT(profile_zone_, __LINE__)(name)
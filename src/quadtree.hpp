@@ -23,107 +23,371 @@
 
 #pragma once
 
-#include <set>
+#include <algorithm>
 #include <vector>
+
+#include "asserts.hpp"
 #include "geometry.hpp"
 
-template<typename T, typename R=int, unsigned MAX_OBJECTS=10, unsigned MAX_LEVELS=5>
+// Loose quadtree. Each node's loose bounds are twice the size of its tight bounds and
+// an object is stored in a node whose loose bounds contain it, which means objects 
+// never straddle nodes. A node is split once it directly holds more than MAX_OBJECTS
+// and moving an object only touches the tree if it leaves its node's loose bounds.
+//
+// Nodes and objects are held in pools, insert() hands back a handle which is used to 
+// move() or remove() the object later. Rectangles are half-open, i.e. a 1x1 rectangle
+// at (x,y) covers the single tile (x,y). The bounds double in size as needed to fit 
+// whatever is inserted.
+template<typename T, typename R=int, unsigned MAX_OBJECTS=8, unsigned MAX_LEVELS=8>
 class quadtree
 {
 public:
-	explicit quadtree(int level, const geometry::Rect<R>& bounds) 
-		: level_(level), 
-		  bounding_rect_(bounds) 
+	typedef geometry::Rect<R> rect_type;
+	typedef geometry::Point<R> point_type;
+	typedef int handle;
+	enum { invalid_handle = -1 };
+
+	explicit quadtree(const rect_type& bounds) 
+		: bounds_(bounds),
+		  nodes_(),
+		  free_nodes_(),
+		  objects_(),
+		  free_objects_(),
+		  size_(0)
 	{
-		nodes_.reserve(4);
+		ASSERT_LOG(bounds_.w() > 0 && bounds_.h() > 0, "quadtree bounds must not be empty.");
+		nodes_.emplace_back(node(-1, 0, bounds_));
 	}
+
 	void clear() {
+		nodes_.clear();
+		free_nodes_.clear();
 		objects_.clear();
-		for(auto& n : nodes_) {
-			n.clear();
+		free_objects_.clear();
+		size_ = 0;
+		nodes_.emplace_back(node(-1, 0, bounds_));
+	}
+
+	const rect_type& get_bounds() const { return bounds_; }
+	int size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+	// Pool sizes, for profiling.
+	int node_capacity() const { return static_cast<int>(nodes_.size()); }
+	int node_count() const { return static_cast<int>(nodes_.size() - free_nodes_.size()); }
+
+	// Doubles the bounds until r fits. This re-inserts everything so is best done up 
+	// front, e.g. with the map size, it also happens automatically on insert/move.
+	void expand(const rect_type& r) {
+		grow_to_fit(r);
+	}
+
+	handle insert(const T& obj, const rect_type& r) {
+		grow_to_fit(r);
+		handle h;
+		if(!free_objects_.empty()) {
+			h = free_objects_.back();
+			free_objects_.pop_back();
+		} else {
+			h = static_cast<handle>(objects_.size());
+			objects_.emplace_back(entry());
 		}
-		nodes_.clear();
+		entry& e = objects_[h];
+		e.obj = obj;
+		e.area = r;
+		e.in_use = true;
+		place(h);
+		++size_;
+		return h;
+	}
+
+	void remove(handle h) {
+		ASSERT_LOG(is_valid(h), "Invalid quadtree handle: " << h);
+		const int n = objects_[h].owner;
+		unlink(h);
+		prune(n);
+		objects_[h].in_use = false;
+		objects_[h].obj = T();
+		free_objects_.emplace_back(h);
+		--size_;
+	}
+
+	// Changes the area occupied by an object. O(1) while it stays within the loose
+	// bounds of its node, otherwise it is re-inserted from the root.
+	void move(handle h, const rect_type& r) {
+		ASSERT_LOG(is_valid(h), "Invalid quadtree handle: " << h);
+		entry& e = objects_[h];
+		e.area = r;
+		if(contains(nodes_[e.owner].loose, r)) {
+			return;
+		}
+		if(!contains(bounds_, r)) {
+			// N.B. grow_to_fit re-inserts everything, including h.
+			grow_to_fit(r);
+			return;
+		}
+		const int old = e.owner;
+		unlink(h);
+		prune(old);
+		place(h);
+	}
+
+	bool is_valid(handle h) const { 
+		return h >= 0 && h < static_cast<handle>(objects_.size()) && objects_[h].in_use; 
+	}
+	const T& get(handle h) const { return objects_[h].obj; }
+	const rect_type& get_area(handle h) const { return objects_[h].area; }
+
+	// Calls fn(obj, area) for every object whose area intersects r.
+	template<typename F>
+	void for_each_in_rect(const rect_type& r, F fn) const {
+		query_rect(0, r, fn);
 	}
-	void split() {
-		const R x = bounding_rect_.x();
-		const R mx = bounding_rect_.mid_x();
-		const R y = bounding_rect_.y();
-		const R my = bounding_rect_.mid_y();
-		const R sw = bounding_rect_.w()/2;
-		const R sh = bounding_rect_.h()/2;
-
-		nodes_.emplace_back(level_+1, geometry::Rect<R>(mx,  y, sw, sh));
-		nodes_.emplace_back(level_+1, geometry::Rect<R>(x,   y, sw, sh));
-		nodes_.emplace_back(level_+1, geometry::Rect<R>(x,  my, sw, sh));
-		nodes_.emplace_back(level_+1, geometry::Rect<R>(mx, my, sw, sh));
-	}
-	void insert(const T& obj, const geometry::Rect<R>& r) {
-		if(!nodes_.empty()) {
-			int index = get_index(r);
-			if(index != -1) {
-				nodes_[index].insert(obj, r);
-				return;
+
+	// Calls fn(obj, area) for every object whose area is within radius of centre.
+	template<typename F>
+	void for_each_in_radius(const point_type& centre, R radius, F fn) const {
+		const rect_type r = make_rect(centre.x - radius, centre.y - radius, centre.x + radius + 1, centre.y + radius + 1);
+		auto in_radius = [&centre, radius, &fn](const T& obj, const rect_type& area) {
+			const R dx = centre.x < area.x1() ? area.x1() - centre.x : (centre.x >= area.x2() ? centre.x - area.x2() + 1 : 0);
+			const R dy = centre.y < area.y1() ? area.y1() - centre.y : (centre.y >= area.y2() ? centre.y - area.y2() + 1 : 0);
+			if(dx * dx + dy * dy <= radius * radius) {
+				fn(obj, area);
 			}
+		};
+		query_rect(0, r, in_radius);
+	}
+
+	// Appends all the objects intersecting r to res.
+	void get_collidable(std::vector<T>& res, const rect_type& r) const {
+		for_each_in_rect(r, [&res](const T& obj, const rect_type&) {
+			res.emplace_back(obj);
+		});
+	}
+private:
+	struct node
+	{
+		node(int p, unsigned lvl, const rect_type& b) 
+			: parent(p), level(lvl), bounds(b), loose(loose_bounds(b)), first(-1), num_objects(0), count(0) 
+		{
+			std::fill(children, children + 4, -1);
 		}
-		objects_.insert(std::make_pair(obj, r));
-		if(objects_.size() > MAX_OBJECTS && level_ < MAX_LEVELS) {
-			if(nodes_.empty()) {
-				split();
+		int parent;
+		unsigned level;
+		rect_type bounds;
+		rect_type loose;
+		int children[4];
+		// head of the list of objects stored directly in this node.
+		int first;
+		int num_objects;
+		// number of objects in this node and all its descendants.
+		int count;
+	};
+
+	struct entry
+	{
+		entry() : obj(), area(), owner(-1), prev(-1), next(-1), in_use(false) {}
+		T obj;
+		rect_type area;
+		int owner;
+		int prev;
+		int next;
+		bool in_use;
+	};
+
+	rect_type bounds_;
+	std::vector<node> nodes_;
+	std::vector<int> free_nodes_;
+	std::vector<entry> objects_;
+	std::vector<handle> free_objects_;
+	int size_;
+
+	// N.B. Not from_coordinates, which treats x2/y2 as inclusive for integers.
+	static rect_type make_rect(R x1, R y1, R x2, R y2) {
+		return rect_type(x1, y1, x2 - x1, y2 - y1);
+	}
+
+	static bool contains(const rect_type& outer, const rect_type& r) {
+		return r.x1() >= outer.x1() && r.y1() >= outer.y1() && r.x2() <= outer.x2() && r.y2() <= outer.y2();
+	}
+
+	static bool intersects(const rect_type& a, const rect_type& b) {
+		return a.x1() < b.x2() && b.x1() < a.x2() && a.y1() < b.y2() && b.y1() < a.y2();
+	}
+
+	static rect_type child_bounds(const rect_type& b, int quad) {
+		const R mx = b.mid_x();
+		const R my = b.mid_y();
+		switch(quad) {
+			case 0:  return make_rect(b.x1(), b.y1(), mx, my);
+			case 1:  return make_rect(mx, b.y1(), b.x2(), my);
+			case 2:  return make_rect(b.x1(), my, mx, b.y2());
+			default: return make_rect(mx, my, b.x2(), b.y2());
+		}
+	}
+
+	static rect_type loose_bounds(const rect_type& b) {
+		const R hw = b.w() / 2;
+		const R hh = b.h() / 2;
+		return make_rect(b.x1() - hw, b.y1() - hh, b.x2() + hw, b.y2() + hh);
+	}
+
+	// The child of n that r should go in, or -1 if it should stay in n.
+	int child_for(int n, const rect_type& r, bool create) {
+		const node& nd = nodes_[n];
+		if(nd.level + 1 >= MAX_LEVELS) {
+			return -1;
+		}
+		const R cx = r.x1() + r.w() / 2;
+		const R cy = r.y1() + r.h() / 2;
+		const int quad = (cx >= nd.bounds.mid_x() ? 1 : 0) + (cy >= nd.bounds.mid_y() ? 2 : 0);
+		if(nd.children[quad] >= 0) {
+			const int c = nd.children[quad];
+			return contains(nodes_[c].loose, r) ? c : -1;
+		}
+		if(!create) {
+			return -1;
+		}
+		const rect_type cb = child_bounds(nd.bounds, quad);
+		if(cb.w() <= 0 || cb.h() <= 0 || !contains(loose_bounds(cb), r)) {
+			return -1;
+		}
+		const int c = alloc_node(n, nd.level + 1, cb);
+		nodes_[n].children[quad] = c;
+		return c;
+	}
+
+	int alloc_node(int parent, unsigned level, const rect_type& b) {
+		if(!free_nodes_.empty()) {
+			const int n = free_nodes_.back();
+			free_nodes_.pop_back();
+			nodes_[n] = node(parent, level, b);
+			return n;
+		}
+		nodes_.emplace_back(node(parent, level, b));
+		return static_cast<int>(nodes_.size()) - 1;
+	}
+
+	// Puts h in the deepest existing node it fits, splitting that node if it's full.
+	void place(handle h) {
+		const rect_type& r = objects_[h].area;
+		int n = 0;
+		for(int c = child_for(n, r, false); c >= 0; c = child_for(n, r, false)) {
+			n = c;
+		}
+		link(h, n);
+		if(nodes_[n].num_objects > static_cast<int>(MAX_OBJECTS)) {
+			split(n);
+		}
+	}
+
+	// Pushes down whatever objects in n will fit in a child.
+	void split(int n) {
+		int h = nodes_[n].first;
+		while(h >= 0) {
+			const int next = objects_[h].next;
+			const int c = child_for(n, objects_[h].area, true);
+			if(c >= 0) {
+				unlink(h);
+				link(h, c);
 			}
-			auto it = objects_.begin();
-			while(it != objects_.end()) {
-				int index = get_index(it->second);
-				if(index != -1) {
-					nodes_[index].insert(it->first, it->second);
-					objects_.erase(it++);
-				} else {
-					++it;
+			h = next;
+		}
+	}
+
+	void link(handle h, int n) {
+		entry& e = objects_[h];
+		e.owner = n;
+		e.prev = -1;
+		e.next = nodes_[n].first;
+		if(e.next >= 0) {
+			objects_[e.next].prev = h;
+		}
+		nodes_[n].first = h;
+		++nodes_[n].num_objects;
+		for(int p = n; p >= 0; p = nodes_[p].parent) {
+			++nodes_[p].count;
+		}
+	}
+
+	void unlink(handle h) {
+		entry& e = objects_[h];
+		if(e.prev >= 0) {
+			objects_[e.prev].next = e.next;
+		} else {
+			nodes_[e.owner].first = e.next;
+		}
+		if(e.next >= 0) {
+			objects_[e.next].prev = e.prev;
+		}
+		--nodes_[e.owner].num_objects;
+		for(int p = e.owner; p >= 0; p = nodes_[p].parent) {
+			--nodes_[p].count;
+		}
+		e.owner = e.prev = e.next = -1;
+	}
+
+	// Returns empty nodes to the pool, walking up from n.
+	void prune(int n) {
+		while(n > 0 && nodes_[n].count == 0) {
+			const int parent = nodes_[n].parent;
+			for(int& c : nodes_[parent].children) {
+				if(c == n) {
+					c = -1;
 				}
 			}
+			// empty count means any children are empty too.
+			release_subtree(n);
+			n = parent;
 		}
 	}
-	void remove(const T& obj) {
-		auto it = objects_.begin();
-		while(it != objects_.end()) {
-			if(it->first == obj) {
-				objects_.erase(it++);
-			} else {
-				++it;
+
+	void release_subtree(int n) {
+		for(int c : nodes_[n].children) {
+			if(c >= 0) {
+				release_subtree(c);
 			}
 		}
+		free_nodes_.emplace_back(n);
 	}
-	void get_collidable(std::vector<T>& res, const geometry::Rect<R>& r) {
-		int index = get_index(r);
-		if(index == -1 && !nodes_.empty()) {
-			nodes_[index].get_collidable(res, r);
+
+	// Doubles the bounds until r fits then re-inserts everything. This is rare, it
+	// only happens when something is placed outside all previous bounds.
+	void grow_to_fit(const rect_type& r) {
+		if(contains(bounds_, r)) {
+			return;
+		}
+		while(!contains(bounds_, r)) {
+			const R w = std::max<R>(bounds_.w(), 1);
+			const R h = std::max<R>(bounds_.h(), 1);
+			const R x1 = r.x1() < bounds_.x1() ? bounds_.x1() - w : bounds_.x1();
+			const R y1 = r.y1() < bounds_.y1() ? bounds_.y1() - h : bounds_.y1();
+			bounds_ = make_rect(x1, y1, x1 + w * 2, y1 + h * 2);
 		}
-		for(auto& obj : objects_) {
-			res.emplace_back(obj.first);
+		nodes_.clear();
+		free_nodes_.clear();
+		nodes_.emplace_back(node(-1, 0, bounds_));
+		for(handle h = 0; h != static_cast<handle>(objects_.size()); ++h) {
+			if(objects_[h].in_use) {
+				place(h);
+			}
 		}
 	}
-private:
-	int level_;
-	geometry::Rect<R> bounding_rect_;
-	std::set<std::pair<T,geometry::Rect<R>>> objects_;
-	std::vector<quadtree<T, R, MAX_OBJECTS, MAX_LEVELS>> nodes_;
-
-	int get_index(const geometry::Rect<R> r) {
-		int index = -1;
-		bool tq = r.y() < bounding_rect_.mid_y() && r.y2() < bounding_rect_.mid_y();
-		bool bq = r.y() > bounding_rect_.mid_y();
-		if(r.x() < bounding_rect_.mid_x() && r.x2() < bounding_rect_.mid_x()) {
-			if(tq) {
-				index = 1;
-			} else if(bq) {
-				index = 2;
+
+	template<typename F>
+	void query_rect(int n, const rect_type& r, F& fn) const {
+		const node& nd = nodes_[n];
+		if(nd.count == 0 || !intersects(nd.loose, r)) {
+			return;
+		}
+		for(int h = nd.first; h >= 0; h = objects_[h].next) {
+			if(intersects(objects_[h].area, r)) {
+				fn(objects_[h].obj, objects_[h].area);
 			}
-		} else if(r.x() > bounding_rect_.mid_x()) {
-			if(tq) {
-				index = 0;
-			} else if(bq) {
-				index = 3;
+		}
+		for(int c : nd.children) {
+			if(c >= 0) {
+				query_rect(c, r, fn);
 			}
 		}
-		return index;
 	}
 };
@@ -33,4 +33,9 @@ namespace generator
 		static std::mt19937 res{seed};
 		return res;
 	}
+
+	void set_seed(std::mt19937::result_type seed)
+	{
+		get_random_engine().seed(seed);
+	}
 }
@@ -28,6 +28,8 @@
 namespace generator
 {
 	std::mt19937& get_random_engine();
+	// Re-seed the engine, for reproducible runs.
+	void set_seed(std::mt19937::result_type seed);
 
 	template<typename T>
 	T get_uniform_int(T mn, T mx)
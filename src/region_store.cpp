@@ -0,0 +1,254 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#ifdef _MSC_VER
+#pragma comment(lib, "zlib")
+#endif
+
+#include <fstream>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <zlib.h>
+
+#include "asserts.hpp"
+#include "region_store.hpp"
+
+namespace mercy
+{
+	namespace
+	{
+		const char region_magic[4] = { 'M', 'R', 'G', 'N' };
+		const uint32_t region_version = 1;
+		const int chunks_per_region = region_store::region_size * region_store::region_size;
+		// Magic, version, chunk width and height, then an offset and size for each chunk.
+		const uint32_t region_header_size = 16 + chunks_per_region * 8;
+		const std::size_t max_open_regions = 32;
+
+		int floor_div(int n, int d)
+		{
+			return n >= 0 ? n / d : -((-n + d - 1) / d);
+		}
+
+		// Where the chunk is in its region's index.
+		int get_slot(const point& chunk)
+		{
+			const int size = region_store::region_size;
+			return (chunk.y - floor_div(chunk.y, size) * size) * size + chunk.x - floor_div(chunk.x, size) * size;
+		}
+
+		// Files are little endian whatever the machine is.
+		void put_u32(uint8_t* p, uint32_t n)
+		{
+			p[0] = static_cast<uint8_t>(n);
+			p[1] = static_cast<uint8_t>(n >> 8);
+			p[2] = static_cast<uint8_t>(n >> 16);
+			p[3] = static_cast<uint8_t>(n >> 24);
+		}
+
+		uint32_t get_u32(const uint8_t* p)
+		{
+			return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+		}
+	}
+
+	struct region_store::region
+	{
+		region() : exists(false), index(chunks_per_region * 2), end(region_header_size), last_used(0) {}
+		std::string filename;
+		bool exists;
+		// Offset and size of each chunk's data, a size of zero if it hasn't been written.
+		std::vector<uint32_t> index;
+		uint32_t end;
+		// Opened when first written to.
+		std::fstream file;
+		// Mapped when first read from, and dropped when written to.
+		std::unique_ptr<boost::interprocess::file_mapping> mapping;
+		std::unique_ptr<boost::interprocess::mapped_region> view;
+		unsigned last_used;
+	};
+
+	region_store::region_store(const std::string& path, int chunk_w, int chunk_h)
+		: path_(path),
+		  chunk_w_(chunk_w),
+		  chunk_h_(chunk_h),
+		  mutex_(),
+		  regions_(),
+		  use_count_(0)
+	{
+		if(!path_.empty() && path_.back() != '/') {
+			path_ += '/';
+		}
+	}
+
+	region_store::~region_store()
+	{
+		flush();
+	}
+
+	region_store::region* region_store::get_region(const point& chunk, bool create)
+	{
+		const point rpos(floor_div(chunk.x, region_size), floor_div(chunk.y, region_size));
+		auto it = regions_.find(rpos);
+		if(it == regions_.end()) {
+			if(regions_.size() >= max_open_regions) {
+				auto lru = regions_.begin();
+				for(auto rit = regions_.begin(); rit != regions_.end(); ++rit) {
+					if(rit->second->last_used < lru->second->last_used) {
+						lru = rit;
+					}
+				}
+				regions_.erase(lru);
+			}
+			std::unique_ptr<region> r(new region);
+			std::stringstream ss;
+			ss << path_ << "r." << rpos.x << "." << rpos.y << ".mrg";
+			r->filename = ss.str();
+			std::ifstream in(r->filename, std::ios_base::binary);
+			if(in) {
+				std::vector<uint8_t> header(region_header_size);
+				in.read(reinterpret_cast<char*>(header.data()), header.size());
+				ASSERT_LOG(in.gcount() == static_cast<std::streamsize>(header.size()) && std::equal(region_magic, region_magic + 4, header.begin()), 
+					"Not a region file: " << r->filename);
+				ASSERT_LOG(get_u32(&header[4]) == region_version, "Unsupported region file version " << get_u32(&header[4]) << ": " << r->filename);
+				ASSERT_LOG(get_u32(&header[8]) == static_cast<uint32_t>(chunk_w_) && get_u32(&header[12]) == static_cast<uint32_t>(chunk_h_), 
+					"Region file chunk size doesn't match the terrain's: " << r->filename);
+				for(int n = 0; n != chunks_per_region * 2; ++n) {
+					r->index[n] = get_u32(&header[16 + n * 4]);
+				}
+				in.seekg(0, std::ios_base::end);
+				r->end = static_cast<uint32_t>(in.tellg());
+				r->exists = true;
+			}
+			it = regions_.emplace(rpos, std::move(r)).first;
+		}
+		region* r = it->second.get();
+		r->last_used = ++use_count_;
+		if(!r->exists && !create) {
+			return nullptr;
+		}
+		if(!r->exists) {
+			boost::filesystem::create_directories(path_);
+			std::vector<uint8_t> header(region_header_size);
+			std::copy(region_magic, region_magic + 4, header.begin());
+			put_u32(&header[4], region_version);
+			put_u32(&header[8], chunk_w_);
+			put_u32(&header[12], chunk_h_);
+			std::ofstream out(r->filename, std::ios_base::binary);
+			out.write(reinterpret_cast<const char*>(header.data()), header.size());
+			ASSERT_LOG(out.good(), "Couldn't create region file: " << r->filename);
+			r->exists = true;
+		}
+		if(create && !r->file.is_open()) {
+			r->file.open(r->filename, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+			ASSERT_LOG(r->file.is_open(), "Couldn't open region file for writing: " << r->filename);
+		}
+		return r;
+	}
+
+	bool region_store::contains(const point& chunk)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		region* r = get_region(chunk, false);
+		if(r == nullptr) {
+			return false;
+		}
+		const int n = get_slot(chunk);
+		return r->index[n * 2 + 1] != 0;
+	}
+
+	bool region_store::read(const point& chunk, std::vector<uint8_t>* types)
+	{
+		std::vector<uint8_t> packed;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			region* r = get_region(chunk, false);
+			if(r == nullptr) {
+				return false;
+			}
+			const int n = get_slot(chunk);
+			const uint32_t offset = r->index[n * 2];
+			const uint32_t size = r->index[n * 2 + 1];
+			if(size == 0) {
+				return false;
+			}
+			if(r->view == nullptr) {
+				if(r->file.is_open()) {
+					r->file.flush();
+				}
+				using namespace boost::interprocess;
+				r->mapping.reset(new file_mapping(r->filename.c_str(), read_only));
+				r->view.reset(new mapped_region(*r->mapping, read_only));
+			}
+			ASSERT_LOG(static_cast<std::size_t>(offset) + size <= r->view->get_size(), 
+				"Chunk " << chunk << " runs past the end of region file: " << r->filename);
+			const uint8_t* p = static_cast<const uint8_t*>(r->view->get_address()) + offset;
+			packed.assign(p, p + size);
+		}
+		types->resize(chunk_w_ * chunk_h_);
+		uLongf len = static_cast<uLongf>(types->size());
+		const int res = uncompress(types->data(), &len, packed.data(), static_cast<uLong>(packed.size()));
+		ASSERT_LOG(res == Z_OK && len == types->size(), "Chunk " << chunk << " in " << path_ << " is corrupt.");
+		return true;
+	}
+
+	void region_store::write(const point& chunk, const std::vector<uint8_t>& types)
+	{
+		ASSERT_LOG(types.size() == static_cast<std::size_t>(chunk_w_ * chunk_h_), "Chunk " << chunk << " is the wrong size to store.");
+		std::vector<uint8_t> packed(compressBound(static_cast<uLong>(types.size())));
+		uLongf len = static_cast<uLongf>(packed.size());
+		const int res = compress(packed.data(), &len, types.data(), static_cast<uLong>(types.size()));
+		ASSERT_LOG(res == Z_OK, "Failed to compress chunk " << chunk << ": " << res);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		region* r = get_region(chunk, true);
+		// Mappings aren't guaranteed to see the file grow, so it is remade on the next read.
+		r->view.reset();
+		r->mapping.reset();
+		// Always appended, the space used by an earlier copy isn't reused.
+		const int n = get_slot(chunk);
+		r->file.seekp(r->end);
+		r->file.write(reinterpret_cast<const char*>(packed.data()), len);
+		uint8_t entry[8];
+		put_u32(entry, r->end);
+		put_u32(entry + 4, static_cast<uint32_t>(len));
+		r->file.seekp(16 + n * 8);
+		r->file.write(reinterpret_cast<const char*>(entry), sizeof(entry));
+		ASSERT_LOG(r->file.good(), "Failed writing chunk " << chunk << " to region file: " << r->filename);
+		r->index[n * 2] = r->end;
+		r->index[n * 2 + 1] = static_cast<uint32_t>(len);
+		r->end += static_cast<uint32_t>(len);
+	}
+
+	void region_store::flush()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for(auto& r : regions_) {
+			if(r.second->file.is_open()) {
+				r.second->file.flush();
+			}
+		}
+	}
+}
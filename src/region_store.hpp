@@ -0,0 +1,80 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "geometry.hpp"
+
+namespace mercy
+{
+	// Stores chunks' terrain types on disk, grouped into regions of region_size by
+	// region_size chunks with a file per region. A region file starts with an index
+	// giving the offset and size of each chunk's compressed data, which follows it.
+	// Only the index of a region is read when it is first used, chunk data is read
+	// through a memory mapping of the file when the chunk is asked for.
+	//
+	// Chunks are given by their index on the chunk grid, rather than a tile position.
+	// All functions are safe to call from several threads at once.
+	class region_store
+	{
+	public:
+		static const int region_size = 32;
+
+		// Region files are in the directory path, which is made when first written to.
+		region_store(const std::string& path, int chunk_w, int chunk_h);
+		~region_store();
+
+		const std::string& get_path() const { return path_; }
+		// Whether the chunk has been written.
+		bool contains(const point& chunk);
+		// Returns false if the chunk hasn't been written.
+		bool read(const point& chunk, std::vector<uint8_t>* types);
+		// types is the chunk's terrain types in rows. Replaces any earlier copy.
+		void write(const point& chunk, const std::vector<uint8_t>& types);
+		// Makes sure everything written is in the files.
+		void flush();
+	private:
+		struct region;
+		// Opens the region's file, or makes it if create is set. Returns null if the
+		// region has no file and create isn't set. Must hold mutex_.
+		region* get_region(const point& chunk, bool create);
+
+		std::string path_;
+		int chunk_w_;
+		int chunk_h_;
+		std::mutex mutex_;
+		std::map<point, std::unique_ptr<region>> regions_;
+		// Used to close the least recently used region when too many are open.
+		unsigned use_count_;
+
+		region_store(const region_store&) = delete;
+		void operator=(const region_store&) = delete;
+	};
+}
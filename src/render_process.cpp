@@ -21,6 +21,8 @@
 	   distribution.
 */
 
+#include <cmath>
+
 #include "component.hpp"
 #include "engine.hpp"
 #include "map.hpp"
@@ -33,14 +35,20 @@
 namespace process
 {
 	render::render()
-		: process(ProcessPriority::render)
+		: process(ProcessPriority::render),
+		  query_(0)
 	{
 	}
 
+	void render::start(engine& eng)
+	{
+		using namespace component;
+		query_ = eng.register_query(genmask(Component::SPRITE) | genmask(Component::POSITION));
+	}
+
 	void render::update(engine& eng, float t, const entity_list& elist)
 	{
 		using namespace component;
-		static component_id render_mask = genmask(Component::SPRITE) | genmask(Component::POSITION);
 
 		std::unique_ptr<KRE::ModelManager2D> mm;
 
@@ -50,15 +58,6 @@ namespace process
 		const mercy::BaseMapPtr& rmap = eng.getMap();
 		const pointf& ts = rmap->getTileSize();
 		pointf map_offset;
-		// draw map
-		const int screen_width_in_tiles = (eng.getGameArea().w() + ts.x - 1) / ts.x;
-		const int screen_height_in_tiles = (eng.getGameArea().h() + ts.y - 1) / ts.y;
-		rect area = rect::from_coordinates(-screen_width_in_tiles / 2 + cam.x / ts.x, 
-			-screen_height_in_tiles / 2 + cam.y / ts.y,
-			screen_width_in_tiles / 2 + cam.x / ts.x,
-			screen_height_in_tiles / 2 + cam.y / ts.y);
-
-		auto mapr = rmap->getRenderable(area);
 		if(rmap->isFixedSize()) {
 			const float map_pixel_width = rmap->getWidth() * ts.x;
 			const float map_pixel_height = rmap->getHeight() * ts.y;
@@ -84,33 +83,36 @@ namespace process
 			} else {
 				map_offset.y = screen_centre.y - map_pixel_height/ 2.0f;
 			}
-			for(auto& r : mapr) {
-				r->setPosition(map_offset.x, map_offset.y);
-			}
 		} else {
 			map_offset.x = screen_centre.x - cam.x;
 			map_offset.y = screen_centre.y - cam.y;
-
-			mm.reset(new KRE::ModelManager2D(map_offset.x, map_offset.y));
 		}
+		// draw map, only the tiles covered by the game area are asked for.
+		const rect& ga = eng.getGameArea();
+		rect area = rect::from_coordinates(static_cast<int>(std::floor((ga.x1() - map_offset.x) / ts.x)), 
+			static_cast<int>(std::floor((ga.y1() - map_offset.y) / ts.y)),
+			static_cast<int>(std::floor((ga.x2() - map_offset.x) / ts.x)),
+			static_cast<int>(std::floor((ga.y2() - map_offset.y) / ts.y)));
+
+		const auto& mapr = rmap->getRenderable(area);
+		// Map renderables are positioned relative to the map's origin.
+		mm.reset(new KRE::ModelManager2D(static_cast<int>(map_offset.x), static_cast<int>(map_offset.y)));
 		for(auto& r : mapr) {
 			r->preRender(wnd);
 			wnd->render(r.get());
 		}
 		mm.reset();
 
-		for(auto& e : elist) {
-			if((e->mask & render_mask) == render_mask) {
-				auto& spr = e->spr;
-				auto& pos = e->pos;
-				const auto& visible = rmap->getPlayerVisibleTiles();
-
-				if(visible.find(pos->pos) != visible.end()) {
-					ASSERT_LOG(spr->obj != nullptr, "No renderable object attached to sprite.");
-					spr->obj->setPosition(pos->pos.x * ts.x + map_offset.x, pos->pos.y * ts.y + map_offset.y);
-					spr->obj->preRender(wnd);
-					wnd->render(spr->obj.get());
-				}
+		const auto& visible = rmap->getPlayerVisibleTiles();
+		for(auto& e : eng.get_query(query_)) {
+			auto& spr = e->spr;
+			auto& pos = e->pos;
+
+			if(visible.test(pos->pos)) {
+				ASSERT_LOG(spr->obj != nullptr, "No renderable object attached to sprite.");
+				spr->obj->setPosition(pos->pos.x * ts.x + map_offset.x, pos->pos.y * ts.y + map_offset.y);
+				spr->obj->preRender(wnd);
+				wnd->render(spr->obj.get());
 			}
 		}
 	}
@@ -31,7 +31,10 @@ namespace process
 	{
 	public:
 		render();
+		void start(engine& eng) override;
 		void update(engine& eng, float t, const entity_list& elist) override;
+		const char* get_name() const override { return "render"; }
 	private:
+		std::size_t query_;
 	};
 }
@@ -0,0 +1,179 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <chrono>
+
+#include "asserts.hpp"
+#include "profiler.hpp"
+#include "scheduler.hpp"
+#include "thread_pool.hpp"
+
+namespace process
+{
+	scheduler::scheduler(threading::thread_pool* pool)
+		: nodes_(),
+		  pool_(pool),
+		  parallel_(true),
+		  remaining_(),
+		  outstanding_(0),
+		  main_mutex_(),
+		  main_cv_(),
+		  main_ready_()
+	{
+	}
+
+	bool scheduler::conflicts(const process& a, const process& b)
+	{
+		return (a.get_writes() & (b.get_reads() | b.get_writes())).any() 
+			|| (a.get_reads() & b.get_writes()).any();
+	}
+
+	void scheduler::build(const std::vector<process_ptr>& processes)
+	{
+		nodes_.clear();
+		nodes_.resize(processes.size());
+		for(int n = 0; n != static_cast<int>(processes.size()); ++n) {
+			nodes_[n].proc = processes[n];
+			if(n > 0) {
+				ASSERT_LOG(processes[n-1]->get_priority() <= processes[n]->get_priority(), "Processes given to scheduler must be sorted by priority.");
+			}
+		}
+		for(int n = 0; n != static_cast<int>(nodes_.size()); ++n) {
+			for(int m = n + 1; m != static_cast<int>(nodes_.size()); ++m) {
+				if(conflicts(*nodes_[n].proc, *nodes_[m].proc)) {
+					nodes_[n].successors.emplace_back(m);
+					++nodes_[m].num_predecessors;
+				}
+			}
+		}
+		remaining_.reset(new std::atomic<int>[nodes_.size()]);
+	}
+
+	int scheduler::get_root_count() const
+	{
+		int count = 0;
+		for(auto& n : nodes_) {
+			if(n.num_predecessors == 0) {
+				++count;
+			}
+		}
+		return count;
+	}
+
+	std::vector<scheduler::process_stats> scheduler::get_stats() const
+	{
+		std::vector<process_stats> res;
+		for(auto& n : nodes_) {
+			process_stats ps = { n.proc, n.total_ms, n.runs };
+			res.emplace_back(ps);
+		}
+		return res;
+	}
+
+	void scheduler::reset_stats()
+	{
+		for(auto& n : nodes_) {
+			n.total_ms = 0.0;
+			n.runs = 0;
+		}
+	}
+
+	void scheduler::execute(int ndx, engine& eng, float t, const entity_list& elist)
+	{
+		profile::zone z(nodes_[ndx].proc->get_name());
+		nodes_[ndx].proc->update(eng, t, elist);
+		nodes_[ndx].total_ms += z.elapsed_ms();
+		++nodes_[ndx].runs;
+	}
+
+	void scheduler::run(engine& eng, float t, const entity_list& elist)
+	{
+		if(!is_parallel()) {
+			for(int n = 0; n != static_cast<int>(nodes_.size()); ++n) {
+				execute(n, eng, t, elist);
+			}
+			return;
+		}
+
+		outstanding_ = static_cast<int>(nodes_.size());
+		for(int n = 0; n != static_cast<int>(nodes_.size()); ++n) {
+			remaining_[n] = nodes_[n].num_predecessors;
+		}
+		for(int n = 0; n != static_cast<int>(nodes_.size()); ++n) {
+			if(nodes_[n].num_predecessors == 0) {
+				dispatch(n, eng, t, elist);
+			}
+		}
+
+		// Run anything that needs the main thread, help out the pool otherwise.
+		while(outstanding_ > 0) {
+			int ndx = -1;
+			{
+				std::lock_guard<std::mutex> lock(main_mutex_);
+				if(!main_ready_.empty()) {
+					ndx = main_ready_.front();
+					main_ready_.pop_front();
+				}
+			}
+			if(ndx >= 0) {
+				execute(ndx, eng, t, elist);
+				complete(ndx, eng, t, elist);
+			} else if(!pool_->run_pending_task()) {
+				std::unique_lock<std::mutex> lock(main_mutex_);
+				main_cv_.wait_for(lock, std::chrono::milliseconds(1), [this]() { 
+					return !main_ready_.empty() || outstanding_ == 0; 
+				});
+			}
+		}
+	}
+
+	void scheduler::dispatch(int ndx, engine& eng, float t, const entity_list& elist)
+	{
+		if(nodes_[ndx].proc->is_main_thread_only()) {
+			{
+				std::lock_guard<std::mutex> lock(main_mutex_);
+				main_ready_.emplace_back(ndx);
+			}
+			main_cv_.notify_one();
+			return;
+		}
+		pool_->submit([this, ndx, &eng, t, &elist]() {
+			execute(ndx, eng, t, elist);
+			complete(ndx, eng, t, elist);
+		});
+	}
+
+	void scheduler::complete(int ndx, engine& eng, float t, const entity_list& elist)
+	{
+		for(int s : nodes_[ndx].successors) {
+			if(--remaining_[s] == 0) {
+				dispatch(s, eng, t, elist);
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(main_mutex_);
+			--outstanding_;
+		}
+		main_cv_.notify_one();
+	}
+}
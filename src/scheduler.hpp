@@ -0,0 +1,100 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "process.hpp"
+
+namespace threading
+{
+	class thread_pool;
+}
+
+namespace process
+{
+	// Runs a list of processes each engine tick. Two processes conflict if one writes
+	// something the other reads or writes, in which case the one with the lower priority
+	// (or that was added first, for equal priorities) finishes before the other starts.
+	// Processes which don't conflict are run at the same time on the thread pool.
+	class scheduler
+	{
+	public:
+		explicit scheduler(threading::thread_pool* pool=nullptr);
+		// Rebuilds the dependency graph, processes must already be sorted by priority.
+		void build(const std::vector<process_ptr>& processes);
+		void run(engine& eng, float t, const entity_list& elist);
+
+		// With parallel execution disabled processes are just run in order on the calling thread.
+		void set_parallel(bool p) { parallel_ = p; }
+		bool is_parallel() const { return parallel_ && pool_ != nullptr; }
+
+		// Number of processes with nothing before them in the graph, mainly for debugging.
+		int get_root_count() const;
+
+		// Accumulated time spent in each process since the last reset_stats().
+		struct process_stats
+		{
+			process_ptr proc;
+			double total_ms;
+			int runs;
+		};
+		std::vector<process_stats> get_stats() const;
+		void reset_stats();
+	private:
+		static bool conflicts(const process& a, const process& b);
+		void dispatch(int ndx, engine& eng, float t, const entity_list& elist);
+		void complete(int ndx, engine& eng, float t, const entity_list& elist);
+		void execute(int ndx, engine& eng, float t, const entity_list& elist);
+
+		struct node
+		{
+			node() : proc(), num_predecessors(0), successors(), total_ms(0.0), runs(0) {}
+			process_ptr proc;
+			int num_predecessors;
+			std::vector<int> successors;
+			// N.B. only touched by the thread running the process and read between runs.
+			double total_ms;
+			int runs;
+		};
+		std::vector<node> nodes_;
+		threading::thread_pool* pool_;
+		bool parallel_;
+
+		// per-run state
+		std::unique_ptr<std::atomic<int>[]> remaining_;
+		std::atomic<int> outstanding_;
+		std::mutex main_mutex_;
+		std::condition_variable main_cv_;
+		std::deque<int> main_ready_;
+
+		scheduler(const scheduler&) = delete;
+		void operator=(const scheduler&) = delete;
+	};
+}
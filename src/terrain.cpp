@@ -24,8 +24,6 @@
 #include <algorithm>
 
 #include <boost/functional/hash.hpp>
-#include <noise/noise.h>
-#include "noiseutils.h"
 
 #include "asserts.hpp"
 #include "component.hpp"
@@ -43,28 +41,79 @@ namespace mercy
 	namespace
 	{
 		const double terrain_scale_factor = 8.0;
+		// Renderables are made on the game thread, so only this many streamed chunks are
+		// added per update to avoid a hitch when a lot arrive at once.
+		const int max_chunks_added_per_update = 8;
+		// How many chunks beyond the edge of the screen are prefetched.
+		const int prefetch_distance = 2;
+		// Buckets in the lookup from a height to its tile.
+		const int height_lookup_size = 1024;
+
+		// Terrain is the same for the same seed, so new worlds share the region files.
+		std::string get_default_region_path(int seed)
+		{
+			return "save/terrain_" + std::to_string(seed) + "/";
+		}
+
+		int sign(int n)
+		{
+			return n > 0 ? 1 : (n < 0 ? -1 : 0);
+		}
+
+		// Heights of the w by h tiles from the tile position x,y, in rows.
+		void get_terrain_heights(const noise::batch::perlin& pnoise, double x, double y, int w, int h, int chunk_w, int chunk_h, std::vector<double>* heights)
+		{
+			std::vector<double> xs(w), ys(h);
+			for(int n = 0; n != w; ++n) {
+				xs[n] = (x + n) / (chunk_w * terrain_scale_factor);
+			}
+			for(int n = 0; n != h; ++n) {
+				ys[n] = (y + n) / (chunk_h * terrain_scale_factor);
+			}
+			heights->resize(w * h);
+			pnoise.get_grid(xs.data(), w, ys.data(), h, 0.0, heights->data());
+		}
 
 		class terrain_data
 		{
 		public:
-			terrain_data() {}
+			terrain_data() : height_min_(0), height_scale_(0) {}
 			void sort_tiles() {
 				std::stable_sort(tiles_.begin(), tiles_.end());
+				thresholds_.clear();
+				for(auto& t : tiles_) {
+					thresholds_.emplace_back(t->get_threshold());
+				}
+				// Each bucket of heights starts its search at the first tile for the bucket 
+				// before, so that rounding in working out the bucket can only make it 
+				// search one tile too many.
+				height_lookup_.resize(height_lookup_size);
+				height_min_ = thresholds_.front();
+				height_scale_ = thresholds_.back() > height_min_ ? height_lookup_size / (thresholds_.back() - height_min_) : 0.0f;
+				for(int n = 0; n != height_lookup_size; ++n) {
+					const float start = height_scale_ > 0.0f ? height_min_ + (n - 1) / height_scale_ : height_min_;
+					height_lookup_[n] = static_cast<uint8_t>(std::upper_bound(thresholds_.begin(), thresholds_.end(), start) - thresholds_.begin());
+				}
 			}
 			const pointf& get_tile_size() const { return tile_size_; }
 			void set_tile_size(const pointf& p) { tile_size_ = p; }
-			terrain_tile_ptr getTileAtHeight(float value) const 
+			// The first tile whose threshold is above value, or the last tile.
+			TerrainType getTypeAtHeight(float value) const 
 			{
-				if(value >= tiles_.back()->get_threshold()) {
-					return tiles_.back();
+				if(value >= thresholds_.back()) {
+					return tiles_.back()->get_terrain_type();
 				}
-				for(auto& t : tiles_) {
-					if(value < t->get_threshold()) {
-						return t;
-					}
+				const float bucket = (value - height_min_) * height_scale_;
+				std::size_t n = bucket > 0.0f ? height_lookup_[std::min(static_cast<int>(bucket), height_lookup_size - 1)] : 0;
+				while(n != thresholds_.size() && !(value < thresholds_[n])) {
+					++n;
 				}
-				ASSERT_LOG(false, "No valid terrain value found for value: " << value);
-				return nullptr;
+				ASSERT_LOG(n != thresholds_.size(), "No valid terrain value found for value: " << value);
+				return tiles_[n]->get_terrain_type();
+			}
+			const terrain_tile_ptr& getTileAtHeight(float value) const 
+			{
+				return types_[getTypeAtHeight(value)];
 			}
 			bool is_higher_priority(TerrainType first, TerrainType second) const 
 			{
@@ -84,6 +133,7 @@ namespace mercy
 					"terrain data must have 'tiles' attribute that is a map.");
 				auto& tiles = n["tiles"].as_map();
 
+				ASSERT_LOG(tiles.size() <= 256, "At most 256 terrain tiles are supported, found " << tiles.size());
 				tiles_.resize(tiles.size());
 
 				TerrainType counter = 0;
@@ -103,6 +153,7 @@ namespace mercy
 					++counter;
 				}
 
+				types_ = tiles_;
 				sort_tiles();
 
 				// Load tile priorities
@@ -118,13 +169,21 @@ namespace mercy
 				}
 			}
 			const std::vector<TerrainType>& get_priority_list() const { return tile_priority_list_; }
-			terrain_tile_ptr get_tile_from_terrain(TerrainType tt) {
-				ASSERT_LOG(tt >= 0 && static_cast<unsigned>(tt) < tiles_.size(), "TerrainType exceeds internal terrain data. " << tt);
-				return tiles_[tt];
+			const terrain_tile_ptr& get_tile_from_terrain(TerrainType tt) const {
+				ASSERT_LOG(static_cast<unsigned>(tt) < types_.size(), "TerrainType exceeds internal terrain data. " << tt);
+				return types_[tt];
 			}
 		private:
 			pointf tile_size_;
+			// Sorted by threshold.
 			std::vector<terrain_tile_ptr> tiles_;
+			std::vector<float> thresholds_;
+			// Indexed by terrain type.
+			std::vector<terrain_tile_ptr> types_;
+			// For each bucket of heights, the index in tiles_ to start searching from.
+			std::vector<uint8_t> height_lookup_;
+			float height_min_;
+			float height_scale_;
 			// Map from name to terrain type for the tile.
 			std::map<std::string, TerrainType> tile_name_map_;
 			// List of terrain priorities. 
@@ -154,33 +213,41 @@ namespace mercy
 	chunk::chunk(const point&pos, int width, int height)
 		: pos_(pos),
 		  width_(width),
-		  height_(height)
+		  height_(height),
+		  terrain_(width * height),
+		  renderable_(),
+		  last_used_(0)
 	{
-		terrain_.resize(height);
-		for(auto& row : terrain_) {
-			row.resize(width);
-		}
 	}
 
-	terrain_tile_ptr chunk::get_at(int x, int y)
+	const terrain_tile_ptr& chunk::get_at(int x, int y) const
 	{
-		ASSERT_LOG(x < width_, "x exceeds width of chunk: " << x << " >= " << width_);
-		ASSERT_LOG(y < height_, "y exceeds height of chunk: " << y << " >= " << height_);
-		return terrain_[y][x];
+		return get_terrain_data().get_tile_from_terrain(get_terrain_at(x, y));
 	}
 
-	TerrainType chunk::get_terrain_at(int x, int y)
+	TerrainType chunk::get_terrain_at(int x, int y) const
 	{
 		ASSERT_LOG(x < width_, "x exceeds width of chunk: " << x << " >= " << width_);
 		ASSERT_LOG(y < height_, "y exceeds height of chunk: " << y << " >= " << height_);
-		return terrain_[y][x]->get_terrain_type();
+		return terrain_[y * width_ + x];
 	}
 
 	void chunk::set_at(int x, int y, float height_value)
+	{
+		set_terrain_at(x, y, get_terrain_data().getTypeAtHeight(height_value));
+	}
+
+	void chunk::set_terrain_at(int x, int y, TerrainType tt)
 	{
 		ASSERT_LOG(x < width_, "x exceeds width of chunk: " << x << " >= " << width_);
 		ASSERT_LOG(y < height_, "y exceeds height of chunk: " << y << " >= " << height_);
-		terrain_[y][x] = get_terrain_data().getTileAtHeight(height_value);
+		terrain_[y * width_ + x] = static_cast<uint8_t>(tt);
+	}
+
+	void chunk::set_terrain(std::vector<uint8_t> types)
+	{
+		ASSERT_LOG(types.size() == terrain_.size(), "Chunk terrain is the wrong size: " << types.size() << " != " << terrain_.size());
+		terrain_ = std::move(types);
 	}
 
 	KRE::SceneObjectPtr chunk::make_renderable_from_chunk(chunk_ptr chk)
@@ -207,12 +274,10 @@ namespace mercy
 
 	terrain_tile_ptr Terrain::getTileAt(const point& p)
 	{
-		int cw2 = chunk_size_w_/2;
-		int ch2 = chunk_size_h_/2;
 		// position of chunk
-		point cpos(p.x > 0 ? (p.x+cw2)/cw2-1 : (p.x+cw2)/cw2, p.y > 0 ? (p.y+ch2)/ch2-1 : (p.y+ch2)/ch2);
+		const point cpos = getChunkPosition(p);
 		// position in chunk
-		point pos(p.x % cw2 + cw2, p.y % ch2 + ch2);
+		const point pos(p.x - cpos.x + chunk_size_w_/2, p.y - cpos.y + chunk_size_h_/2);
 		ASSERT_LOG(pos.x >= 0 && pos.x < chunk_size_w_, "x coordinate outside of chunk bounds. 0 <= " << pos.x << " < " << chunk_size_w_);
 		ASSERT_LOG(pos.y >= 0 && pos.y < chunk_size_h_, "y coordinate outside of chunk bounds. 0 <= " << pos.y << " < " << chunk_size_h_);
 		auto it = chunks_.find(cpos);
@@ -271,8 +336,20 @@ namespace mercy
 		  chunk_size_h_(16),
 		  chunks_(),
 		  terrain_seed_(generator::get_uniform_int(0, std::numeric_limits<int>::max())),
-		  start_location_()
+		  height_noise_(),
+		  start_location_(),
+		  paths_(),
+		  chunk_budget_(1024),
+		  update_count_(0),
+		  last_player_pos_(),
+		  travel_(),
+		  arrived_(),
+		  regions_(),
+		  streamer_(new chunk_streamer([this](const point& pos) { return makeChunk(pos); }, [this](const chunk_ptr& c) { saveChunk(c); }))
 	{
+		height_noise_.set_seed(terrain_seed_);
+		regions_.reset(new region_store(get_default_region_path(terrain_seed_), chunk_size_w_, chunk_size_h_));
+		createPathfinder();
 	}
 
 	Terrain::Terrain(const variant& node, const variant& features)
@@ -281,17 +358,74 @@ namespace mercy
 		  chunk_size_h_(16),
 		  chunks_(),
 		  terrain_seed_(0),
-		  start_location_()
+		  height_noise_(),
+		  start_location_(),
+		  paths_(),
+		  chunk_budget_(1024),
+		  update_count_(0),
+		  last_player_pos_(),
+		  travel_(),
+		  arrived_(),
+		  regions_(),
+		  streamer_(new chunk_streamer([this](const point& pos) { return makeChunk(pos); }, [this](const chunk_ptr& c) { saveChunk(c); }))
 	{
 		ASSERT_LOG(node.has_key("seed"), "No seed value for terrain was found.");
 		terrain_seed_ = node["seed"].as_int32();
+		height_noise_.set_seed(terrain_seed_);
 		ASSERT_LOG(node.has_key("start_location"), "No starting location found.");
 		start_location_ = variant_to_point(node["start_location"]);
 		ASSERT_LOG(node.has_key("chunk_size"), "No terrain chunk_size attribute found.");
 		point cs = variant_to_point(node["chunk_size"]);
 		chunk_size_w_ = cs.x;
 		chunk_size_h_ = cs.y;
-		// XXX load chunks
+		// Chunks are loaded from the region files as they are needed.
+		regions_.reset(new region_store(node.has_key("regions") ? node["regions"].as_string() : get_default_region_path(terrain_seed_), chunk_size_w_, chunk_size_h_));
+		createPathfinder();
+	}
+
+	void Terrain::createPathfinder()
+	{
+		paths_.reset(new hpa_pathfinder(chunk_size_w_, chunk_size_h_, point(-chunk_size_w_/2, -chunk_size_h_/2), 
+			[this](const rect& area, tile_bitmap* walkable) { sampleWalkable(area, walkable); }));
+	}
+
+	point Terrain::getChunkPosition(const point& p) const
+	{
+		const point chunk = paths_->get_chunk(p);
+		return point(chunk.x * chunk_size_w_, chunk.y * chunk_size_h_);
+	}
+
+	void Terrain::sampleWalkable(const rect& area, tile_bitmap* walkable) const
+	{
+		const point cpos = getChunkPosition(point(area.x(), area.y()));
+		auto it = chunks_.find(cpos);
+		if(it != chunks_.end()) {
+			for(int y = 0; y != chunk_size_h_; ++y) {
+				for(int x = 0; x != chunk_size_w_; ++x) {
+					if(it->second->get_at(x, y)->isWalkable()) {
+						walkable->set(area.x() + x, area.y() + y);
+					}
+				}
+			}
+			return;
+		}
+		// Same heights as generate_terrain_chunk(), without making the chunk.
+		std::vector<double> heights;
+		get_terrain_heights(height_noise_, area.x(), area.y(), area.w(), area.h(), chunk_size_w_, chunk_size_h_, &heights);
+		auto& data = get_terrain_data();
+		auto ns = heights.cbegin();
+		for(int y = area.y(); y != area.y2(); ++y) {
+			for(int x = area.x(); x != area.x2(); ++x, ++ns) {
+				if(data.getTileAtHeight(static_cast<float>(*ns))->isWalkable()) {
+					walkable->set(x, y);
+				}
+			}
+		}
+	}
+
+	bool Terrain::findPath(const point& from, const point& to, std::vector<point>* path)
+	{
+		return paths_->find(from, to, path);
 	}
 
 	void Terrain::load_terrain_data(const variant& n)
@@ -299,21 +433,21 @@ namespace mercy
 		get_terrain_data().load(n);
 	}
 
+	rect Terrain::getChunkRange(const rect& r) const
+	{
+		// Chunks are placed on a grid so that 0,0 is the co-ordinates of the centre of the 
+		// first chunk, the chunk one up/one right would be at chunk_size_w_,chunk_size_h_.
+		const point first = paths_->get_chunk(point(r.x(), r.y()));
+		const point last = paths_->get_chunk(point(r.x2() - 1, r.y2() - 1));
+		return rect::from_coordinates(first.x, first.y, last.x, last.y);
+	}
+
 	std::vector<chunk_ptr> Terrain::get_chunks_in_area(const rect& r)
 	{
-		// We assume that chunks are placed on a grid. So that 0,0 is the co-ordinates of the 
-		// center of the first chunk, the chunk one up/one right would be at chunk_size_w_,chunk_size_h_
-	
 		std::vector<chunk_ptr> res;
-		
-		// So first step, we create a new rectangle based on our grid that is normalised to cover the rectangle r.
-		rect r_norm = rect::from_coordinates((r.x() - chunk_size_w_/2) / chunk_size_w_,
-			(r.y() - chunk_size_h_/2) / chunk_size_h_,
-			(r.x2() + chunk_size_w_/2) / chunk_size_w_,
-			(r.y2() + chunk_size_h_/2) / chunk_size_h_);
-		// Next iterate over the grid positions and get all the relevant chunks
-		for(int y = r_norm.y(); y < r_norm.y2(); ++y) {
-			for(int x = r_norm.x(); x < r_norm.x2(); ++x) {
+		const rect range = getChunkRange(r);
+		for(int y = range.y(); y < range.y2(); ++y) {
+			for(int x = range.x(); x < range.x2(); ++x) {
 				point pos(x * chunk_size_w_, y * chunk_size_h_);
 				auto it = chunks_.find(pos);
 				if(it == chunks_.end()) {
@@ -324,40 +458,52 @@ namespace mercy
 				}				
 			}
 		}
-		// XXX Need to add some chunk unloading logic.
 		return res;
 	}
 
-	chunk_ptr Terrain::generate_terrain_chunk(const point& pos)
+	chunk_ptr Terrain::makeChunk(const point& pos) const
 	{
-		using namespace noise;
-		module::Perlin pnoise;
-		pnoise.SetSeed(terrain_seed_);
 		chunk_ptr nchunk = std::make_shared<chunk>(pos, chunk_size_w_, chunk_size_h_);
+		std::vector<uint8_t> types;
+		if(regions_->read(point(pos.x / chunk_size_w_, pos.y / chunk_size_h_), &types)) {
+			nchunk->set_terrain(std::move(types));
+			return nchunk;
+		}
+		std::vector<double> heights;
+		get_terrain_heights(height_noise_, pos.x - chunk_size_w_ / 2.0, pos.y - chunk_size_h_ / 2.0, chunk_size_w_, chunk_size_h_, chunk_size_w_, chunk_size_h_, &heights);
+		auto ns = heights.cbegin();
 		for(int y = 0; y < chunk_size_h_; ++y) {
-			for(int x = 0; x < chunk_size_w_; ++x) {
-				auto ns = pnoise.GetValue(
-					(x + pos.x - chunk_size_w_ / 2.0) / (chunk_size_w_ * terrain_scale_factor),
-					(y + pos.y - chunk_size_h_ / 2.0) / (chunk_size_h_ * terrain_scale_factor),
-					0.0);
-				nchunk->set_at(x, y, static_cast<float>(ns));
+			for(int x = 0; x < chunk_size_w_; ++x, ++ns) {
+				nchunk->set_at(x, y, static_cast<float>(*ns));
 			}
 		}
+		return nchunk;
+	}
+
+	void Terrain::addChunk(const chunk_ptr& nchunk)
+	{
+		const point& pos = nchunk->get_position();
 		nchunk->set_renderable(chunk::make_renderable_from_chunk(nchunk));
 		auto& ts = get_terrain_data().get_tile_size();
 		nchunk->get_renderable()->setPosition(pos.x * ts.x, pos.y * ts.y);
+		nchunk->set_last_used(update_count_);
 		chunks_[pos] = nchunk;
+		paths_->chunk_changed(paths_->get_chunk(pos));
+	}
+
+	chunk_ptr Terrain::generate_terrain_chunk(const point& pos)
+	{
+		chunk_ptr nchunk = makeChunk(pos);
+		addChunk(nchunk);
 		return nchunk;
 	}
 
 	terrain_tile_ptr Terrain::getTileAt(const point& p) const
 	{
-		int cw2 = chunk_size_w_/2;
-		int ch2 = chunk_size_h_/2;
 		// position of chunk
-		point cpos(p.x > 0 ? (p.x+cw2)/cw2-1 : (p.x+cw2)/cw2, p.y > 0 ? (p.y+ch2)/ch2-1 : (p.y+ch2)/ch2);
+		const point cpos = getChunkPosition(p);
 		// position in chunk
-		point pos(p.x % cw2 + cw2, p.y % ch2 + ch2);
+		const point pos(p.x - cpos.x + chunk_size_w_/2, p.y - cpos.y + chunk_size_h_/2);
 		ASSERT_LOG(pos.x >= 0 && pos.x < chunk_size_w_, "x coordinate outside of chunk bounds. 0 <= " << pos.x << " < " << chunk_size_w_);
 		ASSERT_LOG(pos.y >= 0 && pos.y < chunk_size_h_, "y coordinate outside of chunk bounds. 0 <= " << pos.y << " < " << chunk_size_h_);
 		auto it = chunks_.find(cpos);
@@ -385,7 +531,7 @@ namespace mercy
 		setTileSize(ts.x, ts.y);
 	}
 
-	void Terrain::clearVisible()
+	void Terrain::handleClearVisible()
 	{
 		// XXX
 	}
@@ -417,10 +563,37 @@ namespace mercy
 		// XXX
 	}
 
-	variant Terrain::handleWrite()
+	void Terrain::handleSetInvisible(int x, int y)
 	{
 		// XXX
-		return variant();
+	}
+
+	void Terrain::saveChunk(const chunk_ptr& c)
+	{
+		const point index(c->get_position().x / chunk_size_w_, c->get_position().y / chunk_size_h_);
+		if(!regions_->contains(index)) {
+			regions_->write(index, c->get_terrain());
+		}
+	}
+
+	variant Terrain::handleWrite()
+	{
+		// Only the chunks still loaded need writing, evicted ones were queued then.
+		streamer_->wait();
+		for(auto& c : chunks_) {
+			saveChunk(c.second);
+		}
+		regions_->flush();
+
+		variant_builder res;
+		res.add("type", "terrain");
+		res.add("seed", terrain_seed_);
+		res.add("start_location", start_location_.x);
+		res.add("start_location", start_location_.y);
+		res.add("chunk_size", chunk_size_w_);
+		res.add("chunk_size", chunk_size_h_);
+		res.add("regions", regions_->get_path());
+		return res.build();
 	}
 
 	void Terrain::update(engine& eng)
@@ -438,10 +611,88 @@ namespace mercy
 			screen_width_in_tiles / 2 + p->pos->pos.x / ts.x,
 			screen_height_in_tiles / 2 + p->pos->pos.y / ts.y);
 
+		++update_count_;
+		std::vector<chunk_ptr> done;
+		streamer_->collect(&done);
+		arrived_.insert(arrived_.end(), done.begin(), done.end());
+		for(int n = 0; n != max_chunks_added_per_update && !arrived_.empty(); ++n) {
+			chunk_ptr c = arrived_.front();
+			arrived_.pop_front();
+			// It may have been generated directly in the meantime.
+			if(chunks_.find(c->get_position()) == chunks_.end()) {
+				addChunk(c);
+			}
+		}
+
+		// Chunks which aren't ready yet are requested and drawn once they arrive, this 
+		// never waits for them.
 		renderable_.clear();
-		std::vector<KRE::SceneObjectPtr> renderables;
-		for(auto& chunk : get_chunks_in_area(area)) {
-			renderable_.emplace_back(chunk->get_renderable());
+		const rect range = getChunkRange(area);
+		for(int y = range.y(); y < range.y2(); ++y) {
+			for(int x = range.x(); x < range.x2(); ++x) {
+				const point pos(x * chunk_size_w_, y * chunk_size_h_);
+				auto it = chunks_.find(pos);
+				if(it == chunks_.end()) {
+					streamer_->request(pos);
+				} else {
+					it->second->set_last_used(update_count_);
+					renderable_.emplace_back(it->second->get_renderable());
+				}
+			}
+		}
+
+		const point player_pos(static_cast<int>(p->pos->pos.x / ts.x), static_cast<int>(p->pos->pos.y / ts.y));
+		if(player_pos != last_player_pos_) {
+			travel_ = point(sign(player_pos.x - last_player_pos_.x), sign(player_pos.y - last_player_pos_.y));
+			last_player_pos_ = player_pos;
+		}
+		prefetchChunks(range);
+		evictChunks();
+	}
+
+	void Terrain::prefetchChunks(const rect& range)
+	{
+		std::vector<point> wanted;
+		if(travel_.x != 0 || travel_.y != 0) {
+			// The strips of chunks the player is heading into, nearest first.
+			for(int d = 1; d <= prefetch_distance; ++d) {
+				const rect ahead = range + point(travel_.x * d, travel_.y * d);
+				for(int y = ahead.y(); y < ahead.y2(); ++y) {
+					for(int x = ahead.x(); x < ahead.x2(); ++x) {
+						const bool in_view = x >= range.x() && x < range.x2() && y >= range.y() && y < range.y2();
+						const point pos(x * chunk_size_w_, y * chunk_size_h_);
+						if(!in_view && chunks_.find(pos) == chunks_.end()) {
+							wanted.emplace_back(pos);
+						}
+					}
+				}
+			}
+		}
+		streamer_->prefetch(wanted);
+	}
+
+	void Terrain::evictChunks()
+	{
+		if(chunks_.size() <= chunk_budget_) {
+			return;
+		}
+		// Down to a little under the budget, so that this doesn't happen every update.
+		const std::size_t target = chunk_budget_ - chunk_budget_ / 8;
+		std::vector<std::pair<unsigned, point>> lru;
+		for(auto& c : chunks_) {
+			// Chunks in view are never evicted.
+			if(c.second->get_last_used() != update_count_) {
+				lru.emplace_back(c.second->get_last_used(), c.first);
+			}
+		}
+		std::sort(lru.begin(), lru.end());
+		for(auto& c : lru) {
+			if(chunks_.size() <= target) {
+				break;
+			}
+			auto it = chunks_.find(c.second);
+			streamer_->save(it->second);
+			chunks_.erase(it);
 		}
 	}
 }
@@ -23,13 +23,20 @@
 
 #pragma once
 
+#include <cstdint>
+#include <deque>
 #include <map>
 #include <memory>
+#include <vector>
 
+#include "chunk_streamer.hpp"
 #include "color.hpp"
 #include "variant.hpp"
 #include "geometry.hpp"
+#include "hpa_pathfinder.hpp"
 #include "map.hpp"
+#include "noise_batch.hpp"
+#include "region_store.hpp"
 
 #include "SceneFwd.hpp"
 
@@ -71,21 +78,31 @@ namespace mercy
 	{
 	public:
 		chunk(const point& pos, int width, int height);
+		// Sets the tile for the height tt.
 		void set_at(int x, int y, float tt);
-		terrain_tile_ptr get_at(int x, int y);
-		TerrainType get_terrain_at(int x, int y);
+		void set_terrain_at(int x, int y, TerrainType tt);
+		const terrain_tile_ptr& get_at(int x, int y) const;
+		TerrainType get_terrain_at(int x, int y) const;
+		// All the terrain types, in rows.
+		const std::vector<uint8_t>& get_terrain() const { return terrain_; }
+		void set_terrain(std::vector<uint8_t> types);
 		int width() const { return width_; }
 		int height() const { return height_; }
 		const point& get_position() const { return pos_; }
 		static KRE::SceneObjectPtr make_renderable_from_chunk(chunk_ptr chk);
 		void set_renderable(const KRE::SceneObjectPtr& r) { renderable_ = r; }
 		KRE::SceneObjectPtr get_renderable() const { return renderable_; }
+		// The update the chunk was last in view, for evicting the least recently used.
+		void set_last_used(unsigned n) { last_used_ = n; }
+		unsigned get_last_used() const { return last_used_; }
 	private:
 		point pos_;
 		int width_;
 		int height_;
-		std::vector<std::vector<terrain_tile_ptr>> terrain_;
+		// Terrain types, in rows.
+		std::vector<uint8_t> terrain_;
 		KRE::SceneObjectPtr renderable_;
+		unsigned last_used_;
 	};
 	typedef std::shared_ptr<chunk> chunk_ptr;
 
@@ -101,7 +118,8 @@ namespace mercy
 		// Will generate chunks as needed for complete coverage.
 		std::vector<chunk_ptr> get_chunks_in_area(const rect& r);
 
-		// Pos is the worldspace position.
+		// Pos is the worldspace position. Generates the chunk on this thread, update() 
+		// streams chunks in from the thread pool instead.
 		chunk_ptr generate_terrain_chunk(const point& pos);
 		terrain_tile_ptr getTileAt(const point& p);
 		// const version of function to get a tile, if pos isn't available in
@@ -116,7 +134,6 @@ namespace mercy
 
 		const std::vector<KRE::SceneObjectPtr>& getRenderable(const rect& r) const override;
 		void generate(engine& eng) override;
-		void clearVisible() override;
 		bool blocksLight(int x, int y) const override;
 		int getDistance(int x, int y) const override;
 		
@@ -125,14 +142,56 @@ namespace mercy
 		bool isFixedSize() const override { return false; }
 		const point& getStartLocation() const override;
 
+		// Paths over any distance, chunks that haven't been generated are sampled 
+		// for walkability but not created.
+		bool findPath(const point& from, const point& to, std::vector<point>* path);
+		// For planning a route and turning the legs into tiles as they're walked.
+		hpa_pathfinder& getPathfinder() { return *paths_; }
+
+		// Chunks out of view are evicted, least recently seen first, to keep to about 
+		// this many. They are generated again from the seed when next needed.
+		void setChunkBudget(std::size_t n) { chunk_budget_ = n; }
+		std::size_t getChunkCount() const { return chunks_.size(); }
+
 	private:
+		void createPathfinder();
+		// Chunks are keyed by the position of their middle tile.
+		point getChunkPosition(const point& p) const;
+		void sampleWalkable(const rect& area, tile_bitmap* walkable) const;
+		// The range of chunks covering r, in chunks rather than tiles.
+		rect getChunkRange(const rect& r) const;
+		// Reads the chunk from the region files, or makes it from the height noise if it 
+		// isn't there. Safe to call from the thread pool.
+		chunk_ptr makeChunk(const point& pos) const;
+		// Writes the chunk to the region files if it isn't already in them. Safe to call 
+		// from the thread pool.
+		void saveChunk(const chunk_ptr& c);
+		// Makes the renderable and adds the chunk to the map.
+		void addChunk(const chunk_ptr& c);
+		void prefetchChunks(const rect& area);
+		void evictChunks();
+		void handleClearVisible() override;
 		void handleSetVisible(int x, int y) override;
+		void handleSetInvisible(int x, int y) override;
 		variant handleWrite() override;
 		int chunk_size_w_;
 		int chunk_size_h_;
 		terrain_map_type chunks_;
 		int terrain_seed_;
+		noise::batch::perlin height_noise_;
 		point start_location_;
 		std::vector<KRE::SceneObjectPtr> renderable_;
+		std::unique_ptr<hpa_pathfinder> paths_;
+		std::size_t chunk_budget_;
+		// Counts calls to update(), for the chunks' last used times.
+		unsigned update_count_;
+		point last_player_pos_;
+		// Direction the player last moved in, chunks are prefetched ahead of them.
+		point travel_;
+		// Chunks from the streamer waiting for their renderables.
+		std::deque<chunk_ptr> arrived_;
+		// Chunks that have been made, so they are loaded rather than made again.
+		std::unique_ptr<region_store> regions_;
+		std::unique_ptr<chunk_streamer> streamer_;
 	};
 }
\ No newline at end of file
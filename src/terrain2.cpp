@@ -23,17 +23,19 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <string>
 #include <vector>
 
-#include <noise/noise.h>
-
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
 #include "asserts.hpp"
+#include "noise_batch.hpp"
+#include "png_writer.hpp"
 #include "profile_timer.hpp"
 #include "terrain2.hpp"
+#include "thread_pool.hpp"
 
 #include "Color.hpp"
 
@@ -65,7 +67,7 @@ namespace
 
 	const float ice_alt = 1.0f;
 	
-	enum class TerrainType {
+	enum class TerrainType : uint8_t {
 		OCEAN,
 		COAST,
 		PLAIN,
@@ -78,27 +80,23 @@ namespace
 	typedef std::vector<KRE::Color> TerrainColor;
 	const KRE::Color& get_terrain_color(TerrainType tt)
 	{
-		static TerrainColor res;
-		if(res.empty()) { 
-			res.emplace_back(0, 0, 150);
-			res.emplace_back(64, 64, 255);
-			res.emplace_back(32, 150, 64);
-			res.emplace_back(100, 100, 0);
-			res.emplace_back(150, 150, 180);
-			res.emplace_back(220, 220, 255);
-			res.emplace_back(150, 120, 130);
-		}
+		// Initialised once, before any caller sees it, as rows are coloured on the thread pool.
+		static const TerrainColor res = []() {
+			TerrainColor colors;
+			colors.emplace_back(0, 0, 150);
+			colors.emplace_back(64, 64, 255);
+			colors.emplace_back(32, 150, 64);
+			colors.emplace_back(100, 100, 0);
+			colors.emplace_back(150, 150, 180);
+			colors.emplace_back(220, 220, 255);
+			colors.emplace_back(150, 120, 130);
+			return colors;
+		}();
 		int ndx = static_cast<int>(tt);
 		ASSERT_LOG(ndx < static_cast<int>(res.size()), "Unable to map " << ndx << " to color.");
 		return res[ndx];
 	}
 
-	float& get_max_rainfall()
-	{
-		static float res = 0;
-		return res;
-	}
-
 	std::vector<std::pair<int,int>> line(float dx, float dy)
 	{
 		std::vector<std::pair<int,int>> res;
@@ -134,81 +132,60 @@ namespace
 
 namespace mercy
 {
-	class Tile
+	namespace
 	{
-	public:
-		Tile() 
-			: type_(TerrainType::PLAIN),
-			  equator_distance_(0),
-			  base_height_(0),
-			  fault_(0),
-			  elevation_(0),
-			  ruggedness_(0),
-			  is_land_(true),
-			  air_moisture_(0),
-			  rainfall_(0)
-		{
-		}
-		explicit Tile(float ed, float bh, float flt, float el, float r, bool is_land, float am, float rain)
-			: type_(TerrainType::PLAIN),
-			  equator_distance_(ed),
-			  base_height_(bh),
-			  fault_(flt),
-			  elevation_(el),
-			  ruggedness_(r),
-			  is_land_(is_land),
-			  air_moisture_(am),
-			  rainfall_(rain)
+		// Rows in each band of the map given to a thread.
+		const int rows_per_band = 16;
+		// Rainfall from a tile is spread over the tiles from this many before it to one 
+		// less than this many after it, in both directions.
+		const int rainfall_kernel = static_cast<int>(rainfall_kernel_radius);
+		// Rows generated at a time when exporting.
+		const int export_strip_rows = 256;
+
+		TerrainType classify(float ed, float bh, float flt, float r)
 		{
-			float alt = base_height_ + fault_ * 0.5f;
-			if(alt + alt * ruggedness_ > (1.0f - equator_distance_) * ice_alt) {
-				type_ = TerrainType::ICE;
-			} else {
-				if(base_height_ < water_level && alt < water_level + coast_threshold) {
-					if(water_level - base_height_ > coast_threshold) {
-						type_ = TerrainType::OCEAN;
-					} else {
-						type_ = TerrainType::COAST;
-					}
-				} else {
-					if(ruggedness_ > mountain_hill_threshold) {
-						type_ = TerrainType::MOUNTAIN;
-					} else if(ruggedness_ + fault_ > hill_threshold && ruggedness_ > fault_) {
-						type_ = TerrainType::HILL;
-					} else if(fault_ > mountain_fault_threshold) {
-						type_ = TerrainType::MOUNTAIN;
-					} else {
-						type_ = TerrainType::PLAIN;
-					}
+			float alt = bh + flt * 0.5f;
+			if(alt + alt * r > (1.0f - ed) * ice_alt) {
+				return TerrainType::ICE;
+			}
+			if(bh < water_level && alt < water_level + coast_threshold) {
+				if(water_level - bh > coast_threshold) {
+					return TerrainType::OCEAN;
 				}
+				return TerrainType::COAST;
+			}
+			if(r > mountain_hill_threshold) {
+				return TerrainType::MOUNTAIN;
+			} else if(r + flt > hill_threshold && r > flt) {
+				return TerrainType::HILL;
+			} else if(flt > mountain_fault_threshold) {
+				return TerrainType::MOUNTAIN;
 			}
+			return TerrainType::PLAIN;
 		}
-		KRE::Color getTileColor()
+
+		KRE::Color get_tile_color(TerrainType tt, float rainfall)
 		{
-			int rain = static_cast<int>(rainfall_);
-			KRE::Color color = get_terrain_color(type_);
+			int rain = static_cast<int>(rainfall);
+			const KRE::Color& color = get_terrain_color(tt);
 			return KRE::Color(color.ri() - rain, color.gi() - rain, color.bi() - rain);
 		}
-		TerrainType getTerrainType() const { return type_; }
-		bool isLand() const { return is_land_; }
-		float getRainfall() const { return rainfall_; }
-		void setRainfall(float rain) { rainfall_ = rain; }
-		float getEquatorDistance() const { return equator_distance_; }
-		float getRuggedness() const { return ruggedness_; }
-	private:
-		TerrainType type_;
-		float equator_distance_;
-		float base_height_;
-		float fault_;
-		float elevation_;		
-		float ruggedness_;
-		bool is_land_;
-		float air_moisture_;
-		float rainfall_;
-	};
 
-	typedef std::unique_ptr<Tile> TilePtr;
+		// The co-ordinates 0 to n-1 as the noise is sampled at them.
+		std::vector<double> scaled_coordinates(int n, float scale)
+		{
+			std::vector<double> res(n);
+			for(int i = 0; i != n; ++i) {
+				res[i] = static_cast<float>(i) * scale;
+			}
+			return res;
+		}
+	}
 
+	// The map is held as a plane for each property, and generated in passes that each 
+	// split the map into bands of rows run on the thread pool. A pass only writes the rows
+	// of its band and only reads what earlier passes wrote, so the map is the same however
+	// many threads there are.
 	class TerrainMap
 	{
 	public:
@@ -221,58 +198,152 @@ namespace mercy
 			  fault_scale_f_(fault_scale / map_size),
 			  erode_scale_f_(fault_erosion_scale / map_size),
 			  land_scale_f_(land_mass_scale / map_size),
-			  hill_scale_f_(hill_scale / map_size)
+			  hill_scale_f_(hill_scale / map_size),
+			  land_noise_(),
+			  fault_noise_(),
+			  erode_noise_(),
+			  hill_noise_(),
+			  equator_distance_(map_size),
+			  window_first_(0),
+			  window_last_(0),
+			  type_(),
+			  is_land_(),
+			  ruggedness_(),
+			  land_rainfall_(),
+			  rainfall_(),
+			  wind_first_(),
+			  wind_steps_(),
+			  wind_reach_(0),
+			  max_rainfall_(0)
 		{			
-			tiles_.resize(height_);
-			for(auto& row : tiles_) {
-				row.resize(width_);
+			land_noise_.set_octave_count(coast_complexity);
+			land_noise_.set_seed(seed_);
+			fault_noise_.set_octave_count(fault_octaves);
+			fault_noise_.set_seed(seed_ + 10);
+			erode_noise_.set_octave_count(static_cast<int>(fault_erosion_octaves));
+			erode_noise_.set_seed(seed_);
+			erode_noise_.set_persistence(0.85);
+			hill_noise_.set_octave_count(hill_octaves);
+			hill_noise_.set_seed(seed_ + 10);
+			hill_noise_.set_persistence(0.9);
+			// The wind only depends on the latitude, so each row's is worked out once.
+			for(int y = 0; y != height_; ++y) {
+				equator_distance_[y] = equatorDistance(y);
+				wind_first_.emplace_back(static_cast<int>(wind_steps_.size()));
+				for(auto& step : prevailingWindLine(y)) {
+					wind_steps_.emplace_back(step);
+					wind_reach_ = std::max(wind_reach_, std::abs(step.second));
+				}
+			}
+			wind_first_.emplace_back(static_cast<int>(wind_steps_.size()));
+		}
+
+		int width() const { return width_; }
+		int height() const { return height_; }
+
+		// Generates the rows first to last, along with the rows around them that they 
+		// depend on, replacing whatever was generated before.
+		void generate(int first, int last)
+		{
+			// Rainfall is spread from the rows around, which get it from the rows upwind.
+			const int rain_first = std::max(first - rainfall_kernel + 1, 0);
+			const int rain_last = std::min(last + rainfall_kernel, height_);
+			window_first_ = std::max(rain_first - wind_reach_, 0);
+			window_last_ = std::min(rain_last + wind_reach_, height_);
+			const std::size_t size = static_cast<std::size_t>(window_last_ - window_first_) * width_;
+			type_.resize(size);
+			is_land_.resize(size);
+			ruggedness_.resize(size);
+			land_rainfall_.resize(size);
+			rainfall_.resize(size);
+
+			const int bands = (rain_last - rain_first + rows_per_band - 1) / rows_per_band;
+			std::vector<float> band_max_rainfall(bands);
+			threading::parallel_for(window_first_, window_last_, rows_per_band, [this](int first, int last) { 
+				generateTerrain(first, last); 
+			});
+			threading::parallel_for(rain_first, rain_last, rows_per_band, [this, rain_first, &band_max_rainfall](int first, int last) { 
+				band_max_rainfall[(first - rain_first) / rows_per_band] = generateRainfall(first, last); 
+			});
+			threading::parallel_for(first, last, rows_per_band, [this](int first, int last) { 
+				spreadRainfall(first, last); 
+			});
+			for(float rainfall : band_max_rainfall) {
+				max_rainfall_ = std::max(max_rainfall_, rainfall);
 			}
-			generate();
 		}
 
-		void generate()
+		// Where tile x,y is in the planes, y must be in the rows last generated.
+		std::size_t getIndex(int x, int y) const
 		{
-			// create tiles.
-			for(int y = 0; y != tiles_.size(); ++y) {
-				const float ed = equatorDistance(y);
-				for(int x = 0; x != tiles_[y].size(); ++x) {
-					const float bh = baseHeight(x, y);
-					const float f = faultLevel(x, y);
-					const float r = hilliness(x, y);
-					const float el = bh + f * 0.5f;
-					const bool is_land = bh >= water_level || el >= water_level + coast_threshold;
+			return static_cast<std::size_t>(y - window_first_) * width_ + x;
+		}
 
-					tiles_[y][x].reset(new Tile(ed, bh, f, el, r, is_land, 0.0f, 0.0f));
+		// Heights, ruggedness and terrain types for the rows first to last.
+		void generateTerrain(int first, int last)
+		{
+			// The noise is made a row at a time.
+			const std::vector<double> land_xs = scaled_coordinates(width_, land_scale_f_);
+			const std::vector<double> fault_xs = scaled_coordinates(width_, fault_scale_f_);
+			const std::vector<double> erode_xs = scaled_coordinates(width_, erode_scale_f_);
+			const std::vector<double> hill_xs = scaled_coordinates(width_, hill_scale_f_);
+			std::vector<double> land(width_), fault(width_), erode(width_), hill(width_);
+			for(int y = first; y != last; ++y) {
+				const float ed = equator_distance_[y];
+				const double land_y = static_cast<float>(y) * land_scale_f_;
+				const double fault_y = static_cast<float>(y) * fault_scale_f_;
+				const double erode_y = static_cast<float>(y) * erode_scale_f_;
+				const double hill_y = static_cast<float>(y) * hill_scale_f_;
+				land_noise_.get_grid(land_xs.data(), width_, &land_y, 1, 0.5, land.data());
+				fault_noise_.get_grid(fault_xs.data(), width_, &fault_y, 1, 0.5, fault.data());
+				erode_noise_.get_grid(erode_xs.data(), width_, &erode_y, 1, 0.5, erode.data());
+				hill_noise_.get_grid(hill_xs.data(), width_, &hill_y, 1, 0.5, hill.data());
+				for(int x = 0; x != width_; ++x) {
+					const float bh = baseHeight(land[x], y);
+					const float f = faultLevel(fault[x], erode[x]);
+					const float r = hilliness(hill[x]);
+					const float el = bh + f * 0.5f;
+					const std::size_t n = getIndex(x, y);
+					type_[n] = classify(ed, bh, f, r);
+					is_land_[n] = bh >= water_level || el >= water_level + coast_threshold;
+					ruggedness_[n] = r;
 				}
 			}
+		}
 
-			// set rainfall
-			for(int y = 0; y != tiles_.size(); ++y) {
-				for(int x = 0; x != tiles_[y].size(); ++x) {
-					set_rainfall(x, y);
+		// The rainfall on each land tile of the rows first to last, from the terrain 
+		// upwind of it. Returns the most rainfall.
+		float generateRainfall(int first, int last)
+		{
+			float max_rainfall = 0;
+			for(int y = first; y != last; ++y) {
+				for(int x = 0; x != width_; ++x) {
+					if(!is_land_[getIndex(x, y)]) {
+						continue;
+					}
+					const float rainfall = getRainfall(x, y);
+					land_rainfall_[getIndex(x, y)] = rainfall;
+					max_rainfall = std::max(max_rainfall, rainfall);
 				}
 			}
+			return max_rainfall;
 		}
 
-		void set_rainfall(int x, int y)
+		float getRainfall(int x, int y) const
 		{
-			TilePtr& tile = tiles_[y][x];
-			if(!tile->isLand()) {
-				return;
-			}
 			bool clear_line = true;
 			float moisture = 0.0f;
 			float rain_factor = 0.5f;
 			int rainfall_reach = rainfall_influence_tiles_;
 
-			for(auto& w : prevailingWindLine(y)) {
-				const int wx = w.first;
-				const int wy = w.second;
+			for(int step = wind_first_[y]; step != wind_first_[y + 1]; ++step) {
+				const int wx = wind_steps_[step].first;
+				const int wy = wind_steps_[step].second;
 				if(y + wy < 0 || y + wy >= height_ || x + wx < 0 || x + wx >= width_) {
 					continue;
 				}
-				TilePtr& nearby_tile = tiles_[y + wy][x + wx];
-				TerrainType type = nearby_tile->getTerrainType();
+				const std::size_t nearby = getIndex(x + wx, y + wy);
+				TerrainType type = type_[nearby];
 
 				if(clear_line) {
 					if(type == TerrainType::COAST || type == TerrainType::OCEAN) {
@@ -280,7 +351,7 @@ namespace mercy
 					} else if(type == TerrainType::MOUNTAIN) {
 						clear_line = false;
 					} else if(type == TerrainType::ICE) {
-						moisture += (1.0f - nearby_tile->getEquatorDistance()) * (1.0f - nearby_tile->getRuggedness());
+						moisture += (1.0f - equator_distance_[y + wy]) * (1.0f - ruggedness_[nearby]);
 					} else {
 						moisture *= 0.25;
 					}
@@ -296,16 +367,31 @@ namespace mercy
 					break;
 				}
 			}
-			const float rainfall = rain_factor * moisture;
-			if(rainfall > get_max_rainfall()) {
-				get_max_rainfall() = rainfall;
-			}
-			for(int ty = y - rainfall_kernel_radius; ty != y + rainfall_kernel_radius; ++ty) {
-				for(int tx = x - rainfall_kernel_radius; tx != x + rainfall_kernel_radius; ++tx) {
-					if(ty < 0 || ty >= height_ || tx < 0 || tx >= width_) {
-						continue;
+			return rain_factor * moisture;
+		}
+
+		// Each land tile's rainfall covers the tiles around it, where they overlap the 
+		// last land tile in row order wins.
+		void spreadRainfall(int first, int last)
+		{
+			for(int y = first; y != last; ++y) {
+				const int sy_first = std::min(y + rainfall_kernel, height_ - 1);
+				const int sy_last = std::max(y - rainfall_kernel + 1, 0);
+				for(int x = 0; x != width_; ++x) {
+					const int sx_first = std::min(x + rainfall_kernel, width_ - 1);
+					const int sx_last = std::max(x - rainfall_kernel + 1, 0);
+					float rainfall = 0.0f;
+					bool found = false;
+					for(int sy = sy_first; sy >= sy_last && !found; --sy) {
+						for(int sx = sx_first; sx >= sx_last; --sx) {
+							if(is_land_[getIndex(sx, sy)]) {
+								rainfall = land_rainfall_[getIndex(sx, sy)];
+								found = true;
+								break;
+							}
+						}
 					}
-					tiles_[ty][tx]->setRainfall(rainfall);
+					rainfall_[getIndex(x, y)] = rainfall;
 				}
 			}
 		}
@@ -322,55 +408,53 @@ namespace mercy
 			return line(delta.first * -moisture_reach_tiles_, delta.second * -moisture_reach_tiles_);
 		}
 
-		float baseHeight(float x, float y) 
+		float baseHeight(double land, float y) const
 		{
-			noise::module::Perlin perlin;
-			perlin.SetOctaveCount(coast_complexity);
-			perlin.SetSeed(seed_);
-			const float height = perlin.GetValue(x * land_scale_f_, y * land_scale_f_, 0.5);
+			const float height = land;
 			return (height + height * std::log10(10.0f * (1.01f - equatorDistance(y))) * equitorial_multiplier) / (equitorial_multiplier + 1.0f);
 		}
 
-		float faultLevel(float x, float y) 
+		float faultLevel(double fault, double erode) const
 		{
-			noise::module::Perlin perlin;
-			perlin.SetOctaveCount(fault_octaves);
-			perlin.SetSeed(seed_ + 10);
-
-			float fl = 1.0f - std::abs(perlin.GetValue(x * fault_scale_f_, y * fault_scale_f_, 0.5));
+			float fl = 1.0f - std::abs(fault);
 			const float thold = std::max(0.0f, (fl - fault_threshold) / (1.0f - fault_threshold));
-			perlin.SetSeed(seed_);
-			perlin.SetOctaveCount(fault_erosion_octaves);
-			perlin.SetPersistence(0.85);
-			fl *= std::abs(perlin.GetValue(x * erode_scale_f_, y * erode_scale_f_, 0.5));
+			fl *= std::abs(erode);
 			fl *= std::log10(thold * 9.0f + 1.0f);
 			return fl;
 		}
 
-		float hilliness(float x, float y) 
+		float hilliness(double hill) const
 		{
-			noise::module::Perlin perlin;
-			perlin.SetOctaveCount(hill_octaves);
-			perlin.SetSeed(seed_ + 10);
-			perlin.SetPersistence(0.9);
-			return std::abs(perlin.GetValue(x * hill_scale_f_, y * hill_scale_f_, 0.5));
+			return std::abs(hill);
 		}
 
-		float equatorDistance(float y)
+		float equatorDistance(float y) const
 		{
 			return std::abs(height_ - y * 2.0f) / height_;
 		}
 
-		void writePng(const std::string& filename) const
+		float getMaxRainfall() const { return max_rainfall_; }
+
+		// The colours of row y as RGBA, y must be in the rows last generated.
+		void getRowColors(int y, glm::u8vec4* out) const
+		{
+			const std::size_t n = getIndex(0, y);
+			for(int x = 0; x != width_; ++x) {
+				out[x] = get_tile_color(type_[n + x], rainfall_[n + x]).as_u8vec4();
+			}
+		}
+
+		void writePng(const std::string& filename)
 		{
+			generate(0, height_);
 			std::vector<glm::u8vec4> data;
 			data.resize(width_ * height_);
-			for(int y = 0; y != height_; ++y) {
-				for(int x = 0; x != width_; ++x) {
-					data[x + y * width_] = tiles_[y][x]->getTileColor().as_u8vec4();
+			threading::parallel_for(0, height_, rows_per_band, [this, &data](int first, int last) {
+				for(int y = first; y != last; ++y) {
+					getRowColors(y, &data[y * width_]);
 				}
-			}
-			stbi_write_png(filename.c_str(), width_, height_, 4, data.data(), height_ * 4);
+			});
+			stbi_write_png(filename.c_str(), width_, height_, 4, data.data(), width_ * 4);
 		}
 	private:
 		int width_;
@@ -382,7 +466,29 @@ namespace mercy
 		float erode_scale_f_;
 		float land_scale_f_;
 		float hill_scale_f_;
-		std::vector<std::vector<TilePtr>> tiles_;
+		noise::batch::perlin land_noise_;
+		noise::batch::perlin fault_noise_;
+		noise::batch::perlin erode_noise_;
+		noise::batch::perlin hill_noise_;
+		// By row.
+		std::vector<float> equator_distance_;
+		// The rows held in the planes below.
+		int window_first_;
+		int window_last_;
+		// By tile, in rows.
+		std::vector<TerrainType> type_;
+		std::vector<uint8_t> is_land_;
+		std::vector<float> ruggedness_;
+		// The rainfall worked out for each land tile, before it is spread out.
+		std::vector<float> land_rainfall_;
+		std::vector<float> rainfall_;
+		// The steps of the line upwind of a tile in each row are wind_steps_ from 
+		// wind_first_[y] to wind_first_[y+1].
+		std::vector<int> wind_first_;
+		std::vector<std::pair<int,int>> wind_steps_;
+		// Furthest a wind line goes up or down.
+		int wind_reach_;
+		float max_rainfall_;
 		TerrainMap() = delete;
 	};
 
@@ -392,4 +498,35 @@ namespace mercy
 		TerrainMap map(mapsize, seed);
 		map.writePng(filename);
 	}
+
+	void export_terrain_image(const std::string& filename, const std::string& tile_path, int mapsize, int seed, int tile_size)
+	{
+		profile::manager pman("export_terrain_image");
+		TerrainMap map(mapsize, seed);
+		std::unique_ptr<png_writer> png(filename.empty() ? nullptr : new png_writer(filename, map.width(), map.height()));
+		std::unique_ptr<tile_pyramid> tiles(tile_path.empty() ? nullptr : new tile_pyramid(tile_path, map.width(), map.height(), tile_size));
+		std::vector<glm::u8vec4> strip(map.width() * export_strip_rows);
+		for(int y = 0; y < map.height(); y += export_strip_rows) {
+			const int rows = std::min(export_strip_rows, map.height() - y);
+			map.generate(y, y + rows);
+			threading::parallel_for(0, rows, rows_per_band, [&map, &strip, y](int first, int last) {
+				for(int row = first; row != last; ++row) {
+					map.getRowColors(y + row, &strip[row * map.width()]);
+				}
+			});
+			const uint8_t* data = reinterpret_cast<const uint8_t*>(strip.data());
+			if(png) {
+				png->write_rows(data, rows, map.width() * 4);
+			}
+			if(tiles) {
+				tiles->write_rows(data, rows, map.width() * 4);
+			}
+		}
+		if(png) {
+			png->finish();
+		}
+		if(tiles) {
+			tiles->finish();
+		}
+	}
 }
@@ -23,7 +23,14 @@
 
 #pragma once
 
+#include <string>
+
 namespace mercy
 {
 	void write_terrain_image(const std::string& filename, int mapsize, int seed);
+	// Generates the map a strip of rows at a time and writes each strip out before the
+	// next, so memory use grows with the width of the map rather than its area. Writes
+	// a PNG of the whole map to filename and a tile_pyramid of it to tile_path, either
+	// is skipped if empty.
+	void export_terrain_image(const std::string& filename, const std::string& tile_path, int mapsize, int seed, int tile_size=256);
 }
@@ -0,0 +1,199 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <algorithm>
+
+#include "asserts.hpp"
+#include "thread_pool.hpp"
+
+namespace threading
+{
+	thread_pool::thread_pool(int num_threads)
+		: queues_(),
+		  threads_(),
+		  done_(false),
+		  queued_(0),
+		  next_queue_(0),
+		  sleep_mutex_(),
+		  sleep_cv_()
+	{
+		if(num_threads <= 0) {
+			num_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+		}
+		for(int n = 0; n != num_threads; ++n) {
+			queues_.emplace_back(new work_queue);
+		}
+		for(int n = 0; n != num_threads; ++n) {
+			threads_.emplace_back(&thread_pool::worker, this, n);
+		}
+	}
+
+	thread_pool::~thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex_);
+			done_ = true;
+		}
+		sleep_cv_.notify_all();
+		for(auto& t : threads_) {
+			t.join();
+		}
+	}
+
+	thread_pool& thread_pool::get()
+	{
+		static thread_pool res;
+		return res;
+	}
+
+	int thread_pool::get_queue_index() const
+	{
+		// Tasks submitted from a worker go on that workers own queue.
+		const auto id = std::this_thread::get_id();
+		for(int n = 0; n != static_cast<int>(threads_.size()); ++n) {
+			if(threads_[n].get_id() == id) {
+				return n;
+			}
+		}
+		return -1;
+	}
+
+	void thread_pool::submit(task t)
+	{
+		int ndx = get_queue_index();
+		if(ndx < 0) {
+			ndx = static_cast<int>(next_queue_++ % queues_.size());
+		}
+		{
+			std::lock_guard<std::mutex> lock(queues_[ndx]->mutex);
+			queues_[ndx]->tasks.emplace_back(std::move(t));
+		}
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex_);
+			++queued_;
+		}
+		sleep_cv_.notify_one();
+	}
+
+	bool thread_pool::pop(int ndx, task& t)
+	{
+		auto& q = *queues_[ndx];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if(q.tasks.empty()) {
+			return false;
+		}
+		t = std::move(q.tasks.back());
+		q.tasks.pop_back();
+		--queued_;
+		return true;
+	}
+
+	bool thread_pool::steal(int ndx, task& t)
+	{
+		const int num_queues = static_cast<int>(queues_.size());
+		for(int n = 1; n <= num_queues; ++n) {
+			auto& q = *queues_[(ndx + n) % num_queues];
+			std::lock_guard<std::mutex> lock(q.mutex);
+			if(!q.tasks.empty()) {
+				t = std::move(q.tasks.front());
+				q.tasks.pop_front();
+				--queued_;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool thread_pool::run_pending_task()
+	{
+		task t;
+		const int ndx = get_queue_index();
+		if((ndx >= 0 && pop(ndx, t)) || steal(ndx < 0 ? 0 : ndx, t)) {
+			t();
+			return true;
+		}
+		return false;
+	}
+
+	void thread_pool::worker(int ndx)
+	{
+		while(true) {
+			task t;
+			if(pop(ndx, t) || steal(ndx, t)) {
+				t();
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(sleep_mutex_);
+			sleep_cv_.wait(lock, [this]() { return done_ || queued_ > 0; });
+			if(done_ && queued_ == 0) {
+				return;
+			}
+		}
+	}
+
+	task_group::task_group(thread_pool& pool)
+		: pool_(pool),
+		  outstanding_(0)
+	{
+	}
+
+	task_group::~task_group()
+	{
+		wait();
+	}
+
+	void task_group::run(task t)
+	{
+		++outstanding_;
+		pool_.submit([this, t]() {
+			t();
+			--outstanding_;
+		});
+	}
+
+	void task_group::wait()
+	{
+		while(outstanding_ > 0) {
+			if(!pool_.run_pending_task()) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void parallel_for(int begin, int end, int grain, const std::function<void(int, int)>& fn, thread_pool& pool)
+	{
+		ASSERT_LOG(grain > 0, "parallel_for grain size must be greater than zero: " << grain);
+		if(end - begin <= grain) {
+			if(end > begin) {
+				fn(begin, end);
+			}
+			return;
+		}
+		task_group group(pool);
+		for(int n = begin; n < end; n += grain) {
+			const int last = std::min(end, n + grain);
+			group.run([&fn, n, last]() { fn(n, last); });
+		}
+		group.wait();
+	}
+}
@@ -0,0 +1,99 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace threading
+{
+	typedef std::function<void()> task;
+
+	// Fixed size pool of worker threads. Each worker has its own queue, it takes work from
+	// the back of its own queue and steals from the front of the other queues when it runs out.
+	class thread_pool
+	{
+	public:
+		// num_threads == 0 means use one less than the number of hardware threads,
+		// so that the thread calling wait() has a core to itself.
+		explicit thread_pool(int num_threads=0);
+		~thread_pool();
+
+		void submit(task t);
+		// Runs a single pending task on the calling thread, returns false if there
+		// was nothing to run.
+		bool run_pending_task();
+
+		int size() const { return static_cast<int>(threads_.size()); }
+
+		// Shared pool used by the engine and anything else which wants to run in parallel.
+		static thread_pool& get();
+	private:
+		struct work_queue
+		{
+			std::mutex mutex;
+			std::deque<task> tasks;
+		};
+		void worker(int ndx);
+		int get_queue_index() const;
+		bool pop(int ndx, task& t);
+		bool steal(int ndx, task& t);
+
+		std::vector<std::unique_ptr<work_queue>> queues_;
+		std::vector<std::thread> threads_;
+		std::atomic<bool> done_;
+		std::atomic<int> queued_;
+		std::atomic<unsigned> next_queue_;
+		std::mutex sleep_mutex_;
+		std::condition_variable sleep_cv_;
+
+		thread_pool(const thread_pool&) = delete;
+		void operator=(const thread_pool&) = delete;
+	};
+
+	// Tracks a set of tasks submitted to a pool, so they can be waited upon.
+	class task_group
+	{
+	public:
+		explicit task_group(thread_pool& pool=thread_pool::get());
+		~task_group();
+		void run(task t);
+		// Waits for all the tasks to finish, running pending tasks on this thread in the meantime.
+		void wait();
+	private:
+		thread_pool& pool_;
+		std::atomic<int> outstanding_;
+		task_group(const task_group&) = delete;
+		void operator=(const task_group&) = delete;
+	};
+
+	// Calls fn(first, last) for sub-ranges of [begin,end) of at most grain elements, in parallel.
+	void parallel_for(int begin, int end, int grain, const std::function<void(int, int)>& fn, thread_pool& pool=thread_pool::get());
+}
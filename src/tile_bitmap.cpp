@@ -0,0 +1,241 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "random.hpp"
+#include "tile_bitmap.hpp"
+#include "unit_test.hpp"
+
+namespace
+{
+	int popcount(uint64_t w)
+	{
+#if defined(__GNUC__)
+		return __builtin_popcountll(w);
+#else
+		w = w - ((w >> 1) & 0x5555555555555555ULL);
+		w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+		w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+		return static_cast<int>((w * 0x0101010101010101ULL) >> 56);
+#endif
+	}
+}
+
+tile_bitmap::tile_bitmap()
+	: bounds_(),
+	  words_per_row_(0),
+	  words_()
+{
+}
+
+tile_bitmap::tile_bitmap(const rect& bounds)
+	: bounds_(),
+	  words_per_row_(0),
+	  words_()
+{
+	reset(bounds);
+}
+
+void tile_bitmap::reset(const rect& bounds)
+{
+	bounds_ = bounds;
+	words_per_row_ = (std::max(bounds.w(), 0) + 63) / 64;
+	words_.assign(words_per_row_ * std::max(bounds.h(), 0), 0);
+}
+
+void tile_bitmap::clear()
+{
+	std::fill(words_.begin(), words_.end(), 0);
+}
+
+std::size_t tile_bitmap::count() const
+{
+	std::size_t res = 0;
+	for(auto w : words_) {
+		res += popcount(w);
+	}
+	return res;
+}
+
+bool tile_bitmap::none() const
+{
+	for(auto w : words_) {
+		if(w != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int tile_bitmap::count_trailing_zeros(uint64_t w)
+{
+#if defined(_MSC_VER)
+	unsigned long n;
+	if(_BitScanForward(&n, static_cast<unsigned long>(w))) {
+		return static_cast<int>(n);
+	}
+	_BitScanForward(&n, static_cast<unsigned long>(w >> 32));
+	return static_cast<int>(n) + 32;
+#else
+	return __builtin_ctzll(w);
+#endif
+}
+
+uint64_t tile_bitmap::extract(int row, int bit) const
+{
+	const uint64_t* words = words_.data() + row * words_per_row_;
+	// floor division, bit may be negative.
+	const int q = bit >= 0 ? bit / 64 : -((-bit + 63) / 64);
+	const int s = bit - q * 64;
+	uint64_t res = 0;
+	if(q >= 0 && q < words_per_row_) {
+		res = words[q] >> s;
+	}
+	if(s != 0 && q + 1 >= 0 && q + 1 < words_per_row_) {
+		res |= words[q + 1] << (64 - s);
+	}
+	return res;
+}
+
+tile_bitmap& tile_bitmap::operator|=(const tile_bitmap& other)
+{
+	if(other.bounds_.w() <= 0 || other.bounds_.h() <= 0) {
+		return *this;
+	}
+	if(bounds_.w() <= 0 || bounds_.h() <= 0) {
+		*this = other;
+		return *this;
+	}
+	const int x1 = std::min(bounds_.x(), other.bounds_.x());
+	const int y1 = std::min(bounds_.y(), other.bounds_.y());
+	const int x2 = std::max(bounds_.x2(), other.bounds_.x2());
+	const int y2 = std::max(bounds_.y2(), other.bounds_.y2());
+	if(x1 != bounds_.x() || y1 != bounds_.y() || x2 != bounds_.x2() || y2 != bounds_.y2()) {
+		tile_bitmap grown(rect(x1, y1, x2 - x1, y2 - y1));
+		for(int row = 0; row != bounds_.h(); ++row) {
+			uint64_t* dst = grown.words_.data() + (bounds_.y() - y1 + row) * grown.words_per_row_;
+			const int offset = x1 - bounds_.x();
+			for(int n = 0; n != grown.words_per_row_; ++n) {
+				dst[n] |= extract(row, offset + n * 64);
+			}
+		}
+		std::swap(*this, grown);
+	}
+	const int offset = bounds_.x() - other.bounds_.x();
+	for(int row = 0; row != other.bounds_.h(); ++row) {
+		uint64_t* dst = words_.data() + (other.bounds_.y() - bounds_.y() + row) * words_per_row_;
+		for(int n = 0; n != words_per_row_; ++n) {
+			dst[n] |= other.extract(row, offset + n * 64);
+		}
+	}
+	return *this;
+}
+
+tile_bitmap& tile_bitmap::operator&=(const tile_bitmap& other)
+{
+	const int offset = bounds_.x() - other.bounds_.x();
+	for(int row = 0; row != bounds_.h(); ++row) {
+		uint64_t* dst = words_.data() + row * words_per_row_;
+		const int other_row = bounds_.y() + row - other.bounds_.y();
+		if(other_row < 0 || other_row >= other.bounds_.h()) {
+			std::fill(dst, dst + words_per_row_, 0);
+			continue;
+		}
+		for(int n = 0; n != words_per_row_; ++n) {
+			dst[n] &= other.extract(other_row, offset + n * 64);
+		}
+	}
+	return *this;
+}
+
+std::set<point> tile_bitmap::to_set() const
+{
+	std::set<point> res;
+	for_each([&res](int x, int y) { res.emplace(x, y); });
+	return res;
+}
+
+namespace
+{
+	// Random tiles in r, added to both the bitmap and the set.
+	void fill_random(const rect& r, tile_bitmap* bitmap, std::set<point>* tiles)
+	{
+		bitmap->reset(r);
+		tiles->clear();
+		for(int n = 0; n != r.w() * r.h() / 3; ++n) {
+			const point p(generator::get_uniform_int<int>(r.x(), r.x2() - 1), generator::get_uniform_int<int>(r.y(), r.y2() - 1));
+			bitmap->set(p);
+			tiles->insert(p);
+		}
+	}
+}
+
+UNIT_TEST(tile_bitmap_operations)
+{
+	// Bounds that aren't word aligned, some negative and some overlapping.
+	const rect bounds[] = { rect(-70, -3, 150, 9), rect(5, 2, 64, 12), rect(-200, 0, 3, 3), rect(60, -10, 130, 4) };
+	for(auto& ra : bounds) {
+		for(auto& rb : bounds) {
+			tile_bitmap a, b;
+			std::set<point> sa, sb;
+			fill_random(ra, &a, &sa);
+			fill_random(rb, &b, &sb);
+			CHECK_EQ(a.count(), sa.size());
+			CHECK_EQ(a.none(), sa.empty());
+			CHECK_EQ(a.to_set() == sa, true);
+			CHECK_EQ(a.test(ra.x() - 1, ra.y()), false);
+
+			tile_bitmap u = a;
+			u |= b;
+			std::set<point> su = sa;
+			su.insert(sb.begin(), sb.end());
+			CHECK_EQ(u.to_set() == su, true);
+
+			tile_bitmap i = a;
+			i &= b;
+			std::set<point> si;
+			for(auto& p : sa) {
+				if(sb.count(p) != 0) {
+					si.insert(p);
+				}
+			}
+			CHECK_EQ(i.to_set() == si, true);
+			CHECK_EQ(i.get_bounds().x() == ra.x() && i.get_bounds().y() == ra.y() && i.get_bounds().w() == ra.w() && i.get_bounds().h() == ra.h(), true);
+
+			for(auto& p : sb) {
+				a.unset(p.x, p.y);
+				sa.erase(p);
+			}
+			CHECK_EQ(a.count(), sa.size());
+			// Visited row by row.
+			std::vector<point> order;
+			a.for_each([&order](int x, int y) { order.emplace_back(x, y); });
+			CHECK_EQ(std::is_sorted(order.begin(), order.end(), [](const point& l, const point& r) { return l.y < r.y || (l.y == r.y && l.x < r.x); }), true);
+		}
+	}
+}
@@ -0,0 +1,109 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+#include "geometry.hpp"
+
+// A set of tiles stored as one bit per tile over a rectangle, i.e. the bounding box of
+// a field of view. Membership tests are O(1), union and intersection work a word at a 
+// time and iterating visits only the tiles that are set.
+class tile_bitmap
+{
+public:
+	tile_bitmap();
+	explicit tile_bitmap(const rect& bounds);
+
+	// Clears all the tiles and changes the area covered, storage is reused.
+	void reset(const rect& bounds);
+	void clear();
+	const rect& get_bounds() const { return bounds_; }
+	// Rows of words, bit n of a row's words is the tile at bounds x + n.
+	const uint64_t* data() const { return words_.data(); }
+	int get_words_per_row() const { return words_per_row_; }
+
+	// Tiles outside the bounds are ignored.
+	void set(int x, int y) {
+		if(in_bounds(x, y)) {
+			const int col = x - bounds_.x();
+			words_[(y - bounds_.y()) * words_per_row_ + (col >> 6)] |= uint64_t(1) << (col & 63);
+		}
+	}
+	void set(const point& p) { set(p.x, p.y); }
+	void unset(int x, int y) {
+		if(in_bounds(x, y)) {
+			const int col = x - bounds_.x();
+			words_[(y - bounds_.y()) * words_per_row_ + (col >> 6)] &= ~(uint64_t(1) << (col & 63));
+		}
+	}
+	// False for tiles outside the bounds.
+	bool test(int x, int y) const {
+		if(!in_bounds(x, y)) {
+			return false;
+		}
+		const int col = x - bounds_.x();
+		return (words_[(y - bounds_.y()) * words_per_row_ + (col >> 6)] >> (col & 63)) & 1;
+	}
+	bool test(const point& p) const { return test(p.x, p.y); }
+
+	std::size_t count() const;
+	bool none() const;
+
+	// The bounds grow to cover both bitmaps.
+	tile_bitmap& operator|=(const tile_bitmap& other);
+	// The bounds are kept, tiles outside other's bounds are cleared.
+	tile_bitmap& operator&=(const tile_bitmap& other);
+
+	// Calls fn(x, y) for each tile that is set, row by row.
+	template<typename F>
+	void for_each(F fn) const {
+		for(int row = 0; row != bounds_.h(); ++row) {
+			const uint64_t* words = words_.data() + row * words_per_row_;
+			for(int n = 0; n != words_per_row_; ++n) {
+				uint64_t w = words[n];
+				while(w != 0) {
+					fn(bounds_.x() + n * 64 + count_trailing_zeros(w), bounds_.y() + row);
+					w &= w - 1;
+				}
+			}
+		}
+	}
+
+	// For code that expects a set of points.
+	std::set<point> to_set() const;
+private:
+	bool in_bounds(int x, int y) const {
+		return x >= bounds_.x() && y >= bounds_.y() && x < bounds_.x2() && y < bounds_.y2();
+	}
+	// 64 bits of a row starting at column bit, bits outside the row are 0.
+	uint64_t extract(int row, int bit) const;
+	static int count_trailing_zeros(uint64_t w);
+
+	rect bounds_;
+	int words_per_row_;
+	std::vector<uint64_t> words_;
+};
@@ -0,0 +1,126 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include "asserts.hpp"
+#include "turn_scheduler.hpp"
+
+turn_scheduler::turn_scheduler()
+	: heap_(),
+	  positions_(),
+	  now_(0),
+	  seq_(0)
+{
+}
+
+void turn_scheduler::add(component::entity_id id, int speed)
+{
+	ASSERT_LOG(speed > 0, "Actor speed must be greater than zero: " << speed);
+	ASSERT_LOG(!contains(id), "Entity " << id << " already scheduled.");
+	if(id >= positions_.size()) {
+		positions_.resize(id + 1, npos);
+	}
+	actor a;
+	a.next = now_ + get_interval(speed);
+	a.seq = seq_++;
+	a.id = id;
+	a.speed = speed;
+	heap_.emplace_back(a);
+	positions_[id] = heap_.size() - 1;
+	sift_up(heap_.size() - 1);
+}
+
+void turn_scheduler::remove(component::entity_id id)
+{
+	if(!contains(id)) {
+		return;
+	}
+	const std::size_t n = positions_[id];
+	positions_[id] = npos;
+	const actor last = heap_.back();
+	heap_.pop_back();
+	if(n == heap_.size()) {
+		return;
+	}
+	place(n, last);
+	if(n > 0 && before(last, heap_[(n - 1) / 2])) {
+		sift_up(n);
+	} else {
+		sift_down(n);
+	}
+}
+
+void turn_scheduler::clear()
+{
+	heap_.clear();
+	positions_.clear();
+}
+
+void turn_scheduler::set_speed(component::entity_id id, int speed)
+{
+	ASSERT_LOG(speed > 0, "Actor speed must be greater than zero: " << speed);
+	ASSERT_LOG(contains(id), "Entity " << id << " isn't scheduled.");
+	heap_[positions_[id]].speed = speed;
+}
+
+void turn_scheduler::delay(component::entity_id id, int turns)
+{
+	ASSERT_LOG(contains(id), "Entity " << id << " isn't scheduled.");
+	ASSERT_LOG(turns >= 0, "Can't delay an actor by a negative number of turns: " << turns);
+	heap_[positions_[id]].next += static_cast<time_type>(turns) * turn_length;
+	sift_down(positions_[id]);
+}
+
+void turn_scheduler::sift_up(std::size_t n)
+{
+	const actor a = heap_[n];
+	while(n > 0) {
+		const std::size_t parent = (n - 1) / 2;
+		if(!before(a, heap_[parent])) {
+			break;
+		}
+		place(n, heap_[parent]);
+		n = parent;
+	}
+	place(n, a);
+}
+
+void turn_scheduler::sift_down(std::size_t n)
+{
+	const actor a = heap_[n];
+	const std::size_t count = heap_.size();
+	for(;;) {
+		std::size_t child = 2 * n + 1;
+		if(child >= count) {
+			break;
+		}
+		if(child + 1 < count && before(heap_[child + 1], heap_[child])) {
+			++child;
+		}
+		if(!before(heap_[child], a)) {
+			break;
+		}
+		place(n, heap_[child]);
+		n = child;
+	}
+	place(n, a);
+}
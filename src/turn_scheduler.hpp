@@ -0,0 +1,125 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "component.hpp"
+
+// Energy based scheduling of actors. Each actor has a speed, normal_speed being one
+// action per turn, and the time of its next action. Actors are kept in a binary 
+// heap on that time, indexed by entity id, so only actors whose time has come are 
+// ever touched. Advancing by any number of turns costs O(k log n) for the k actors 
+// that are due, each actor being told how many actions it gets in one go.
+class turn_scheduler
+{
+public:
+	typedef int64_t time_type;
+	enum { 
+		normal_speed = 100,
+		// Time units in a turn.
+		turn_length = 100,
+	};
+
+	turn_scheduler();
+
+	// The actor first acts one action interval from now.
+	void add(component::entity_id id, int speed=normal_speed);
+	void remove(component::entity_id id);
+	void clear();
+	bool contains(component::entity_id id) const {
+		return id < positions_.size() && positions_[id] != npos;
+	}
+	std::size_t size() const { return heap_.size(); }
+
+	// Takes effect from the actors next action.
+	void set_speed(component::entity_id id, int speed);
+	int get_speed(component::entity_id id) const { return heap_[positions_[id]].speed; }
+	// Pushes the next action of the actor back by the given number of turns.
+	void delay(component::entity_id id, int turns);
+
+	time_type get_time() const { return now_; }
+	time_type get_next_time(component::entity_id id) const { return heap_[positions_[id]].next; }
+	// Time of the earliest action, now if there are no actors.
+	time_type peek_time() const { return heap_.empty() ? now_ : heap_.front().next; }
+
+	// Moves time forward, calling fn(entity_id, int actions) once for each actor that 
+	// acts before then, in order of their first action. fn may remove actors.
+	// Returns the number of actors that acted.
+	template<typename F>
+	std::size_t advance(int turns, F fn) {
+		return advance_to(now_ + static_cast<time_type>(turns) * turn_length, fn);
+	}
+	template<typename F>
+	std::size_t advance_to(time_type t, F fn) {
+		std::size_t woken = 0;
+		while(!heap_.empty() && heap_.front().next <= t) {
+			const component::entity_id id = heap_.front().id;
+			const time_type interval = get_interval(heap_.front().speed);
+			const int actions = static_cast<int>((t - heap_.front().next) / interval) + 1;
+			fn(id, actions);
+			++woken;
+			if(contains(id)) {
+				auto& a = heap_[positions_[id]];
+				a.next += actions * get_interval(a.speed);
+				a.seq = seq_++;
+				sift_down(positions_[id]);
+			}
+		}
+		if(t > now_) {
+			now_ = t;
+		}
+		return woken;
+	}
+private:
+	enum : std::size_t { npos = ~std::size_t(0) };
+	struct actor
+	{
+		time_type next;
+		// Breaks ties in next so the order actors are woken in is deterministic.
+		uint64_t seq;
+		component::entity_id id;
+		int speed;
+	};
+	static time_type get_interval(int speed) {
+		const time_type interval = static_cast<time_type>(turn_length) * normal_speed / speed;
+		return interval > 0 ? interval : 1;
+	}
+	static bool before(const actor& a, const actor& b) {
+		return a.next < b.next || (a.next == b.next && a.seq < b.seq);
+	}
+	void place(std::size_t n, const actor& a) {
+		heap_[n] = a;
+		positions_[a.id] = n;
+	}
+	void sift_up(std::size_t n);
+	void sift_down(std::size_t n);
+
+	std::vector<actor> heap_;
+	// Index into heap_ for each entity id, npos if the entity isn't scheduled.
+	std::vector<std::size_t> positions_;
+	time_type now_;
+	uint64_t seq_;
+};
@@ -0,0 +1,115 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#include <algorithm>
+
+#include "asserts.hpp"
+#include "map.hpp"
+#include "visibility.hpp"
+#include "visibility_cache.hpp"
+
+visibility_cache::visibility_cache(const mercy::BaseMap& map)
+	: map_(map),
+	  observers_(),
+	  free_ids_(),
+	  scratch_()
+{
+}
+
+visibility_cache::observer_id visibility_cache::add()
+{
+	observer_id id;
+	if(!free_ids_.empty()) {
+		id = free_ids_.back();
+		free_ids_.pop_back();
+	} else {
+		id = observers_.size();
+		observers_.emplace_back();
+	}
+	observers_[id].active = true;
+	return id;
+}
+
+void visibility_cache::remove(observer_id id)
+{
+	ASSERT_LOG(id < observers_.size() && observers_[id].active, "Invalid observer: " << id);
+	observers_[id] = observer();
+	free_ids_.emplace_back(id);
+}
+
+void visibility_cache::reset(observer_id id)
+{
+	auto& ob = observers_[id];
+	ob.radius = -1;
+	ob.visible.reset(rect());
+}
+
+void visibility_cache::move(observer_id id, const point& pos, int radius, const change_fn& changed)
+{
+	ASSERT_LOG(id < observers_.size() && observers_[id].active, "Invalid observer: " << id);
+	auto& ob = observers_[id];
+	ob.pos = pos;
+	ob.radius = radius;
+	map_.getVisibleTilesAt(pos, radius, &scratch_);
+	apply(id, changed);
+}
+
+void visibility_cache::tile_changed(const point& p, const change_fn& changed)
+{
+	for(observer_id id = 0; id != observers_.size(); ++id) {
+		auto& ob = observers_[id];
+		// The opacity of tiles that can't be seen doesn't matter.
+		if(!ob.active || !ob.visible.test(p)) {
+			continue;
+		}
+		const unsigned affected = fov::octants_containing(p.x - ob.pos.x, p.y - ob.pos.y);
+		scratch_ = ob.visible;
+		for(int octant = 0; octant != 8; ++octant) {
+			if(affected & (1 << octant)) {
+				fov::for_each_in_octant(octant, ob.pos, std::max(ob.radius, 0), [this](int x, int y) { scratch_.unset(x, y); });
+			}
+		}
+		// Tiles on the edges of the cleared octants may have been lit by the neighbouring
+		// octants, so those are cast again too. Casting only ever sets tiles.
+		const unsigned neighbours = ((affected << 1) | (affected >> 7) | (affected >> 1) | (affected << 7)) & fov::all_octants;
+		map_.addVisibleTiles(ob.pos, ob.radius, affected | neighbours, &scratch_);
+		apply(id, changed);
+	}
+}
+
+void visibility_cache::apply(observer_id id, const change_fn& changed)
+{
+	auto& ob = observers_[id];
+	const tile_bitmap& now = scratch_;
+	ob.visible.for_each([&](int x, int y) {
+		if(!now.test(x, y)) {
+			changed(id, x, y, false);
+		}
+	});
+	now.for_each([&](int x, int y) {
+		if(!ob.visible.test(x, y)) {
+			changed(id, x, y, true);
+		}
+	});
+	std::swap(ob.visible, scratch_);
+}
@@ -0,0 +1,80 @@
+/*
+	Copyright (C) 2014-2015 by Kristina Simpson <sweet.kristas@gmail.com>
+	
+	This software is provided 'as-is', without any express or implied
+	warranty. In no event will the authors be held liable for any damages
+	arising from the use of this software.
+
+	Permission is granted to anyone to use this software for any purpose,
+	including commercial applications, and to alter it and redistribute it
+	freely, subject to the following restrictions:
+
+	   1. The origin of this software must not be misrepresented; you must not
+	   claim that you wrote the original software. If you use this software
+	   in a product, an acknowledgement in the product documentation would be
+	   appreciated but is not required.
+
+	   2. Altered source versions must be plainly marked as such, and must not be
+	   misrepresented as being the original software.
+
+	   3. This notice may not be removed or altered from any source
+	   distribution.
+*/
+
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "geometry.hpp"
+#include "tile_bitmap.hpp"
+
+namespace mercy
+{
+	class BaseMap;
+}
+
+// The last field of view of each of a set of observers, kept up to date as they move
+// and as tiles change opacity. A change of opacity only recasts the octants holding 
+// the tile for the observers that can see it. Callers are told which tiles changed 
+// visibility so that per tile state can be updated without clearing the whole map.
+class visibility_cache
+{
+public:
+	typedef std::size_t observer_id;
+	// Called with a tile that became visible (true) or stopped being visible (false).
+	typedef std::function<void(observer_id, int, int, bool)> change_fn;
+
+	explicit visibility_cache(const mercy::BaseMap& map);
+
+	// New observer that can't see anything until it is moved.
+	observer_id add();
+	void remove(observer_id id);
+	// Forgets what the observer could see, without reporting changes.
+	void reset(observer_id id);
+
+	const tile_bitmap& get_visible(observer_id id) const { return observers_[id].visible; }
+	const point& get_position(observer_id id) const { return observers_[id].pos; }
+	int get_radius(observer_id id) const { return observers_[id].radius; }
+
+	// Recasts the observer's field of view from its new position.
+	void move(observer_id id, const point& pos, int radius, const change_fn& changed);
+	// Call after the opacity of the tile at p changes.
+	void tile_changed(const point& p, const change_fn& changed);
+private:
+	struct observer
+	{
+		observer() : pos(), radius(-1), visible(), active(false) {}
+		point pos;
+		int radius;
+		tile_bitmap visible;
+		bool active;
+	};
+	// Reports the differences between the observer's view and scratch_, then swaps them.
+	void apply(observer_id id, const change_fn& changed);
+
+	const mercy::BaseMap& map_;
+	std::vector<observer> observers_;
+	std::vector<observer_id> free_ids_;
+	tile_bitmap scratch_;
+};
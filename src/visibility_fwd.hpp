@@ -27,3 +27,8 @@
 
 class Visibility;
 typedef std::shared_ptr<Visibility> VisibilityPtr;
+
+namespace fov
+{
+	struct grid_access;
+}